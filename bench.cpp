@@ -0,0 +1,411 @@
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QSurfaceFormat>
+#include <QTemporaryFile>
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include "bench.h"
+#include "memorybudget.h"
+#include "plyreader.h"
+#include "pointstore.h"
+#include "scene.h"
+
+// voxel carving against silhouette intervals, on the same masks and grid
+static void benchCarving(Scene& scene)
+{
+  const int views = scene._listView.length();
+  std::printf("carving\n");
+  std::printf("%8s %6s %14s %16s %9s %10s %12s\n", "nbVox", "views", "voxels (ms)", "intervals (ms)", "speedup", "occupied", "mismatches");
+
+  // the first carve decodes the masks, keep it out of the timings
+  scene.setVoxelSize(8);
+  scene.carve();
+
+  // every view, then one in four from 512 up: the interval engine's lead
+  // grows with the grid and shrinks with the views
+  const int sizes[] = { 32, 64, 128, 256, 512, 1024 };
+  for (int nbVox : sizes) {
+    scene.setVoxelSize(nbVox);
+    if (scene.nbVox() != nbVox) {
+      std::printf("%8d: over the memory budget\n", nbVox);
+      break;
+    }
+    const size_t cells = size_t(nbVox) * nbVox * nbVox;
+    for (int step = 1; step <= (nbVox >= 512 && views >= 8 ? 4 : 1); step += 3) {
+      for (int v = 0; v < views; v++) {
+        scene.setCameraEnabled(v, v % step == 0);
+      }
+      QElapsedTimer timer;
+
+      scene.setCarveEngine(Scene::CarveVoxels);
+      timer.start();
+      scene.carve();
+      const double voxelsMs = timer.nsecsElapsed() * 1e-6;
+      std::vector<unsigned char> reference(scene.voxels(), scene.voxels() + cells);
+
+      scene.setCarveEngine(Scene::CarveIntervals);
+      timer.restart();
+      scene.carve();
+      const double intervalsMs = timer.nsecsElapsed() * 1e-6;
+
+      size_t occupied = 0, mismatches = 0;
+      for (size_t v = 0; v < cells; v++) {
+        occupied += scene.voxels()[v];
+        mismatches += scene.voxels()[v] != reference[v];
+      }
+      std::printf("%8d %6d %14.1f %16.1f %8.1fx %10zu %12zu\n",
+                  nbVox, (views + step - 1) / step, voxelsMs, intervalsMs, voxelsMs / intervalsMs, occupied, mismatches);
+    }
+  }
+  for (int v = 0; v < views; v++) {
+    scene.setCameraEnabled(v, true);
+  }
+}
+
+// free-space carving after the silhouette carve, one ray per camera seeing a point
+static void benchFreeSpace(Scene& scene)
+{
+  std::printf("free-space carving, %d views, %zu points\n", scene._listView.length(), scene.pointsCount());
+  std::printf("%8s %9s %12s %12s %10s %12s\n", "nbVox", "ray step", "rays", "freed", "ms", "M rays/s");
+
+  qulonglong rays = 0, freed = 0;
+  double milliseconds = 0.;
+  QObject::connect(&scene, &Scene::freeSpaceCarved, [&](qulonglong r, qulonglong f, double ms) {
+    rays = r;
+    freed = f;
+    milliseconds = ms;
+  });
+
+  scene.setCarveEngine(Scene::CarveIntervals);
+  scene.setFreeSpaceCarving(true);
+  const int sizes[] = { 64, 128, 256 };
+  const int steps[] = { 1, 4, 16 };
+  for (int nbVox : sizes) {
+    for (int step : steps) {
+      scene.setVoxelSize(nbVox);
+      scene.setRayStep(step);
+      rays = 0;
+      scene.carve();
+      if (rays == 0) {
+        std::printf("%8d %9d: points are not resident\n", nbVox, step);
+        scene.setFreeSpaceCarving(false);
+        return;
+      }
+      std::printf("%8d %9d %12llu %12llu %10.1f %12.2f\n",
+                  nbVox, step, rays, freed, milliseconds, rays / milliseconds * 1e-3);
+    }
+  }
+  scene.setFreeSpaceCarving(false);
+}
+
+// masks against the carved voxels, rendered into every view at 128^3
+static void benchValidation(Scene& scene)
+{
+  double milliseconds = 0.;
+  QObject::connect(&scene, &Scene::hullValidated, [&](double ms) { milliseconds = ms; });
+
+  scene.setCarveEngine(Scene::CarveIntervals);
+  scene.setVoxelSize(128);
+  scene.carve();
+  scene.validateHull();
+
+  std::vector<CameraConsistency> scores = scene.cameraConsistency();
+  if (scores.empty())
+    return;
+  std::sort(scores.begin(), scores.end(), [](const CameraConsistency& a, const CameraConsistency& b) {
+    return a.iou < b.iou;
+  });
+  std::printf("validation, %zu views at %d: %.1f ms, %.2f ms per view; worst IoU",
+              scores.size(), scene.nbVox(), milliseconds, milliseconds / scores.size());
+  for (size_t i = 0; i < scores.size() && i < 5; i++) {
+    std::printf(" %u: %.3f", scores[i].camera, scores[i].iou);
+  }
+  std::printf("\n");
+}
+
+// compressed point storage by chunk size: ratio, coding and decoding rates,
+// and reads of a few points at random places through the cache of hot chunks
+static void benchCompression(Scene& scene)
+{
+  const size_t count = scene.pointsCount();
+  if (count == 0 || !MemoryBudget::instance().fits(count * POINT_STRIDE * sizeof(float))) {
+    std::printf("compression: points are not resident, or do not fit decoded\n");
+    return;
+  }
+  std::vector<float> points(count * POINT_STRIDE);
+  scene.forEachPoints([&](const float* batch, size_t first, size_t n) {
+    std::copy(batch, batch + n * POINT_STRIDE, points.begin() + first * POINT_STRIDE);
+  });
+
+  const size_t READS = 1000, READ_POINTS = 1000;
+  std::printf("compression, %zu points\n", count);
+  std::printf("%8s %10s %7s %12s %12s %14s\n", "chunk", "bytes/pt", "ratio", "coding M/s", "decoding M/s", "read (us)");
+  const size_t sizes[] = { 1024, 4096, 16384, 65536 };
+  for (size_t chunkPoints : sizes) {
+    PointStore store(chunkPoints);
+    QElapsedTimer timer;
+    timer.start();
+    store.append(points.data(), count);
+    const double codingSeconds = timer.nsecsElapsed() * 1e-9;
+
+    timer.restart();
+    size_t decoded = 0;
+    store.forEach(size_t(1) << 20, [&](const float*, size_t, size_t n) { decoded += n; });
+    const double decodingSeconds = timer.nsecsElapsed() * 1e-9;
+
+    std::vector<float> slice(READ_POINTS * POINT_STRIDE);
+    const size_t readPoints = std::min(READ_POINTS, count);
+    timer.restart();
+    for (size_t r = 0; r < READS; r++) {
+      store.read((r * 2654435761u) % (count - readPoints + 1), readPoints, slice.data());
+    }
+    const double readMicroseconds = timer.nsecsElapsed() * 1e-3 / READS;
+
+    std::printf("%8zu %10.2f %6.2fx %12.1f %12.1f %14.1f\n", chunkPoints,
+                double(store.compressedSize()) / count, double(count * POINT_STRIDE * sizeof(float)) / store.compressedSize(),
+                count / codingSeconds * 1e-6, decoded / decodingSeconds * 1e-6, readMicroseconds);
+  }
+}
+
+// binary PLY export of every point, to a temporary file next to the working directory
+static void benchExport(Scene& scene)
+{
+  QTemporaryFile file("bench_export_XXXXXX.ply");
+  if (!file.open()) {
+    std::printf("export: cannot create a temporary file\n");
+    return;
+  }
+  file.close();
+
+  QElapsedTimer timer;
+  timer.start();
+  scene.exportPoints(file.fileName(), false);
+  const double seconds = timer.nsecsElapsed() * 1e-9;
+  const double megabytes = QFile(file.fileName()).size() / 1e6;
+  std::printf("export, %zu points: %.2f s, %.1f MB/s, %.1f M points/s\n",
+              scene.pointsCount(), seconds, megabytes / seconds, scene.pointsCount() / seconds * 1e-6);
+}
+
+// nearest distances to the config's reference, building its tree included
+static void benchDistance(Scene& scene)
+{
+  if (!scene.hasDistances())
+    return;
+  QElapsedTimer timer;
+  timer.start();
+  scene.compareToReference();
+  const double seconds = timer.nsecsElapsed() * 1e-9;
+  const DistanceHistogram& histogram = scene.distanceHistogram();
+  std::printf("distance, %zu points to the reference: %.2f s, %.1f M points/s; mean %g, median %g, 95%% under %g, max %g\n",
+              histogram.count, seconds, histogram.count / seconds * 1e-6,
+              histogram.mean, histogram.median, histogram.percentile95, histogram.max);
+}
+
+int runBenchmark(const QString& configPath)
+{
+  try {
+    Scene scene(SceneConfig::load(configPath));
+    benchCarving(scene);
+    benchFreeSpace(scene);
+    benchValidation(scene);
+    benchDistance(scene);
+    benchCompression(scene);
+    benchExport(scene);
+
+    const MemoryBudget& budget = MemoryBudget::instance();
+    std::printf("memory peak: %.1f MB host", budget.hostPeak() / double(1 << 20));
+    for (int c = 0; c < MemoryBudget::CategoriesCount; c++) {
+      const MemoryBudget::Category category = MemoryBudget::Category(c);
+      std::printf(", %s %.1f MB", MemoryBudget::name(category), budget.peak(category) / double(1 << 20));
+    }
+    std::printf("\n");
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "benchmark failed: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
+
+const int SHADING_WIDTH = 1280;
+const int SHADING_HEIGHT = 720;
+const int SHADING_FRAMES = 200;
+
+// milliseconds per frame, drawn back to back until the GPU is done
+static double timeFrames(Scene& scene, int frames)
+{
+  QElapsedTimer timer;
+  timer.start();
+  for (int i = 0; i < frames; i++) {
+    scene.repaint();
+  }
+  scene.makeCurrent();
+  scene.context()->functions()->glFinish();
+  scene.doneCurrent();
+  return timer.nsecsElapsed() * 1e-6 / frames;
+}
+
+int runShadingBenchmark(const QString& configPath)
+{
+  try {
+    // frames are not held back by the display's refresh
+    QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+    format.setSwapInterval(0);
+    QSurfaceFormat::setDefaultFormat(format);
+
+    Scene scene(SceneConfig::load(configPath));
+    if (!scene.workspace()) {
+      std::fprintf(stderr, "benchmark failed: a live stream has no normals\n");
+      return 1;
+    }
+    scene.resize(SHADING_WIDTH, SHADING_HEIGHT);
+    scene.show();
+    // the first frames upload the points, a slice each
+    while (scene.workspace()->isBusy()) {
+      scene.repaint();
+      QApplication::processEvents();
+    }
+
+    scene.setPointLighting(false);
+    timeFrames(scene, 10);
+    const double unlit = timeFrames(scene, SHADING_FRAMES);
+    std::printf("shading, %zu points at %dx%d: unlit %.2f ms per frame\n",
+                scene.workspace()->arena().used(), SHADING_WIDTH, SHADING_HEIGHT, unlit);
+    if (!scene.workspace()->hasNormals()) {
+      std::printf("shading: normals are off, nothing to light\n");
+      return 0;
+    }
+    scene.setPointLighting(true);
+    timeFrames(scene, 10);
+    const double lit = timeFrames(scene, SHADING_FRAMES);
+    std::printf("shading: lit %.2f ms per frame, %+.0f%%\n", lit, (lit / unlit - 1.) * 100.);
+
+    // a packed normal next to 7 floats of position, row index and colour
+    const size_t points = scene.workspace()->arena().capacity();
+    std::printf("normals: %zu bytes a point against %zu, %.1f MB host and %.1f MB GPU for %zu points\n",
+                sizeof(uint32_t), POINT_STRIDE * sizeof(float),
+                scene.pointsCount() * sizeof(uint32_t) / double(1 << 20),
+                points * sizeof(uint32_t) / double(1 << 20), points);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "benchmark failed: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
+
+const int VOXEL_FRAMES = 50;
+
+// pixels showing voxels in a frame drawn with 'rendering'; edges are black
+// like the background, so a pixel next to a drawn one counts as covered
+static std::vector<char> voxelCoverage(Scene& scene, int rendering)
+{
+  scene.setVoxelRendering(rendering);
+  const QImage image = scene.grabFramebuffer().convertToFormat(QImage::Format_RGB32);
+  const int w = image.width(), h = image.height();
+  std::vector<char> drawn(size_t(w) * h), covered(size_t(w) * h);
+  for (int y = 0; y < h; y++) {
+    const QRgb *row = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+    for (int x = 0; x < w; x++) {
+      drawn[size_t(y) * w + x] = (row[x] & 0xffffff) != 0;
+    }
+  }
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      char c = 0;
+      for (int dy = std::max(y - 1, 0); dy <= std::min(y + 1, h - 1) && !c; dy++) {
+        for (int dx = std::max(x - 1, 0); dx <= std::min(x + 1, w - 1) && !c; dx++) {
+          c = drawn[size_t(dy) * w + dx];
+        }
+      }
+      covered[size_t(y) * w + x] = c;
+    }
+  }
+  return covered;
+}
+
+// percentage of the pixels covered in one of 'a' and 'b' only
+static double coverageDifference(const std::vector<char>& a, const std::vector<char>& b)
+{
+  size_t differ = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    differ += a[i] != b[i];
+  }
+  return 100. * differ / std::max<size_t>(a.size(), 1);
+}
+
+int runVoxelBenchmark(const QString& configPath)
+{
+  try {
+    QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+    format.setSwapInterval(0);
+    QSurfaceFormat::setDefaultFormat(format);
+
+    Scene scene(SceneConfig::load(configPath));
+    scene._drawPoints = false;
+    scene._drawVoxels = true;
+    scene.resize(SHADING_WIDTH, SHADING_HEIGHT);
+    scene.show();
+    scene.repaint();
+    if (!scene.hasRaymarching()) {
+      std::fprintf(stderr, "benchmark failed: raymarching needs GLSL 1.30\n");
+      return 1;
+    }
+
+    std::printf("voxels at %dx%d, ms per frame\n", SHADING_WIDTH, SHADING_HEIGHT);
+    std::printf("%8s %10s %10s %12s %12s %14s\n", "nbVox", "occupied", "cubes", "raymarched", "skipping", "skipping /4 px");
+    const int sizes[] = { 64, 128, 256, 512, 1024 };
+    for (int requested : sizes) {
+      scene.setVoxelSize(requested);
+      scene.carve();
+      const int nbVox = scene.nbVox(); // the memory budget may allow less
+      const size_t cells = size_t(nbVox) * nbVox * nbVox;
+      const size_t occupied = std::count_if(scene.voxels(), scene.voxels() + cells, [](unsigned char v) { return v != 0; });
+
+      double cubes = -1.;
+      if (nbVox <= Scene::CUBES_MAX_VOXELS) {
+        scene.setVoxelRendering(Scene::VoxelsCubes);
+        timeFrames(scene, 1);
+        cubes = timeFrames(scene, 3);
+
+        // the shader reads the grid as the texture holds it, both ways of
+        // marching must draw what the cubes do
+        const std::vector<char> reference = voxelCoverage(scene, Scene::VoxelsCubes);
+        std::printf("%8d pixels covered by the cubes or the rays only: raymarched %.2f%%, skipping %.2f%%\n", nbVox,
+                    coverageDifference(reference, voxelCoverage(scene, Scene::VoxelsRaymarched)),
+                    coverageDifference(reference, voxelCoverage(scene, Scene::VoxelsRaymarchedSkipping)));
+      }
+      // the first frame uploads the grid and its pyramid
+      scene.setVoxelRendering(Scene::VoxelsRaymarched);
+      timeFrames(scene, 3);
+      const double raymarched = timeFrames(scene, VOXEL_FRAMES);
+      scene.setVoxelRendering(Scene::VoxelsRaymarchedSkipping);
+      timeFrames(scene, 3);
+      const double skipping = timeFrames(scene, VOXEL_FRAMES);
+      // a quarter of the pixels
+      scene.resize(SHADING_WIDTH / 2, SHADING_HEIGHT / 2);
+      QApplication::processEvents();
+      timeFrames(scene, 3);
+      const double quarter = timeFrames(scene, VOXEL_FRAMES);
+      scene.resize(SHADING_WIDTH, SHADING_HEIGHT);
+      QApplication::processEvents();
+
+      if (cubes < 0.) {
+        std::printf("%8d %10zu %10s %12.2f %12.2f %14.2f\n", nbVox, occupied, "-", raymarched, skipping, quarter);
+      } else {
+        std::printf("%8d %10zu %10.2f %12.2f %12.2f %14.2f\n", nbVox, occupied, cubes, raymarched, skipping, quarter);
+      }
+      if (nbVox != requested)
+        break;
+    }
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "benchmark failed: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
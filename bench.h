@@ -0,0 +1,15 @@
+#pragma once
+
+#include <QString>
+
+// Headless benchmarks, run with 'pcviewer --bench config.txt'.
+// The scene is loaded but never shown, results are printed to stdout.
+int runBenchmark(const QString& configPath);
+
+// Frame time of the points unlit then lit, run with
+// 'pcviewer --bench-shading config.txt'; needs a display for the view.
+int runShadingBenchmark(const QString& configPath);
+
+// Frame time of the voxels as cubes and raymarched, by grid size, run with
+// 'pcviewer --bench-voxels config.txt'; needs a display for the view.
+int runVoxelBenchmark(const QString& configPath);
@@ -0,0 +1,84 @@
+#include "bufferarena.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+BufferArena::BufferArena(size_t capacity)
+{
+  reset(capacity);
+}
+
+void BufferArena::reset(size_t capacity)
+{
+  _capacity = capacity;
+  _used = 0;
+  _free.clear();
+  if (capacity > 0)
+    _free[0] = capacity;
+}
+
+bool BufferArena::allocate(size_t size, size_t& offset)
+{
+  if (size == 0) {
+    offset = 0;
+    return true;
+  }
+
+  std::map<size_t, size_t>::iterator best = _free.end();
+  for (std::map<size_t, size_t>::iterator range = _free.begin(); range != _free.end(); ++range) {
+    if (range->second >= size && (best == _free.end() || range->second < best->second))
+      best = range;
+  }
+  if (best == _free.end())
+    return false;
+
+  // take the front of the range, the rest stays free
+  offset = best->first;
+  const size_t rest = best->second - size;
+  _free.erase(best);
+  if (rest > 0)
+    _free[offset + size] = rest;
+  _used += size;
+  return true;
+}
+
+void BufferArena::free(size_t offset, size_t size)
+{
+  if (size == 0)
+    return;
+  if (offset + size > _capacity || size > _used)
+    throw std::runtime_error("freeing a range the arena does not hold");
+
+  std::map<size_t, size_t>::iterator next = _free.lower_bound(offset);
+  if (next != _free.end() && next->first < offset + size)
+    throw std::runtime_error("freeing a range twice");
+
+  // merge with the free range ending where this one starts, and with the one
+  // starting where it ends
+  size_t first = offset, last = offset + size;
+  if (next != _free.begin()) {
+    std::map<size_t, size_t>::iterator previous = std::prev(next);
+    if (previous->first + previous->second > offset)
+      throw std::runtime_error("freeing a range twice");
+    if (previous->first + previous->second == offset) {
+      first = previous->first;
+      _free.erase(previous);
+    }
+  }
+  if (next != _free.end() && next->first == last) {
+    last += next->second;
+    _free.erase(next);
+  }
+  _free[first] = last - first;
+  _used -= size;
+}
+
+size_t BufferArena::largestFree() const
+{
+  size_t largest = 0;
+  for (std::map<size_t, size_t>::const_iterator range = _free.begin(); range != _free.end(); ++range) {
+    largest = std::max(largest, range->second);
+  }
+  return largest;
+}
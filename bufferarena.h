@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+
+// Sub-allocates ranges of one fixed-size buffer, e.g. the points of several
+// scans sharing one vertex buffer. Units are whatever the caller counts in.
+//
+// Free ranges are kept by offset; allocation takes the smallest range that
+// fits (best fit, so large holes survive for large scans), freeing merges a
+// range with its free neighbours. Nothing ever moves: a range keeps its
+// offset until freed.
+class BufferArena
+{
+public:
+  explicit BufferArena(size_t capacity = 0);
+
+  // forget every range, all of the capacity is free again
+  void reset(size_t capacity);
+
+  // false when no free range holds 'size' units, whatever the total free
+  bool allocate(size_t size, size_t& offset);
+  void free(size_t offset, size_t size);
+
+  size_t capacity() const { return _capacity; }
+  size_t used() const { return _used; }
+  size_t largestFree() const;
+  size_t freeRangesCount() const { return _free.size(); }
+
+private:
+  size_t                   _capacity;
+  size_t                   _used;
+  std::map<size_t, size_t> _free; // offset -> size, disjoint and never adjacent
+};
@@ -0,0 +1,144 @@
+#include "camerastore.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// n.X + d >= 0, solved in double since frusta are nearly parallel to some
+// box faces
+struct Constraint
+{
+  double n[3];
+  double d;
+
+  bool holds(const double* X) const
+  {
+    const double value = n[0] * X[0] + n[1] * X[1] + n[2] * X[2] + d;
+    const double scale = std::fabs(n[0] * X[0]) + std::fabs(n[1] * X[1]) + std::fabs(n[2] * X[2]) + std::fabs(d);
+    return value >= -1e-9 * scale;
+  }
+};
+
+void cross(const double* a, const double* b, double* c)
+{
+  c[0] = a[1] * b[2] - a[2] * b[1];
+  c[1] = a[2] * b[0] - a[0] * b[2];
+  c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// largest value of a*X + b*Y + c*Z + d over the box, and the magnitude of its terms
+float boxMaximum(const float* k, const float* boxMin, const float* boxMax, float* scale)
+{
+  float value = k[3];
+  *scale = std::fabs(k[3]);
+  for (int axis = 0; axis < 3; axis++) {
+    const float term = k[axis] * (k[axis] > 0.f ? boxMax[axis] : boxMin[axis]);
+    value += term;
+    *scale += std::fabs(term);
+  }
+  return value;
+}
+
+} // namespace
+
+void CameraStore::clear()
+{
+  _count = 0;
+  for (int e = 0; e < 16; e++)
+    _matrix[e].clear();
+  for (int k = 0; k < FRUSTUM_PLANES * 4; k++)
+    _planes[k].clear();
+}
+
+void CameraStore::add(const float* projectionView)
+{
+  for (int e = 0; e < 16; e++)
+    _matrix[e].push_back(projectionView[e]);
+
+  // row r of M is (m[r], m[4 + r], m[8 + r], m[12 + r]); planes are
+  // row 2 - row 0, row 2 + row 0, row 2 - row 1 and row 2 + row 1
+  const int rows[FRUSTUM_PLANES] = { 0, 0, 1, 1 };
+  const float signs[FRUSTUM_PLANES] = { -1.f, 1.f, -1.f, 1.f };
+  for (int p = 0; p < FRUSTUM_PLANES; p++) {
+    for (int k = 0; k < 4; k++) {
+      _planes[p * 4 + k].push_back(projectionView[4 * k + 2] + signs[p] * projectionView[4 * k + rows[p]]);
+    }
+  }
+  _count++;
+}
+
+bool CameraStore::mayOverlap(size_t camera, const float* boxMin, const float* boxMax) const
+{
+  for (int p = 0; p < FRUSTUM_PLANES; p++) {
+    const float k[4] = { plane(p, 0)[camera], plane(p, 1)[camera], plane(p, 2)[camera], plane(p, 3)[camera] };
+    float scale;
+    // rounding may let the projection see a point right on the plane
+    if (boxMaximum(k, boxMin, boxMax, &scale) < -1e-5f * scale)
+      return false;
+  }
+  return true;
+}
+
+bool CameraStore::frustumBounds(size_t camera, const float* boxMin, const float* boxMax, float* min, float* max) const
+{
+  // the intersection is a convex polytope whose vertices are where three of
+  // its ten bounding planes meet
+  Constraint constraints[6 + FRUSTUM_PLANES];
+  for (int axis = 0; axis < 3; axis++) {
+    Constraint& low = constraints[2 * axis];
+    Constraint& high = constraints[2 * axis + 1];
+    low.n[0] = low.n[1] = low.n[2] = 0.;
+    high.n[0] = high.n[1] = high.n[2] = 0.;
+    low.n[axis] = 1.;
+    low.d = -boxMin[axis];
+    high.n[axis] = -1.;
+    high.d = boxMax[axis];
+  }
+  for (int p = 0; p < FRUSTUM_PLANES; p++) {
+    Constraint& c = constraints[6 + p];
+    c.n[0] = plane(p, 0)[camera];
+    c.n[1] = plane(p, 1)[camera];
+    c.n[2] = plane(p, 2)[camera];
+    c.d = plane(p, 3)[camera];
+  }
+
+  const int count = 6 + FRUSTUM_PLANES;
+  bool found = false;
+  for (int a = 0; a < count; a++) {
+    for (int b = a + 1; b < count; b++) {
+      for (int c = b + 1; c < count; c++) {
+        const Constraint &ca = constraints[a], &cb = constraints[b], &cc = constraints[c];
+        double bc[3], ac[3], ab[3];
+        cross(cb.n, cc.n, bc);
+        cross(cc.n, ca.n, ac);
+        cross(ca.n, cb.n, ab);
+        const double det = ca.n[0] * bc[0] + ca.n[1] * bc[1] + ca.n[2] * bc[2];
+        const double norms = std::sqrt((ca.n[0] * ca.n[0] + ca.n[1] * ca.n[1] + ca.n[2] * ca.n[2]) *
+                                       (cb.n[0] * cb.n[0] + cb.n[1] * cb.n[1] + cb.n[2] * cb.n[2]) *
+                                       (cc.n[0] * cc.n[0] + cc.n[1] * cc.n[1] + cc.n[2] * cc.n[2]));
+        if (std::fabs(det) <= 1e-12 * norms)
+          continue;
+
+        double X[3];
+        for (int axis = 0; axis < 3; axis++) {
+          X[axis] = -(ca.d * bc[axis] + cb.d * ac[axis] + cc.d * ab[axis]) / det;
+        }
+        bool inside = true;
+        for (int k = 0; k < count && inside; k++) {
+          inside = constraints[k].holds(X);
+        }
+        if (!inside)
+          continue;
+
+        for (int axis = 0; axis < 3; axis++) {
+          const float x = std::min(std::max(float(X[axis]), boxMin[axis]), boxMax[axis]);
+          min[axis] = found ? std::min(min[axis], x) : x;
+          max[axis] = found ? std::max(max[axis], x) : x;
+        }
+        found = true;
+      }
+    }
+  }
+  return found;
+}
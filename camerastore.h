@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Bundle cameras as a structure of arrays, for loops that visit many
+// cameras per voxel or per tile.
+//
+// Each camera keeps its combined projection * view matrix M, column-major
+// as QMatrix4x4::constData(): element e of camera c is matrix(e)[c]. A point
+// X is seen by a camera when M*X = (x, y, z, w) has z > 0, |x| < z and
+// |y| < z, that is when it is on the positive side of the frustum planes
+// z - x, z + x, z - y and z + y. Those are kept as well, coefficient k of
+// plane p of camera c being plane(p, k)[c], with a*X + b*Y + c*Z + d > 0
+// inside.
+class CameraStore
+{
+public:
+  static const int FRUSTUM_PLANES = 4;
+
+  void clear();
+  void add(const float* projectionView);
+
+  size_t size() const { return _count; }
+  const float* matrix(int element) const { return _matrix[element].data(); }
+  const float* plane(int plane, int coefficient) const { return _planes[plane * 4 + coefficient].data(); }
+
+  // false when no point of the box [boxMin, boxMax] is seen by the camera;
+  // true may still mean none is
+  bool mayOverlap(size_t camera, const float* boxMin, const float* boxMax) const;
+
+  // bounding box [min, max] of the part of the camera's frustum inside the
+  // box [boxMin, boxMax], false when they do not meet
+  bool frustumBounds(size_t camera, const float* boxMin, const float* boxMax, float* min, float* max) const;
+
+private:
+  size_t             _count = 0;
+  std::vector<float> _matrix[16];
+  std::vector<float> _planes[FRUSTUM_PLANES * 4];
+};
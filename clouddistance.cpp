@@ -0,0 +1,102 @@
+#include "clouddistance.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "taskpool.h"
+
+const size_t DISTANCE_GRAIN = 4096;           // points per task
+const size_t PERCENTILE_SAMPLES = 1 << 20;    // distances sorted for the percentiles
+
+CloudDistance::CloudDistance()
+{
+}
+
+void CloudDistance::setReference(const float* points, size_t count, size_t stride)
+{
+  _tree.build(points, count, stride);
+}
+
+void CloudDistance::compute(const float* points, size_t count, size_t stride, float* distances) const
+{
+  TaskPool::instance().parallelFor(0, count, [&](size_t begin, size_t end) {
+    const KdTree::Entry *nearest = nullptr;
+    for (size_t i = begin; i < end; i++) {
+      const float *p = points + i * stride;
+      // the previous point's nearest bounds this one's
+      float bound = std::numeric_limits<float>::infinity();
+      if (nearest) {
+        const float dx = nearest->position[0] - p[0];
+        const float dy = nearest->position[1] - p[1];
+        const float dz = nearest->position[2] - p[2];
+        bound = dx * dx + dy * dy + dz * dz;
+      }
+      distances[i] = std::sqrt(_tree.nearest(p, bound, nearest));
+    }
+  }, DISTANCE_GRAIN);
+}
+
+DistanceHistogram CloudDistance::histogram(const float* distances, size_t count)
+{
+  DistanceHistogram histogram;
+  histogram.count = count;
+  if (count == 0)
+    return histogram;
+
+  TaskPool& pool = TaskPool::instance();
+  const size_t rangesCount = pool.threadsCount();
+
+  // sums and maximum
+  std::vector<double> sums(rangesCount * 3, 0.);
+  pool.parallelFor(0, rangesCount, [&](size_t r, size_t) {
+    double *sum = &sums[r * 3];
+    for (size_t i = count * r / rangesCount; i < count * (r + 1) / rangesCount; i++) {
+      sum[0] += distances[i];
+      sum[1] += double(distances[i]) * distances[i];
+      sum[2] = std::max(sum[2], double(distances[i]));
+    }
+  }, 1);
+  double sum = 0., sumSquares = 0., max = 0.;
+  for (size_t r = 0; r < rangesCount; r++) {
+    sum += sums[r * 3];
+    sumSquares += sums[r * 3 + 1];
+    max = std::max(max, sums[r * 3 + 2]);
+  }
+  histogram.mean = float(sum / count);
+  histogram.rms = float(std::sqrt(sumSquares / count));
+  histogram.max = float(max);
+
+  // percentiles of an even sample
+  const size_t step = std::max<size_t>(1, count / PERCENTILE_SAMPLES);
+  std::vector<float> sample;
+  sample.reserve(count / step + 1);
+  for (size_t i = 0; i < count; i += step) {
+    sample.push_back(distances[i]);
+  }
+  std::sort(sample.begin(), sample.end());
+  histogram.median = sample[sample.size() / 2];
+  histogram.percentile95 = sample[sample.size() * 95 / 100];
+  histogram.percentile99 = sample[sample.size() * 99 / 100];
+
+  // bins up to the 99th percentile, the tail apart
+  histogram.binWidth = histogram.percentile99 / DistanceHistogram::BINS;
+  std::vector<size_t> bins(rangesCount * (DistanceHistogram::BINS + 1), 0);
+  pool.parallelFor(0, rangesCount, [&](size_t r, size_t) {
+    size_t *bin = &bins[r * (DistanceHistogram::BINS + 1)];
+    for (size_t i = count * r / rangesCount; i < count * (r + 1) / rangesCount; i++) {
+      const int b = distances[i] < histogram.percentile99 && histogram.binWidth > 0.f
+                  ? std::min(int(distances[i] / histogram.binWidth), DistanceHistogram::BINS - 1)
+                  : DistanceHistogram::BINS;
+      ++bin[b];
+    }
+  }, 1);
+  for (size_t r = 0; r < rangesCount; r++) {
+    for (int b = 0; b < DistanceHistogram::BINS; b++) {
+      histogram.bins[b] += bins[r * (DistanceHistogram::BINS + 1) + b];
+    }
+    histogram.beyond += bins[r * (DistanceHistogram::BINS + 1) + DistanceHistogram::BINS];
+  }
+  return histogram;
+}
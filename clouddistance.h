@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+
+#include "kdtree.h"
+
+// Summary of the distances of a cloud to its reference.
+struct DistanceHistogram
+{
+  static const int BINS = 32;
+
+  size_t count = 0;
+  float  mean = 0.f;
+  float  rms = 0.f;
+  float  max = 0.f;
+  float  median = 0.f;     // percentiles, from an even sample of the distances
+  float  percentile95 = 0.f;
+  float  percentile99 = 0.f;
+  float  binWidth = 0.f;   // bins cover [0, percentile99) evenly
+  size_t bins[BINS] = {};
+  size_t beyond = 0;       // points at percentile99 or farther
+};
+
+// Distance from each point of a cloud to the nearest point of a reference
+// cloud, to find what changed between two scans of the same scene.
+//
+// The reference is indexed once in a KdTree. Points are queried on the task
+// pool in chunks of consecutive points; consecutive points of a scan lie
+// close together, so each query starts bounded by its distance to the
+// previous point's nearest, which prunes most of the tree at once.
+class CloudDistance
+{
+public:
+  CloudDistance();
+
+  // index the reference, 'count' points, x, y, z first and 'stride' floats
+  // apart; it is copied
+  void setReference(const float* points, size_t count, size_t stride);
+
+  size_t referenceCount() const { return _tree.size(); }
+  size_t memorySize() const { return _tree.memorySize(); }
+
+  // distance of each of 'count' points to the reference, which must not be
+  // empty
+  void compute(const float* points, size_t count, size_t stride, float* distances) const;
+
+  static DistanceHistogram histogram(const float* distances, size_t count);
+
+private:
+  KdTree _tree;
+};
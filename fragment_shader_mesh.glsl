@@ -0,0 +1,7 @@
+#version 120
+
+varying float shade;
+
+void main() {
+  gl_FragColor = vec4(vec3(.85, .8, .7) * shade, 1.);
+}
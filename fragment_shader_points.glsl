@@ -1,9 +1,23 @@
-#version 120
-
-varying vec3 vert;
-varying vec3 vcolor;
-varying float pointIdx;
-
-void main() {
-  gl_FragColor = vec4(vcolor, 1.);
-}
+#version 120
+
+uniform bool roundPoints; // discs instead of squares
+uniform bool accumulate;  // sum weighted colours for the resolve pass
+
+varying vec3 vert;
+varying vec3 vcolor;
+varying float pointIdx;
+
+void main() {
+  vec2 r = gl_PointCoord * 2. - 1.;
+  float r2 = dot(r, r);
+  if (roundPoints && r2 > 1.)
+    discard;
+
+  if (accumulate) {
+    // splats weigh less towards their rim, alpha keeps the sum of weights
+    float weight = roundPoints ? max(1. - r2, 1e-3) : 1.;
+    gl_FragColor = vec4(vcolor * weight, weight);
+  } else {
+    gl_FragColor = vec4(vcolor, 1.);
+  }
+}
@@ -0,0 +1,112 @@
+#version 130
+
+uniform mat4 mvpMatrix;
+uniform mat4 inverseMvp;     // clip space back to the world
+uniform vec2 pixelNdc;       // size of a pixel in normalized device coordinates
+uniform vec3 gridOrigin;
+uniform float voxelSize;
+uniform int nbVox;
+
+uniform sampler3D occupancy; // a byte per voxel, nonzero when occupied, z along the width as in the grid's storage
+uniform sampler3D pyramid;   // any, all voxels occupied per cell; a mip level per OccupancyPyramid level
+uniform int pyramidLevels;   // 0 steps through every voxel
+uniform sampler3D colors;    // mean colour of each voxel's points
+uniform bool hasColors;
+
+in vec2 ndc;
+
+const int   MAX_STEPS = 4096;
+const int   BASE_BITS = 2;      // OccupancyPyramid::BASE_VOXELS is 4
+const float NUDGE = 1e-3;       // voxels past a face, to look up the cell behind it
+const float LINE_PIXELS = 1.;   // grid lines width
+const float LINE_FOOTPRINT = .25; // lines are drawn on voxels of 4 pixels or more
+
+// the ray through 'point' from the near to the far plane, in voxels
+void ray(vec2 point, out vec3 from, out vec3 to) {
+  vec4 near = inverseMvp * vec4(point, -1., 1.);
+  vec4 far = inverseMvp * vec4(point, 1., 1.);
+  from = (near.xyz / near.w - gridOrigin) / voxelSize;
+  to = (far.xyz / far.w - gridOrigin) / voxelSize;
+}
+
+// where the ray through 'point' crosses the plane of a face
+vec3 onFace(vec2 point, int axis, float plane) {
+  vec3 from, to;
+  ray(point, from, to);
+  return from + (to - from) * ((plane - from[axis]) / (to[axis] - from[axis]));
+}
+
+void main() {
+  vec3 from, to;
+  ray(ndc, from, to);
+  float span = length(to - from);
+  vec3 dir = (to - from) / span;
+  vec3 s = vec3(greaterThanEqual(dir, vec3(0.))) * 2. - 1.;
+  vec3 inv = s / max(abs(dir), vec3(1e-8));
+
+  // the part of the ray inside the grid
+  vec3 t0 = -from * inv, t1 = (vec3(nbVox) - from) * inv;
+  vec3 tNear = min(t0, t1), tFar = max(t0, t1);
+  float enter = max(max(tNear.x, tNear.y), max(tNear.z, 0.));
+  float leave = min(min(tFar.x, tFar.y), min(tFar.z, span));
+  if (enter >= leave)
+    discard;
+  int axis = tNear.x >= tNear.y && tNear.x >= tNear.z ? 0 : (tNear.y >= tNear.z ? 1 : 2); // of the face entered
+
+  // down the pyramid into occupied cells, across empty ones and up again;
+  // a cell whose voxels are all occupied is hit where it is entered
+  vec3 origin = from + dir * enter;
+  float t = 0., end = leave - enter;
+  int level = pyramidLevels;
+  bool hit = false;
+  for (int i = 0; i < MAX_STEPS && t < end; i++) {
+    float width = level == 0 ? 1. : exp2(float(level - 1 + BASE_BITS));
+    vec3 cell = floor((origin + dir * t + s * NUDGE) / width);
+    if (any(lessThan(cell, vec3(0.))) || any(greaterThanEqual(cell * width, vec3(nbVox))))
+      break;
+    ivec3 texel = ivec3(cell.zyx);
+    if (level == 0) {
+      // the grid holds 0 or 1, read as 1/255
+      if (texelFetch(occupancy, texel, 0).r > 0.) {
+        hit = true;
+        break;
+      }
+    } else {
+      vec2 occupied = texelFetch(pyramid, texel, level - 1).rg;
+      if (occupied.g > .5) {
+        hit = true;
+        break;
+      }
+      if (occupied.r > .5) {
+        level--;
+        continue;
+      }
+    }
+    vec3 exits = ((cell + max(s, 0.)) * width - origin) * inv;
+    float next = min(min(exits.x, exits.y), exits.z);
+    axis = next == exits.x ? 0 : (next == exits.y ? 1 : 2);
+    t = max(next, t + NUDGE);
+    level = min(level + 1, pyramidLevels);
+  }
+  if (!hit)
+    discard;
+
+  vec3 p = origin + dir * t;
+  vec3 voxel = clamp(floor(p + s * NUDGE), vec3(0.), vec3(nbVox - 1));
+  vec3 color = hasColors ? texelFetch(colors, ivec3(voxel.zyx), 0).rgb : vec3(1.);
+  // a headlight, as for the points
+  color *= .3 + .7 * abs(dir[axis]);
+
+  // the edges of the face, from the voxels a pixel spans on it
+  vec3 footprint = max(abs(onFace(ndc + vec2(pixelNdc.x, 0.), axis, p[axis]) - p),
+                       abs(onFace(ndc + vec2(0., pixelNdc.y), axis, p[axis]) - p));
+  vec3 edge = min(fract(p), 1. - fract(p)) / max(footprint, vec3(1e-6));
+  edge[axis] = LINE_PIXELS;
+  footprint[axis] = 0.;
+  if (min(edge.x, min(edge.y, edge.z)) < LINE_PIXELS && max(footprint.x, max(footprint.y, footprint.z)) < LINE_FOOTPRINT)
+    color = vec3(0.);
+
+  vec4 clip = mvpMatrix * vec4(gridOrigin + p * voxelSize, 1.);
+  gl_FragDepth = clip.z / clip.w * .5 + .5;
+  gl_FragColor = vec4(color, 1.);
+}
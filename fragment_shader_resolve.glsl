@@ -0,0 +1,13 @@
+#version 120
+
+uniform sampler2D accumulation;
+
+varying vec2 texCoord;
+
+void main() {
+  // weighted colour sums of the splats at the nearest depth, by weight
+  vec4 sum = texture2D(accumulation, texCoord);
+  if (sum.a <= 0.)
+    discard;
+  gl_FragColor = vec4(sum.rgb / sum.a, 1.);
+}
@@ -1,11 +1,12 @@
 uniform int flag;
+uniform vec3 voxColor;
 
 varying vec3 norm;
 
 void main(void)
 {
     if (flag == 1)
-        gl_FragColor = vec4(1. ,1. ,1. , 1.);
+        gl_FragColor = vec4(voxColor, 1.);
     else if (flag == 2)
         gl_FragColor = vec4(0. ,0. ,1. , 1.);
     else
@@ -0,0 +1,267 @@
+#include "freespace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+
+#include "taskpool.h"
+
+const size_t RAY_GRAIN = 4096;      // points per task
+const float  SURFACE_MARGIN = 1.5f; // voxels before the point where a ray stops
+
+namespace {
+
+// bitmasks lent to one chunk of rays at a time; with fewer masks than
+// threads, a chunk waits for one to be given back
+class MaskPool
+{
+public:
+  MaskPool(size_t count, size_t words) : _masks(count), _words(words)
+  {
+    for (size_t m = 0; m < count; m++) {
+      _free.push_back(m);
+    }
+  }
+
+  // allocated the first time it is lent
+  std::vector<uint64_t>& acquire()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _available.wait(lock, [this]() { return !_free.empty(); });
+    std::vector<uint64_t>& mask = _masks[_free.back()];
+    _free.pop_back();
+    lock.unlock();
+    if (mask.empty())
+      mask.assign(_words, 0);
+    return mask;
+  }
+
+  void release(const std::vector<uint64_t>& mask)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _free.push_back(size_t(&mask - _masks.data()));
+    }
+    _available.notify_one();
+  }
+
+  std::vector<std::vector<uint64_t> >& masks() { return _masks; }
+
+private:
+  std::vector<std::vector<uint64_t> > _masks;
+  size_t                  _words;
+  std::vector<size_t>     _free;
+  std::mutex              _mutex;
+  std::condition_variable _available;
+};
+
+}
+
+FreeSpaceCarver::FreeSpaceCarver(float originX, float originY, float originZ, float voxSize, int nbVox)
+  : _voxSize(voxSize),
+    _nbVox(nbVox),
+    _cameras(nullptr),
+    _centres(nullptr),
+    _rayStep(1),
+    _maskSlots(0),
+    _raysCount(0),
+    _freedCount(0)
+{
+  _origin[0] = originX;
+  _origin[1] = originY;
+  _origin[2] = originZ;
+}
+
+size_t FreeSpaceCarver::memorySize(int nbVox, size_t maskSlots)
+{
+  const size_t words = (size_t(nbVox) * nbVox * nbVox + 63) / 64;
+  return (maskSlots + 1) * words * sizeof(uint64_t);
+}
+
+void FreeSpaceCarver::setCameras(const CameraStore* cameras, const float* centres)
+{
+  _cameras = cameras;
+  _centres = centres;
+}
+
+bool FreeSpaceCarver::_sees(const float* m, const float* X) const
+{
+  // same projection as VisualHull
+  const float x = m[0] * X[0] + m[4] * X[1] + m[8]  * X[2] + m[12];
+  const float y = m[1] * X[0] + m[5] * X[1] + m[9]  * X[2] + m[13];
+  const float z = m[2] * X[0] + m[6] * X[1] + m[10] * X[2] + m[14];
+  return z > 0.f && std::fabs(x) < z && std::fabs(y) < z;
+}
+
+void FreeSpaceCarver::_walk(const float* centre, const float* X, float distance,
+                            const uint64_t* surface, uint64_t* mask) const
+{
+  const int n = _nbVox;
+
+  // the segment in grid units, g(t) = g0 + t * dir for t in [0, 1]
+  float g0[3], dir[3];
+  for (int axis = 0; axis < 3; axis++) {
+    g0[axis] = (centre[axis] - _origin[axis]) / _voxSize;
+    dir[axis] = (X[axis] - centre[axis]) / _voxSize;
+  }
+  float tBegin = 0.f;
+  float tEnd = 1.f - SURFACE_MARGIN * _voxSize / distance;
+
+  // clip it to the grid
+  for (int axis = 0; axis < 3; axis++) {
+    if (dir[axis] == 0.f) {
+      if (g0[axis] < 0.f || g0[axis] >= n)
+        return;
+      continue;
+    }
+    const float t0 = -g0[axis] / dir[axis];
+    const float t1 = (n - g0[axis]) / dir[axis];
+    tBegin = std::max(tBegin, std::min(t0, t1));
+    tEnd = std::min(tEnd, std::max(t0, t1));
+  }
+  if (!(tBegin < tEnd))
+    return;
+
+  // Amanatides-Woo: step into the neighbour whose boundary the ray meets first
+  int cell[3], step[3];
+  float tMax[3], tDelta[3];
+  for (int axis = 0; axis < 3; axis++) {
+    const float g = g0[axis] + tBegin * dir[axis];
+    cell[axis] = std::min(std::max(int(std::floor(g)), 0), n - 1);
+    if (dir[axis] > 0.f) {
+      step[axis] = 1;
+      tMax[axis] = tBegin + (cell[axis] + 1 - g) / dir[axis];
+      tDelta[axis] = 1.f / dir[axis];
+    } else if (dir[axis] < 0.f) {
+      step[axis] = -1;
+      tMax[axis] = tBegin + (cell[axis] - g) / dir[axis];
+      tDelta[axis] = -1.f / dir[axis];
+    } else {
+      step[axis] = 0;
+      tMax[axis] = std::numeric_limits<float>::max();
+      tDelta[axis] = std::numeric_limits<float>::max();
+    }
+  }
+
+  float t = tBegin;
+  while (t < tEnd) {
+    const size_t v = (size_t(cell[0]) * n + cell[1]) * n + cell[2];
+    const uint64_t bit = uint64_t(1) << (v & 63);
+    // a voxel holding points hides what lies behind it
+    if (surface[v >> 6] & bit)
+      return;
+    mask[v >> 6] |= bit;
+
+    const int axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+    t = tMax[axis];
+    cell[axis] += step[axis];
+    if (cell[axis] < 0 || cell[axis] >= n)
+      break;
+    tMax[axis] += tDelta[axis];
+  }
+}
+
+void FreeSpaceCarver::carve(const float* points, size_t count, size_t stride, unsigned char* occupancy)
+{
+  TaskPool& pool = TaskPool::instance();
+  const int n = _nbVox;
+  const size_t words = (size_t(n) * n * n + 63) / 64;
+  const size_t samples = (count + _rayStep - 1) / _rayStep;
+  const size_t views = _cameras->size();
+
+  // a mask per thread at most, allocated when first lent
+  const size_t threads = size_t(pool.threadsCount());
+  MaskPool maskPool(_maskSlots > 0 ? std::min(_maskSlots, threads) : threads, words);
+  std::vector<std::vector<uint64_t> >& masks = maskPool.masks();
+  std::vector<uint64_t> surface(words, 0);
+
+  // voxels near a point, from every point whatever the ray step
+  pool.parallelFor(0, count, [&](size_t begin, size_t end) {
+    std::vector<uint64_t>& mask = maskPool.acquire();
+    for (size_t i = begin; i < end; i++) {
+      const float *X = points + i * stride;
+      int cell[3];
+      bool inside = true;
+      for (int axis = 0; axis < 3 && inside; axis++) {
+        cell[axis] = int(std::floor((X[axis] - _origin[axis]) / _voxSize));
+        inside = cell[axis] >= 0 && cell[axis] < n;
+      }
+      if (!inside)
+        continue;
+      // with its neighbours, so rays do not slip between sparse points
+      for (int x = std::max(cell[0] - 1, 0); x <= std::min(cell[0] + 1, n - 1); x++) {
+        for (int y = std::max(cell[1] - 1, 0); y <= std::min(cell[1] + 1, n - 1); y++) {
+          for (int z = std::max(cell[2] - 1, 0); z <= std::min(cell[2] + 1, n - 1); z++) {
+            const size_t v = (size_t(x) * n + y) * n + z;
+            mask[v >> 6] |= uint64_t(1) << (v & 63);
+          }
+        }
+      }
+    }
+    maskPool.release(mask);
+  }, RAY_GRAIN);
+  pool.parallelFor(0, words, [&](size_t begin, size_t end) {
+    for (size_t w = begin; w < end; w++) {
+      for (size_t t = 0; t < masks.size(); t++) {
+        if (!masks[t].empty()) {
+          surface[w] |= masks[t][w];
+          masks[t][w] = 0;
+        }
+      }
+    }
+  });
+
+  // matrices next to each other, as every ray tests them all
+  std::vector<float> matrices(views * 16);
+  for (size_t c = 0; c < views; c++) {
+    for (int e = 0; e < 16; e++)
+      matrices[c * 16 + e] = _cameras->matrix(e)[c];
+  }
+
+  // a ray from every camera whose image holds the point
+  std::atomic<size_t> rays(0);
+  pool.parallelFor(0, samples, [&](size_t begin, size_t end) {
+    std::vector<uint64_t>& mask = maskPool.acquire();
+    size_t cast = 0;
+    for (size_t i = begin; i < end; i++) {
+      const float *X = points + i * _rayStep * stride;
+      for (size_t c = 0; c < views; c++) {
+        if (!_sees(&matrices[c * 16], X))
+          continue;
+        const float *centre = _centres + 3 * c;
+        const float dx = X[0] - centre[0], dy = X[1] - centre[1], dz = X[2] - centre[2];
+        _walk(centre, X, std::sqrt(dx * dx + dy * dy + dz * dz), surface.data(), mask.data());
+        cast++;
+      }
+    }
+    maskPool.release(mask);
+    rays += cast;
+  }, RAY_GRAIN);
+
+  // any thread's ray empties a voxel
+  std::atomic<size_t> freed(0);
+  pool.parallelFor(0, words, [&](size_t begin, size_t end) {
+    size_t emptied = 0;
+    for (size_t w = begin; w < end; w++) {
+      uint64_t bits = 0;
+      for (size_t t = 0; t < masks.size(); t++) {
+        if (!masks[t].empty())
+          bits |= masks[t][w];
+      }
+      for (int k = 0; bits != 0 && k < 64; k++) {
+        if (bits >> k & 1) {
+          unsigned char& voxel = occupancy[w * 64 + k];
+          emptied += voxel;
+          voxel = 0;
+        }
+      }
+    }
+    freed += emptied;
+  });
+
+  _raysCount = rays;
+  _freedCount = freed;
+}
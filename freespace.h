@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "camerastore.h"
+
+// Carves the space cameras look through: every voxel on the segment between
+// a camera centre and a point that camera sees must be empty.
+//
+// Every point casts a ray from each camera whose image holds it. The ray
+// walks the grid with the Amanatides-Woo 3D-DDA and stops short of the
+// point, so the voxels around the surface stay. Bundles do not record which
+// camera saw which point, so occlusion comes from the points themselves: a
+// ray also stops at the first voxel next to any point, and a point hidden
+// from a camera only clears the space in front of what hides it. Rays are
+// spread over the pool by chunks of points, each chunk marks crossed voxels
+// in a bitmask no other chunk holds meanwhile, a thread's worth of masks at
+// most, and the masks are merged into the occupancy at the end.
+class FreeSpaceCarver
+{
+public:
+  // grid spanning [origin, origin + nbVox * voxSize] on each axis, laid out
+  // as Scene's _voxStorage
+  FreeSpaceCarver(float originX, float originY, float originZ, float voxSize, int nbVox);
+
+  // cameras and their centres (x, y, z each), both must outlive the carver
+  void setCameras(const CameraStore* cameras, const float* centres);
+
+  // only every step-th point casts rays, for speed; all of them still hide
+  // what lies behind
+  void setRayStep(size_t step) { _rayStep = step > 0 ? step : 1; }
+
+  // at most 'slots' masks, 0 for one per thread; fewer save memory, and
+  // leave threads waiting for one
+  void setMaskSlots(size_t slots) { _maskSlots = slots; }
+
+  // bytes carve() allocates at most with 'maskSlots' masks, the surface's included
+  static size_t memorySize(int nbVox, size_t maskSlots);
+
+  // clear the voxels crossed by the rays of 'count' points, 'stride' floats
+  // apart with x, y, z first
+  void carve(const float* points, size_t count, size_t stride, unsigned char* occupancy);
+
+  size_t raysCount() const { return _raysCount; }     // cast by the last carve
+  size_t freedCount() const { return _freedCount; }   // voxels it emptied
+
+private:
+  // whether X projects inside the image of matrix m
+  bool _sees(const float* m, const float* X) const;
+  // mark the voxels from the camera centre to short of X, 'distance' away,
+  // up to the first one in 'surface'
+  void _walk(const float* centre, const float* X, float distance,
+             const uint64_t* surface, uint64_t* mask) const;
+
+  float _origin[3];
+  float _voxSize;
+  int   _nbVox;
+  const CameraStore* _cameras;
+  const float*       _centres;
+  size_t _rayStep;
+  size_t _maskSlots;
+  size_t _raysCount;
+  size_t _freedCount;
+};
@@ -0,0 +1,171 @@
+#include "hullvalidator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "taskpool.h"
+
+// corner k of a voxel is offset by one voxel along x if k & 1, y if k & 2
+// and z if k & 4; its edges join the corners one bit apart
+static const int CUBE_EDGES[12][2] = {
+  {0, 1}, {2, 3}, {4, 5}, {6, 7},
+  {0, 2}, {1, 3}, {4, 6}, {5, 7},
+  {0, 4}, {1, 5}, {2, 6}, {3, 7}
+};
+
+HullValidator::HullValidator(float originX, float originY, float originZ, float voxSize, int nbVox)
+  : _voxSize(voxSize),
+    _nbVox(nbVox),
+    _cameras(nullptr),
+    _masks(nullptr),
+    _surfaceVoxelsCount(0)
+{
+  _origin[0] = originX;
+  _origin[1] = originY;
+  _origin[2] = originZ;
+}
+
+void HullValidator::setCameras(const CameraStore* cameras, const Silhouette* const* masks)
+{
+  _cameras = cameras;
+  _masks = masks;
+}
+
+void HullValidator::validate(const unsigned char* occupancy, std::vector<CameraConsistency>& scores)
+{
+  TaskPool& pool = TaskPool::instance();
+  const int n = _nbVox;
+  const size_t nn = size_t(n) * n;
+
+  // surface voxels, gathered by x slab
+  std::vector<std::vector<uint32_t>> slabs(n);
+  pool.parallelFor(0, n, [&](size_t begin, size_t end) {
+    for (size_t x = begin; x < end; x++) {
+      for (int y = 0; y < n; y++) {
+        for (int z = 0; z < n; z++) {
+          const size_t v = x * nn + size_t(y) * n + z;
+          if (!occupancy[v])
+            continue;
+          const bool border = x == 0 || x == size_t(n - 1) || y == 0 || y == n - 1 || z == 0 || z == n - 1;
+          if (border || !occupancy[v - nn] || !occupancy[v + nn] || !occupancy[v - n] || !occupancy[v + n]
+              || !occupancy[v - 1] || !occupancy[v + 1])
+            slabs[x].push_back(uint32_t(v));
+        }
+      }
+    }
+  }, 1);
+  std::vector<uint32_t> voxels;
+  for (const std::vector<uint32_t>& slab : slabs) {
+    voxels.insert(voxels.end(), slab.begin(), slab.end());
+  }
+  _surfaceVoxelsCount = voxels.size();
+
+  const size_t count = _cameras->size();
+  scores.assign(count, CameraConsistency());
+  std::vector<std::vector<unsigned char>> images(pool.threadsCount());
+  pool.parallelFor(0, count, [&](size_t begin, size_t end) {
+    std::vector<unsigned char>& image = images[pool.slot()];
+    for (size_t c = begin; c < end; c++) {
+      const Silhouette& mask = *_masks[c];
+      const int w = mask.width(), h = mask.height();
+      CameraConsistency& score = scores[c];
+      score.camera = uint32_t(c);
+
+      float m[16];
+      for (int e = 0; e < 16; e++) {
+        m[e] = _cameras->matrix(e)[c];
+      }
+      image.assign(size_t(w) * h, 0);
+      _render(m, voxels, w, h, image.data());
+
+      for (int y = 0; y < h; y++) {
+        const unsigned char *row = &image[size_t(y) * w];
+        for (int x = 0; x < w; x++) {
+          score.hullPixels += row[x];
+        }
+        for (const Silhouette::Run *run = mask.rowBegin(y); run != mask.rowEnd(y); ++run) {
+          score.maskPixels += run->end - run->begin;
+          for (int x = run->begin; x < run->end; x++) {
+            score.intersection += row[x];
+          }
+        }
+      }
+      const size_t unionPixels = score.hullPixels + score.maskPixels - score.intersection;
+      score.iou = unionPixels ? float(double(score.intersection) / unionPixels) : 1.f;
+    }
+  }, 1);
+}
+
+void HullValidator::_render(const float* m, const std::vector<uint32_t>& voxels, int width, int height,
+                            unsigned char* image) const
+{
+  const int n = _nbVox;
+
+  // homogeneous x, y, z of the grid origin and of a voxel step along each axis
+  float origin[3], steps[3][3];
+  for (int k = 0; k < 3; k++) {
+    origin[k] = m[k] * _origin[0] + m[4 + k] * _origin[1] + m[8 + k] * _origin[2] + m[12 + k];
+    for (int axis = 0; axis < 3; axis++) {
+      steps[axis][k] = m[axis * 4 + k] * _voxSize;
+    }
+  }
+
+  for (uint32_t v : voxels) {
+    const int index[3] = {int(v / (uint32_t(n) * n)), int(v / n % n), int(v % n)};
+    float base[3];
+    for (int k = 0; k < 3; k++) {
+      base[k] = origin[k] + index[0] * steps[0][k] + index[1] * steps[1][k] + index[2] * steps[2][k];
+    }
+
+    // pixel coordinates of the corners
+    float px[8], py[8];
+    float minX = std::numeric_limits<float>::max(), maxX = std::numeric_limits<float>::lowest();
+    float minY = minX, maxY = maxX;
+    bool behind = false;
+    for (int corner = 0; corner < 8 && !behind; corner++) {
+      float p[3];
+      for (int k = 0; k < 3; k++) {
+        p[k] = base[k] + ((corner & 1) ? steps[0][k] : 0.f) + ((corner & 2) ? steps[1][k] : 0.f)
+                       + ((corner & 4) ? steps[2][k] : 0.f);
+      }
+      behind = !(p[2] > 0.f);
+      px[corner] = (p[0] / p[2] + 1.f) * .5f * width;
+      py[corner] = (1.f - p[1] / p[2]) * .5f * height;
+      minX = std::min(minX, px[corner]);
+      maxX = std::max(maxX, px[corner]);
+      minY = std::min(minY, py[corner]);
+      maxY = std::max(maxY, py[corner]);
+    }
+    if (behind || maxX < .5f || minX > width - .5f || maxY < .5f || minY > height - .5f)
+      continue;
+
+    // rows whose centre the projection covers, each spanning the edges it meets
+    const int firstRow = int(std::ceil(std::max(minY, 0.f) - .5f));
+    const int lastRow = int(std::floor(std::min(maxY, float(height)) - .5f));
+    for (int y = firstRow; y <= lastRow; y++) {
+      const float centre = y + .5f;
+      float spanMin = std::numeric_limits<float>::max(), spanMax = std::numeric_limits<float>::lowest();
+      for (const int *edge : CUBE_EDGES) {
+        const float ya = py[edge[0]], yb = py[edge[1]];
+        if ((centre < ya && centre < yb) || (centre > ya && centre > yb))
+          continue;
+        const float xa = px[edge[0]], xb = px[edge[1]];
+        if (ya == yb) {
+          spanMin = std::min(spanMin, std::min(xa, xb));
+          spanMax = std::max(spanMax, std::max(xa, xb));
+        } else {
+          const float x = xa + (centre - ya) / (yb - ya) * (xb - xa);
+          spanMin = std::min(spanMin, x);
+          spanMax = std::max(spanMax, x);
+        }
+      }
+      // clamped before rounding, corners close to the camera plane land far away
+      const int first = int(std::ceil(std::min(std::max(spanMin, 0.f), float(width)) - .5f));
+      const int last = int(std::floor(std::min(std::max(spanMax, 0.f), float(width)) - .5f));
+      if (first <= last)
+        std::memset(image + size_t(y) * width + first, 1, last - first + 1);
+    }
+  }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "camerastore.h"
+#include "silhouette.h"
+
+// How well one camera's mask agrees with the carved hull seen from it.
+struct CameraConsistency
+{
+  uint32_t camera = 0;
+  float    iou = 0.f;        // intersection over union, 1 when they agree
+  size_t   hullPixels = 0;   // covered by the hull
+  size_t   maskPixels = 0;   // inside the mask
+  size_t   intersection = 0; // both
+};
+
+// Renders an occupancy grid, laid out as Scene's _voxStorage, into the image
+// of every camera at its mask's resolution and compares it with the mask.
+//
+// Only surface voxels, occupied with an empty face neighbour, are drawn: the
+// silhouette of a solid is that of its surface. A voxel covers the pixels
+// whose centres fall inside the projection of its cube, the convex polygon
+// outlined by its projected edges, filled row by row; pixels follow
+// VisualHull's mapping. Voxels reaching behind a camera are left out of its
+// image. Cameras are rendered in parallel on the task pool, each thread into
+// an image of its own, without any GL context.
+//
+// A camera whose mask is wrong, or whose pose is, shows a low IoU: after
+// carving, the other cameras cut away what its mask claims, or its mask cuts
+// away what they see.
+class HullValidator
+{
+public:
+  // grid spanning [origin, origin + nbVox * voxSize] on each axis
+  HullValidator(float originX, float originY, float originZ, float voxSize, int nbVox);
+
+  // masks[c] is camera c's silhouette; all must outlive the validator
+  void setCameras(const CameraStore* cameras, const Silhouette* const* masks);
+
+  // one score per camera, in camera order
+  void validate(const unsigned char* occupancy, std::vector<CameraConsistency>& scores);
+
+  size_t surfaceVoxelsCount() const { return _surfaceVoxelsCount; } // drawn by the last validate
+
+private:
+  // draw the cubes of 'voxels' (x * nbVox^2 + y * nbVox + z) into 'image',
+  // seen through the matrix 'm'
+  void _render(const float* m, const std::vector<uint32_t>& voxels, int width, int height,
+               unsigned char* image) const;
+
+  float _origin[3];
+  float _voxSize;
+  int   _nbVox;
+  const CameraStore*       _cameras;
+  const Silhouette* const* _masks;
+  size_t                   _surfaceVoxelsCount;
+};
@@ -0,0 +1,163 @@
+#include "kdtree.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "taskpool.h"
+
+const size_t PARALLEL_BUILD = 1 << 16; // entries of a range whose halves are built apart
+
+KdTree::KdTree()
+{
+}
+
+size_t KdTree::_nodesCount(size_t count)
+{
+  // a range of n entries has halves of n / 2 entries at most
+  size_t levels = 0;
+  for (size_t n = count; n > LEAF_SIZE; n /= 2)
+    levels++;
+  return (size_t(1) << levels) - 1;
+}
+
+void KdTree::build(const float* points, size_t count, size_t stride)
+{
+  TaskPool& pool = TaskPool::instance();
+  _entries.resize(count);
+  _boxes.assign(_nodesCount(count) * 6, 0.f);
+
+  const size_t rangesCount = pool.threadsCount();
+  std::vector<float> ranges(rangesCount * 6);
+  pool.parallelFor(0, rangesCount, [&](size_t r, size_t) {
+    float *bounds = &ranges[r * 6];
+    for (int axis = 0; axis < 3; axis++) {
+      bounds[axis] = std::numeric_limits<float>::max();
+      bounds[3 + axis] = std::numeric_limits<float>::lowest();
+    }
+    for (size_t i = count * r / rangesCount; i < count * (r + 1) / rangesCount; i++) {
+      const float *p = points + i * stride;
+      Entry& entry = _entries[i];
+      for (int axis = 0; axis < 3; axis++) {
+        entry.position[axis] = p[axis];
+        bounds[axis] = std::min(bounds[axis], p[axis]);
+        bounds[3 + axis] = std::max(bounds[3 + axis], p[axis]);
+      }
+      entry.point = uint32_t(i);
+    }
+  }, 1);
+
+  float min[3], max[3];
+  for (int axis = 0; axis < 3; axis++) {
+    min[axis] = std::numeric_limits<float>::max();
+    max[axis] = std::numeric_limits<float>::lowest();
+    for (size_t r = 0; r < rangesCount; r++) {
+      min[axis] = std::min(min[axis], ranges[r * 6 + axis]);
+      max[axis] = std::max(max[axis], ranges[r * 6 + 3 + axis]);
+    }
+  }
+  _build(0, 0, count, min, max);
+}
+
+void KdTree::_build(size_t node, size_t begin, size_t end, const float* min, const float* max)
+{
+  if (end - begin <= LEAF_SIZE)
+    return;
+  float *box = &_boxes[node * 6];
+  std::copy(min, min + 3, box);
+  std::copy(max, max + 3, box + 3);
+
+  // split the widest side of the box at the median
+  int axis = 0;
+  for (int a = 1; a < 3; a++) {
+    if (max[a] - min[a] > max[axis] - min[axis])
+      axis = a;
+  }
+  const size_t middle = begin + (end - begin) / 2;
+  std::nth_element(_entries.begin() + begin, _entries.begin() + middle, _entries.begin() + end,
+                   [axis](const Entry& a, const Entry& b) { return a.position[axis] < b.position[axis]; });
+
+  // the bounds of each half
+  float lower[6], upper[6];
+  for (int a = 0; a < 3; a++) {
+    lower[a] = upper[a] = std::numeric_limits<float>::max();
+    lower[3 + a] = upper[3 + a] = std::numeric_limits<float>::lowest();
+  }
+  for (size_t i = begin; i < end; i++) {
+    float *bounds = i < middle ? lower : upper;
+    for (int a = 0; a < 3; a++) {
+      bounds[a] = std::min(bounds[a], _entries[i].position[a]);
+      bounds[3 + a] = std::max(bounds[3 + a], _entries[i].position[a]);
+    }
+  }
+
+  if (end - begin > PARALLEL_BUILD) {
+    TaskGroup group;
+    group.run([=]() { _build(2 * node + 1, begin, middle, lower, lower + 3); });
+    _build(2 * node + 2, middle + 1, end, upper, upper + 3);
+    group.wait();
+  } else {
+    _build(2 * node + 1, begin, middle, lower, lower + 3);
+    _build(2 * node + 2, middle + 1, end, upper, upper + 3);
+  }
+}
+
+float KdTree::nearest(const float* p, float bound, const Entry*& entry) const
+{
+  float best = bound;
+  if (!_entries.empty())
+    _search(0, 0, _entries.size(), p, best, entry);
+  return best;
+}
+
+float KdTree::_boxDistance(size_t node, const float* p) const
+{
+  const float *box = &_boxes[node * 6];
+  float distance = 0.f;
+  for (int axis = 0; axis < 3; axis++) {
+    const float offset = std::max(std::max(box[axis] - p[axis], p[axis] - box[3 + axis]), 0.f);
+    distance += offset * offset;
+  }
+  return distance;
+}
+
+void KdTree::_search(size_t node, size_t begin, size_t end, const float* p, float& best, const Entry*& entry) const
+{
+  if (end - begin <= LEAF_SIZE) {
+    for (size_t i = begin; i < end; i++) {
+      const float *q = _entries[i].position;
+      const float dx = q[0] - p[0], dy = q[1] - p[1], dz = q[2] - p[2];
+      const float d = dx * dx + dy * dy + dz * dz;
+      if (d < best) {
+        best = d;
+        entry = &_entries[i];
+      }
+    }
+    return;
+  }
+
+  const size_t middle = begin + (end - begin) / 2;
+  const Entry& split = _entries[middle];
+  const float dx = split.position[0] - p[0], dy = split.position[1] - p[1], dz = split.position[2] - p[2];
+  const float d = dx * dx + dy * dy + dz * dz;
+  if (d < best) {
+    best = d;
+    entry = &split;
+  }
+
+  // the closer half first, each only if its box is closer than the best so
+  // far; leaves are searched without looking at their box
+  const size_t lower = 2 * node + 1, upper = 2 * node + 2;
+  const float lowerDistance = middle - begin > LEAF_SIZE ? _boxDistance(lower, p) : 0.f;
+  const float upperDistance = end - middle - 1 > LEAF_SIZE ? _boxDistance(upper, p) : 0.f;
+  if (lowerDistance <= upperDistance) {
+    if (lowerDistance < best)
+      _search(lower, begin, middle, p, best, entry);
+    if (upperDistance < best)
+      _search(upper, middle + 1, end, p, best, entry);
+  } else {
+    if (upperDistance < best)
+      _search(upper, middle + 1, end, p, best, entry);
+    if (lowerDistance < best)
+      _search(lower, begin, middle, p, best, entry);
+  }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Nearest-neighbour queries on a static cloud.
+//
+// The tree is implicit in the order of its entries: a node is a range whose
+// middle entry splits the rest in two halves along the widest side of the
+// range's box, the lower half before it and the upper half after it.
+// Ranges of LEAF_SIZE entries or fewer are leaves, searched linearly. Each
+// entry keeps a copy of its point's position, so a query only touches the
+// tree. Halves of large ranges are built in parallel on the task pool.
+//
+// Other nodes keep the bounding box of their points, numbered as in a heap
+// (the halves of node k are 2k + 1 and 2k + 2). Queries skip nodes whose box
+// lies farther than the best point so far; on scans, where points lie on
+// surfaces, these boxes are much thinner than the cells the splits cut, so
+// points far from the cloud stay cheap.
+class KdTree
+{
+public:
+  static const size_t LEAF_SIZE = 32;
+
+  struct Entry
+  {
+    float    position[3];
+    uint32_t point; // index in the built cloud
+  };
+
+  KdTree();
+
+  // index 'count' points, x, y, z first and 'stride' floats apart
+  void build(const float* points, size_t count, size_t stride);
+
+  size_t size() const { return _entries.size(); }
+  size_t memorySize() const { return _entries.capacity() * sizeof(Entry) + _boxes.capacity() * sizeof(float); }
+  static size_t memorySize(size_t count) { return count * sizeof(Entry) + _nodesCount(count) * 6 * sizeof(float); }
+
+  // squared distance from p to its nearest point and that point's entry,
+  // looking only closer than 'bound' (squared); returns 'bound' and leaves
+  // 'entry' alone when none is
+  float nearest(const float* p, float bound, const Entry*& entry) const;
+
+private:
+  static size_t _nodesCount(size_t count); // nodes that are not leaves, heap numbered
+  void _build(size_t node, size_t begin, size_t end, const float* min, const float* max);
+  float _boxDistance(size_t node, const float* p) const;
+  void _search(size_t node, size_t begin, size_t end, const float* p, float& best, const Entry*& entry) const;
+
+  std::vector<Entry> _entries;
+  std::vector<float> _boxes; // min then max of each node that is not a leaf
+};
@@ -1,12 +1,89 @@
 #include <QApplication>
+#include <QElapsedTimer>
+#include <cstdio>
+#include <memory>
 #include "mainwindow.h"
-#include <omp.h>
+#include "bench.h"
+#include "memorybudget.h"
+#include "replay.h"
+#include "scene.h"
+#include "taskpool.h"
 
 int main(int argc, char *argv[])
 {
-  omp_set_num_threads(16);
+  // startup is timed from here to the first frame
+  QElapsedTimer startup;
+  startup.start();
+
   QApplication app(argc, argv);
+  QStringList arguments = app.arguments();
+
+  // threads shared by every parallel stage: --threads N, else the
+  // PCVIEWER_THREADS environment variable, else one per hardware thread
+  int threadsCount = qEnvironmentVariableIntValue("PCVIEWER_THREADS");
+  const int threadsArgument = arguments.indexOf("--threads");
+  if (threadsArgument > 0 && threadsArgument + 1 < arguments.size()) {
+    threadsCount = arguments[threadsArgument + 1].toInt();
+    arguments.erase(arguments.begin() + threadsArgument, arguments.begin() + threadsArgument + 2);
+  }
+  TaskPool::configure(threadsCount);
+
+  // --timings prints how long each named stage took; --startup as well, and
+  // quits once the first frame is drawn
+  const bool startupOnly = arguments.removeAll("--startup") > 0;
+  if (arguments.removeAll("--timings") > 0 || startupOnly) {
+    TaskPool::instance().setTimingHook([](const char* name, double milliseconds) {
+      std::fprintf(stderr, "%s: %.1f ms\n", name, milliseconds);
+    });
+  }
+
+  // --memory prints the bytes held by category after each large operation
+  if (arguments.removeAll("--memory") > 0) {
+    MemoryBudget::instance().setLogHook([](const std::string& line) {
+      std::fprintf(stderr, "%s\n", line.c_str());
+    });
+  }
+
+  // headless benchmarks: pcviewer --bench config.txt
+  if (arguments.size() > 2 && arguments[1] == "--bench") {
+    return runBenchmark(arguments[2]);
+  }
+  // lit against unlit points, in a window: pcviewer --bench-shading config.txt
+  if (arguments.size() > 2 && arguments[1] == "--bench-shading") {
+    return runShadingBenchmark(arguments[2]);
+  }
+  // voxels as cubes against raymarched, in a window: pcviewer --bench-voxels config.txt
+  if (arguments.size() > 2 && arguments[1] == "--bench-voxels") {
+    return runVoxelBenchmark(arguments[2]);
+  }
+
+  // live stream producer: pcviewer --replay points.ply /tmp/scan.sock [--rate N] [--loop]
+  if (arguments.size() > 3 && arguments[1] == "--replay") {
+    double rate = 1e6;
+    const int rateArgument = arguments.indexOf("--rate");
+    if (rateArgument > 0 && rateArgument + 1 < arguments.size()) {
+      rate = arguments[rateArgument + 1].toDouble();
+    }
+    return runReplay(arguments[2], arguments[3], rate, arguments.contains("--loop"));
+  }
+
+  TaskPool::instance().reportTiming("startup: application", startup.nsecsElapsed() * 1e-6);
   MainWindow mainWindow;
+  TaskPool::instance().reportTiming("startup: scene loaded", startup.nsecsElapsed() * 1e-6);
   mainWindow.show();
+
+  Scene *scene = mainWindow.findChild<Scene*>();
+  if (scene) {
+    auto firstFrame = std::make_shared<QMetaObject::Connection>();
+    *firstFrame = QObject::connect(scene, &QOpenGLWidget::frameSwapped, [&, firstFrame]() {
+      QObject::disconnect(*firstFrame);
+      TaskPool::instance().reportTiming("startup: first frame", startup.nsecsElapsed() * 1e-6);
+      if (startupOnly)
+        app.quit();
+    });
+  } else if (startupOnly) {
+    std::fprintf(stderr, "--startup needs a config file\n");
+    return 1;
+  }
   return app.exec();
 }
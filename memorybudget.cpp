@@ -0,0 +1,157 @@
+#include "memorybudget.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <unistd.h>
+
+static double megabytes(size_t bytes)
+{
+  return bytes / (1024. * 1024.);
+}
+
+MemoryBudget& MemoryBudget::instance()
+{
+  static MemoryBudget budget;
+  return budget;
+}
+
+MemoryBudget::MemoryBudget()
+  : _limit(0),
+    _hostPeak(0)
+{
+  std::fill(_live, _live + CategoriesCount, size_t(0));
+  std::fill(_peak, _peak + CategoriesCount, size_t(0));
+
+  const long pages = sysconf(_SC_PHYS_PAGES);
+  const long pageSize = sysconf(_SC_PAGE_SIZE);
+  if (pages > 0 && pageSize > 0)
+    _limit = size_t(pages) * size_t(pageSize) / 4 * 3;
+}
+
+void MemoryBudget::setLimit(size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  _limit = bytes;
+}
+
+size_t MemoryBudget::limit() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _limit;
+}
+
+bool MemoryBudget::fits(size_t bytes, size_t released) const
+{
+  const size_t free = available();
+  return free == std::numeric_limits<size_t>::max() || bytes <= free + released;
+}
+
+size_t MemoryBudget::available() const
+{
+  const size_t used = hostLive();
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_limit == 0)
+    return std::numeric_limits<size_t>::max();
+  return _limit > used ? _limit - used : 0;
+}
+
+size_t MemoryBudget::live(Category category) const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _live[category];
+}
+
+size_t MemoryBudget::peak(Category category) const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _peak[category];
+}
+
+size_t MemoryBudget::hostLive() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  size_t total = 0;
+  for (int c = 0; c < CategoriesCount; c++) {
+    if (c != GpuBuffers)
+      total += _live[c];
+  }
+  return total;
+}
+
+size_t MemoryBudget::hostPeak() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _hostPeak;
+}
+
+const char* MemoryBudget::name(Category category)
+{
+  static const char* names[CategoriesCount] = { "points", "voxels", "masks", "gpu buffers", "meshes" };
+  return names[category];
+}
+
+void MemoryBudget::setLogHook(const LogHook& hook)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  _logHook = hook;
+}
+
+void MemoryBudget::log(const std::string& event) const
+{
+  LogHook hook;
+  std::string line = event + ":";
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_logHook)
+      return;
+    hook = _logHook;
+
+    char text[128];
+    size_t host = 0;
+    for (int c = 0; c < CategoriesCount; c++) {
+      std::snprintf(text, sizeof(text), " %s %.1f MB (peak %.1f),",
+                    name(Category(c)), megabytes(_live[c]), megabytes(_peak[c]));
+      line += text;
+      if (c != GpuBuffers)
+        host += _live[c];
+    }
+    std::snprintf(text, sizeof(text), " host %.1f MB (peak %.1f) of %.1f MB",
+                  megabytes(host), megabytes(_hostPeak), megabytes(_limit));
+    line += text;
+  }
+  hook(line);
+}
+
+void MemoryBudget::_change(Category category, size_t previous, size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  _live[category] = _live[category] - previous + bytes;
+  _peak[category] = std::max(_peak[category], _live[category]);
+
+  size_t host = 0;
+  for (int c = 0; c < CategoriesCount; c++) {
+    if (c != GpuBuffers)
+      host += _live[c];
+  }
+  _hostPeak = std::max(_hostPeak, host);
+}
+
+MemoryAccount::MemoryAccount(MemoryBudget::Category category)
+  : _category(category),
+    _bytes(0)
+{
+}
+
+MemoryAccount::~MemoryAccount()
+{
+  set(0);
+}
+
+void MemoryAccount::set(size_t bytes)
+{
+  if (bytes == _bytes)
+    return;
+  MemoryBudget::instance()._change(_category, _bytes, bytes);
+  _bytes = bytes;
+}
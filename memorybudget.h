@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// Bytes held by the viewer's large allocations, live and at their peak, by
+// category, checked against a budget of host memory.
+//
+// Owners keep a MemoryAccount per allocation and set it to the bytes they
+// hold. Before a large allocation they ask fits() and, when it does not,
+// settle for less (a coarser grid, fewer points) instead of running the
+// machine out of memory. GPU buffers are counted but not held to the budget,
+// their size already follows gpu_budget.
+class MemoryBudget
+{
+public:
+  enum Category
+  {
+    Points,     // resident points, scans read before upload
+    Voxels,     // occupancy, voxelizer tables, distance fields
+    Masks,      // decoded silhouettes
+    GpuBuffers, // vertex and index buffers
+    Meshes,     // extracted surfaces
+    CategoriesCount
+  };
+
+  typedef std::function<void(const std::string& line)> LogHook;
+
+  static MemoryBudget& instance();
+
+  MemoryBudget();
+
+  // host bytes allowed, 0 for no limit; three quarters of the physical
+  // memory by default
+  void setLimit(size_t bytes);
+  size_t limit() const;
+
+  // whether 'bytes' more would stay within the limit once 'released' bytes
+  // already counted are freed
+  bool fits(size_t bytes, size_t released = 0) const;
+  // host bytes free under the limit, as many as size_t holds without one
+  size_t available() const;
+
+  size_t live(Category category) const;
+  size_t peak(Category category) const;
+  size_t hostLive() const;  // every category but GpuBuffers
+  size_t hostPeak() const;
+
+  static const char* name(Category category);
+
+  // one line per event when set, e.g. the headless --memory log
+  void setLogHook(const LogHook& hook);
+  // 'event' followed by the live and peak bytes of each category
+  void log(const std::string& event) const;
+
+private:
+  friend class MemoryAccount;
+
+  void _change(Category category, size_t previous, size_t bytes);
+
+  mutable std::mutex _mutex;
+  size_t  _limit;
+  size_t  _live[CategoriesCount];
+  size_t  _peak[CategoriesCount];
+  size_t  _hostPeak;
+  LogHook _logHook;
+};
+
+// Bytes one owner holds in a category, released by the destructor.
+class MemoryAccount
+{
+public:
+  explicit MemoryAccount(MemoryBudget::Category category);
+  ~MemoryAccount();
+
+  MemoryAccount(const MemoryAccount&) = delete;
+  MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+  void set(size_t bytes);
+  size_t bytes() const { return _bytes; }
+
+private:
+  MemoryBudget::Category _category;
+  size_t _bytes;
+};
@@ -0,0 +1,231 @@
+#include "meshing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+
+#include "taskpool.h"
+
+namespace {
+
+const uint64_t EMPTY_KEY = ~uint64_t(0);
+
+// cell -> vertex index, insert-only, safe to fill from several threads
+class CellTable
+{
+public:
+  explicit CellTable(size_t cellsCount)
+  {
+    _capacity = 16;
+    while (_capacity < cellsCount * 2)
+      _capacity <<= 1;
+    _keys.reset(new std::atomic<uint64_t>[_capacity]);
+    _values.resize(_capacity);
+    TaskPool::instance().parallelFor(0, _capacity, [this](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        _keys[i].store(EMPTY_KEY, std::memory_order_relaxed);
+      }
+    });
+  }
+
+  void insert(uint64_t key, uint32_t value)
+  {
+    for (size_t slot = _hash(key); ; slot = (slot + 1) & (_capacity - 1)) {
+      uint64_t expected = EMPTY_KEY;
+      if (_keys[slot].compare_exchange_strong(expected, key, std::memory_order_relaxed)) {
+        _values[slot] = value;
+        return;
+      }
+    }
+  }
+
+  // only valid once every insert is done
+  uint32_t find(uint64_t key) const
+  {
+    for (size_t slot = _hash(key); ; slot = (slot + 1) & (_capacity - 1)) {
+      const uint64_t k = _keys[slot].load(std::memory_order_relaxed);
+      if (k == key)
+        return _values[slot];
+      if (k == EMPTY_KEY)
+        return ~uint32_t(0);
+    }
+  }
+
+private:
+  size_t _hash(uint64_t key) const
+  {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key & (_capacity - 1);
+  }
+
+  size_t _capacity;
+  std::unique_ptr<std::atomic<uint64_t>[]> _keys;
+  std::vector<uint32_t> _values;
+};
+
+// the 12 edges of a cell, as pairs of corner indices (corner = dx + 2*dy + 4*dz)
+const int CELL_EDGES[12][2] = {
+  { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 }, // along x
+  { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 }, // along y
+  { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }, // along z
+};
+
+} // namespace
+
+
+SurfaceExtractor::SurfaceExtractor(float originX, float originY, float originZ, float voxSize, int nbVox)
+  : _voxSize(voxSize),
+    _nbVox(nbVox),
+    _distance(nullptr)
+{
+  _origin[0] = originX;
+  _origin[1] = originY;
+  _origin[2] = originZ;
+}
+
+void SurfaceExtractor::extract(const unsigned char* occupancy, Mesh& mesh) const
+{
+  const int n = _nbVox;
+  // cells run from -1 to n-1 on each axis so the surface closes on the grid bounds
+  const int m = n + 1;
+
+  // field at voxel centre (i, j, k), empty outside the grid
+  auto field = [=](int i, int j, int k) -> float {
+    if (i < 0 || j < 0 || k < 0 || i >= n || j >= n || k >= n)
+      return .5f;
+    const size_t v = (size_t(i) * n + j) * n + k;
+    if (!_distance)
+      return occupancy[v] ? -.5f : .5f;
+    const float d = std::max(std::fabs(_distance[v]), 1e-3f);
+    return occupancy[v] ? -d : d;
+  };
+  auto cellKey = [=](int a, int b, int c) -> uint64_t {
+    return (uint64_t(a + 1) * m + (b + 1)) * m + (c + 1);
+  };
+  auto loadCell = [&](int a, int b, int c, float* f) -> bool {
+    bool inside = false, outside = false;
+    for (int corner = 0; corner < 8; corner++) {
+      f[corner] = field(a + (corner & 1), b + ((corner >> 1) & 1), c + (corner >> 2));
+      inside = inside || f[corner] < 0.f;
+      outside = outside || f[corner] >= 0.f;
+    }
+    return inside && outside;
+  };
+
+  // count the cells the surface crosses, slab by slab
+  std::vector<size_t> slabOffset(m + 1, 0);
+  TaskPool::instance().parallelFor(0, m, [&](size_t slab, size_t) {
+    const int s = int(slab);
+    size_t count = 0;
+    float f[8];
+    for (int b = -1; b < n; b++) {
+      for (int c = -1; c < n; c++) {
+        count += loadCell(s - 1, b, c, f);
+      }
+    }
+    slabOffset[s + 1] = count;
+  }, 1);
+  for (int s = 0; s < m; s++) {
+    slabOffset[s + 1] += slabOffset[s];
+  }
+
+  const size_t verticesCount = slabOffset[m];
+  mesh.vertices.resize(verticesCount * 6);
+  CellTable cells(verticesCount);
+
+  // place one vertex per crossed cell at the mean of its edge crossings,
+  // its normal follows the field gradient
+  TaskPool::instance().parallelFor(0, m, [&](size_t slab, size_t) {
+    const int s = int(slab);
+    const int a = s - 1;
+    uint32_t id = slabOffset[s];
+    float f[8];
+    for (int b = -1; b < n; b++) {
+      for (int c = -1; c < n; c++) {
+        if (!loadCell(a, b, c, f))
+          continue;
+
+        float p[3] = { 0.f, 0.f, 0.f };
+        int crossings = 0;
+        for (int e = 0; e < 12; e++) {
+          const int c0 = CELL_EDGES[e][0], c1 = CELL_EDGES[e][1];
+          if ((f[c0] < 0.f) == (f[c1] < 0.f))
+            continue;
+          const float t = f[c0] / (f[c0] - f[c1]);
+          for (int axis = 0; axis < 3; axis++) {
+            const float p0 = (c0 >> axis) & 1, p1 = (c1 >> axis) & 1;
+            p[axis] += p0 + t * (p1 - p0);
+          }
+          crossings++;
+        }
+
+        const float g[3] = {
+          (f[1] + f[3] + f[5] + f[7]) - (f[0] + f[2] + f[4] + f[6]),
+          (f[2] + f[3] + f[6] + f[7]) - (f[0] + f[1] + f[4] + f[5]),
+          (f[4] + f[5] + f[6] + f[7]) - (f[0] + f[1] + f[2] + f[3]),
+        };
+        const float norm = std::sqrt(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+        const float invNorm = norm > 0.f ? 1.f / norm : 0.f;
+
+        const int cell[3] = { a, b, c };
+        float *vertex = &mesh.vertices[size_t(id) * 6];
+        for (int axis = 0; axis < 3; axis++) {
+          vertex[axis] = _origin[axis] + (cell[axis] + .5f + p[axis] / crossings) * _voxSize;
+          vertex[3 + axis] = g[axis] * invNorm;
+        }
+        cells.insert(cellKey(a, b, c), id++);
+      }
+    }
+  }, 1);
+
+  // one quad per voxel edge crossing the surface, joining the four cells
+  // around it; edges belong to the slab of their lower end
+  std::vector<std::vector<uint32_t> > slabIndices(m);
+  TaskPool::instance().parallelFor(0, m, [&](size_t slab, size_t) {
+    const int s = int(slab);
+    const int i = s - 1;
+    std::vector<uint32_t>& indices = slabIndices[s];
+    auto quad = [&](bool flip, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t k3) {
+      uint32_t q[4] = { cells.find(k0), cells.find(k1), cells.find(k2), cells.find(k3) };
+      if (flip) {
+        std::swap(q[1], q[3]);
+      }
+      const uint32_t triangles[6] = { q[0], q[1], q[2], q[0], q[2], q[3] };
+      indices.insert(indices.end(), triangles, triangles + 6);
+    };
+
+    for (int j = -1; j < n; j++) {
+      for (int k = -1; k < n; k++) {
+        const float f0 = field(i, j, k);
+        const bool inside = f0 < 0.f;
+        // along x, quad in the (y, z) plane
+        if (j >= 0 && k >= 0 && inside != (field(i + 1, j, k) < 0.f)) {
+          quad(!inside, cellKey(i, j - 1, k - 1), cellKey(i, j, k - 1), cellKey(i, j, k), cellKey(i, j - 1, k));
+        }
+        if (i < 0)
+          continue;
+        // along y, quad in the (z, x) plane
+        if (k >= 0 && inside != (field(i, j + 1, k) < 0.f)) {
+          quad(!inside, cellKey(i - 1, j, k - 1), cellKey(i - 1, j, k), cellKey(i, j, k), cellKey(i, j, k - 1));
+        }
+        // along z, quad in the (x, y) plane
+        if (j >= 0 && inside != (field(i, j, k + 1) < 0.f)) {
+          quad(!inside, cellKey(i - 1, j - 1, k), cellKey(i, j - 1, k), cellKey(i, j, k), cellKey(i - 1, j, k));
+        }
+      }
+    }
+  }, 1);
+
+  size_t indicesCount = 0;
+  for (int s = 0; s < m; s++) {
+    indicesCount += slabIndices[s].size();
+  }
+  mesh.indices.clear();
+  mesh.indices.reserve(indicesCount);
+  for (int s = 0; s < m; s++) {
+    mesh.indices.insert(mesh.indices.end(), slabIndices[s].begin(), slabIndices[s].end());
+  }
+}
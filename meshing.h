@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Indexed triangle mesh, vertices as x, y, z, nx, ny, nz
+struct Mesh
+{
+  std::vector<float>    vertices;
+  std::vector<uint32_t> indices;
+
+  size_t verticesCount() const { return vertices.size() / 6; }
+  size_t trianglesCount() const { return indices.size() / 3; }
+  void clear() { vertices.clear(); indices.clear(); }
+};
+
+// Extracts the boundary of an nbVox^3 occupancy grid (Scene's _voxStorage
+// layout) as a surface net: the dual of the grid, one vertex per cell of
+// voxel centres the surface crosses and one quad per pair of neighbouring
+// voxels on either side of it.
+//
+// The scalar field sampled at voxel centres is -1/2 inside and +1/2 outside,
+// so vertices sit halfway between centres; a signed distance (negative
+// inside, in voxels) can be given to place them more precisely, its sign is
+// always taken from the occupancy.
+//
+// Work is split in x slabs. Cells are owned by their slab, which gives each
+// vertex its index up front, and cell -> vertex lookups from neighbouring
+// slabs go through a lock-free open addressing table.
+class SurfaceExtractor
+{
+public:
+  SurfaceExtractor(float originX, float originY, float originZ, float voxSize, int nbVox);
+
+  // optional nbVox^3 signed distance at voxel centres, must outlive extract()
+  void setDistanceField(const float* distance) { _distance = distance; }
+
+  void extract(const unsigned char* occupancy, Mesh& mesh) const;
+
+private:
+  float _origin[3];
+  float _voxSize;
+  int   _nbVox;
+  const float* _distance;
+};
@@ -0,0 +1,153 @@
+#include "normals.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "plyreader.h"
+#include "pointfilter.h"
+#include "spatialhash.h"
+#include "taskpool.h"
+
+const int JACOBI_SWEEPS = 8;
+
+// eigenvector of the smallest eigenvalue of the symmetric matrix c (xx, xy,
+// xz, yy, yz, zz), by Jacobi rotations
+static void leastSpread(const double* c, float* normal)
+{
+  double a[3][3] = { { c[0], c[1], c[2] }, { c[1], c[3], c[4] }, { c[2], c[4], c[5] } };
+  double v[3][3] = { { 1., 0., 0. }, { 0., 1., 0. }, { 0., 0., 1. } };
+  for (int sweep = 0; sweep < JACOBI_SWEEPS; sweep++) {
+    const double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+    if (off < 1e-20 * (a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2]))
+      break;
+    for (int p = 0; p < 2; p++) {
+      for (int q = p + 1; q < 3; q++) {
+        if (a[p][q] == 0.)
+          continue;
+        // rotation zeroing a[p][q]
+        const double theta = (a[q][q] - a[p][p]) / (2. * a[p][q]);
+        const double t = (theta >= 0. ? 1. : -1.) / (std::fabs(theta) + std::sqrt(theta * theta + 1.));
+        const double cs = 1. / std::sqrt(t * t + 1.), sn = t * cs;
+        for (int k = 0; k < 3; k++) {
+          const double akp = a[k][p], akq = a[k][q];
+          a[k][p] = cs * akp - sn * akq;
+          a[k][q] = sn * akp + cs * akq;
+        }
+        for (int k = 0; k < 3; k++) {
+          const double apk = a[p][k], aqk = a[q][k];
+          a[p][k] = cs * apk - sn * aqk;
+          a[q][k] = sn * apk + cs * aqk;
+        }
+        for (int k = 0; k < 3; k++) {
+          const double vkp = v[k][p], vkq = v[k][q];
+          v[k][p] = cs * vkp - sn * vkq;
+          v[k][q] = sn * vkp + cs * vkq;
+        }
+      }
+    }
+  }
+  int smallest = 0;
+  for (int k = 1; k < 3; k++) {
+    if (a[k][k] < a[smallest][smallest])
+      smallest = k;
+  }
+  normal[0] = float(v[0][smallest]);
+  normal[1] = float(v[1][smallest]);
+  normal[2] = float(v[2][smallest]);
+}
+
+NormalEstimator::NormalEstimator(int neighbours)
+  : _neighbours(std::min(std::max(neighbours, 3), MAX_NEIGHBOURS))
+{
+}
+
+void NormalEstimator::estimate(const float* points, size_t count, uint32_t* normals) const
+{
+  const uint32_t up = encodeOctahedral(0.f, 0.f, 1.f);
+  const int k = _neighbours;
+  if (count <= size_t(k)) {
+    std::fill(normals, normals + count, up);
+    return;
+  }
+
+  // cells holding about k points each, so a cell and its ring hold the
+  // neighbours of most points
+  float min[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+  for (size_t i = 0; i < count; i++) {
+    for (int axis = 0; axis < 3; axis++)
+      min[axis] = std::min(min[axis], points[i * POINT_STRIDE + axis]);
+  }
+  PointFilter filter((PointFilterOptions()));
+  const float cellSize = filter.spacingForBudget(points, count, std::max<size_t>(1, count / k));
+  if (!(cellSize > 0.f)) {
+    std::fill(normals, normals + count, up);
+    return;
+  }
+  SpatialHash hash;
+  hash.build(points, count, POINT_STRIDE, min, cellSize);
+
+  TaskPool::instance().parallelFor(0, hash.bucketsCount(), [&](size_t begin, size_t end) {
+    const SpatialHash::Entry* around[MAX_NEIGHBOURS];
+    float nearest[MAX_NEIGHBOURS];
+
+    hash.forEachCellInBuckets(begin, end, [&](const SpatialHash::Entry* first, const SpatialHash::Entry* last) {
+      int cell[3];
+      hash.cellOf(first->position, cell);
+
+      for (const SpatialHash::Entry *e = first; e < last; e++) {
+        const float *p = e->position;
+        int found = 0;
+        // k nearest in the cell and its ring, sorted by distance
+        for (int dx = -1; dx <= 1; dx++) {
+          for (int dy = -1; dy <= 1; dy++) {
+            for (int dz = -1; dz <= 1; dz++) {
+              hash.forEachInCell(cell[0] + dx, cell[1] + dy, cell[2] + dz, [&](const SpatialHash::Entry& neighbour) {
+                const float *q = neighbour.position;
+                const float ox = q[0] - p[0], oy = q[1] - p[1], oz = q[2] - p[2];
+                const float d = ox * ox + oy * oy + oz * oz;
+                if (found == k && d >= nearest[k - 1])
+                  return;
+                int slot = found < k ? found++ : k - 1;
+                while (slot > 0 && nearest[slot - 1] > d) {
+                  nearest[slot] = nearest[slot - 1];
+                  around[slot] = around[slot - 1];
+                  slot--;
+                }
+                nearest[slot] = d;
+                around[slot] = &neighbour;
+              });
+            }
+          }
+        }
+        if (found < 3) {
+          normals[e->point] = up;
+          continue;
+        }
+
+        // covariance around their mean
+        double mean[3] = { 0., 0., 0. };
+        for (int n = 0; n < found; n++) {
+          for (int axis = 0; axis < 3; axis++)
+            mean[axis] += around[n]->position[axis];
+        }
+        for (int axis = 0; axis < 3; axis++)
+          mean[axis] /= found;
+        double covariance[6] = { 0., 0., 0., 0., 0., 0. };
+        for (int n = 0; n < found; n++) {
+          const double ox = around[n]->position[0] - mean[0];
+          const double oy = around[n]->position[1] - mean[1];
+          const double oz = around[n]->position[2] - mean[2];
+          covariance[0] += ox * ox;
+          covariance[1] += ox * oy;
+          covariance[2] += ox * oz;
+          covariance[3] += oy * oy;
+          covariance[4] += oy * oz;
+          covariance[5] += oz * oz;
+        }
+        float normal[3];
+        leastSpread(covariance, normal);
+        normals[e->point] = encodeOctahedral(normal[0], normal[1], normal[2]);
+      }
+    });
+  });
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Unit normals packed in 32 bits: the octahedral projection of the normal,
+// two 16-bit snorm values with u in the low half, so the GPU reads them as a
+// normalized short pair. Under 0.05 degrees of error, a third of the bytes
+// of three floats.
+inline uint32_t encodeOctahedral(float x, float y, float z)
+{
+  const float l1 = std::fabs(x) + std::fabs(y) + std::fabs(z);
+  if (!(l1 > 0.f))
+    return 0; // decodes to +z
+  float u = x / l1, v = y / l1;
+  if (z < 0.f) {
+    // fold the lower half over the diagonals
+    const float fu = (1.f - std::fabs(v)) * (u >= 0.f ? 1.f : -1.f);
+    const float fv = (1.f - std::fabs(u)) * (v >= 0.f ? 1.f : -1.f);
+    u = fu;
+    v = fv;
+  }
+  const int16_t su = int16_t(std::lround(std::fmax(-1.f, std::fmin(1.f, u)) * 32767.f));
+  const int16_t sv = int16_t(std::lround(std::fmax(-1.f, std::fmin(1.f, v)) * 32767.f));
+  return uint32_t(uint16_t(su)) | uint32_t(uint16_t(sv)) << 16;
+}
+
+inline void decodeOctahedral(uint32_t packed, float* n)
+{
+  const float u = std::fmax(-1.f, int16_t(packed & 0xffff) / 32767.f);
+  const float v = std::fmax(-1.f, int16_t(packed >> 16) / 32767.f);
+  n[0] = u;
+  n[1] = v;
+  n[2] = 1.f - std::fabs(u) - std::fabs(v);
+  if (n[2] < 0.f) {
+    n[0] = (1.f - std::fabs(v)) * (u >= 0.f ? 1.f : -1.f);
+    n[1] = (1.f - std::fabs(u)) * (v >= 0.f ? 1.f : -1.f);
+  }
+  const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  n[0] /= length;
+  n[1] /= length;
+  n[2] /= length;
+}
+
+// Normals of a cloud that has none, from the plane fitted to each point's
+// nearest neighbours: the direction of least spread of their covariance.
+// Their sign is arbitrary, shading treats both sides alike. Points are binned
+// in a SpatialHash and cells processed in parallel on the task pool.
+class NormalEstimator
+{
+public:
+  static const int MAX_NEIGHBOURS = 64;
+
+  explicit NormalEstimator(int neighbours = 16);
+
+  // pack the normal of each of 'count' points, POINT_STRIDE floats each,
+  // into 'normals'; isolated points get +z
+  void estimate(const float* points, size_t count, uint32_t* normals) const;
+
+private:
+  int _neighbours;
+};
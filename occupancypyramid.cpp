@@ -0,0 +1,110 @@
+#include "occupancypyramid.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "taskpool.h"
+
+static_assert(OccupancyPyramid::BASE_VOXELS == sizeof(uint32_t), "a row of a cell is read as a word");
+
+void OccupancyPyramid::build(const unsigned char* occupancy, int nbVox)
+{
+  TaskPool& pool = TaskPool::instance();
+  int padded = BASE_VOXELS;
+  while (padded < nbVox)
+    padded *= 2;
+  _baseSize = padded / BASE_VOXELS;
+  _levels.clear();
+
+  // level 0 from the voxels, those past the grid are empty
+  const size_t n = size_t(nbVox), nn = n * n;
+  const size_t m = size_t(_baseSize);
+  _levels.emplace_back(m * m * m * 2);
+  unsigned char *base = _levels.back().data();
+  pool.parallelFor(0, m, [&](size_t begin, size_t end) {
+    std::vector<unsigned char> any(m), all(m);
+    for (size_t cx = begin; cx < end; cx++) {
+      for (size_t cy = 0; cy < m; cy++) {
+        // the cells of a row of cells, a row of voxels at a time
+        std::fill(any.begin(), any.end(), 0);
+        std::fill(all.begin(), all.end(), 1);
+        for (size_t x = cx * BASE_VOXELS; x < cx * BASE_VOXELS + BASE_VOXELS; x++) {
+          for (size_t y = cy * BASE_VOXELS; y < cy * BASE_VOXELS + BASE_VOXELS; y++) {
+            if (x >= n || y >= n) {
+              std::fill(all.begin(), all.end(), 0);
+              continue;
+            }
+            const unsigned char *row = occupancy + x * nn + y * n;
+            size_t cz = 0;
+            for (; (cz + 1) * BASE_VOXELS <= n; cz++) {
+              uint32_t word;
+              std::memcpy(&word, row + cz * BASE_VOXELS, sizeof(word));
+              // a zero byte sets its high bit in (word - 0x01010101) & ~word
+              any[cz] |= word != 0;
+              all[cz] &= ((word - 0x01010101u) & ~word & 0x80808080u) == 0;
+            }
+            for (; cz < m; cz++) {
+              for (size_t z = cz * BASE_VOXELS; z < n; z++) {
+                any[cz] |= row[z] != 0;
+              }
+              all[cz] = 0;
+            }
+          }
+        }
+        unsigned char *cell = base + (cx * m + cy) * m * 2;
+        for (size_t cz = 0; cz < m; cz++) {
+          cell[cz * 2] = any[cz] ? 255 : 0;
+          cell[cz * 2 + 1] = any[cz] && all[cz] ? 255 : 0;
+        }
+      }
+    }
+  }, 1);
+
+  // each next level from the one below
+  for (size_t size = m / 2; size > 0; size /= 2) {
+    const size_t below = size * 2;
+    _levels.emplace_back(size * size * size * 2);
+    const unsigned char *fine = _levels[_levels.size() - 2].data();
+    unsigned char *coarse = _levels.back().data();
+    pool.parallelFor(0, size, [&](size_t begin, size_t end) {
+      for (size_t cx = begin; cx < end; cx++) {
+        for (size_t cy = 0; cy < size; cy++) {
+          for (size_t cz = 0; cz < size; cz++) {
+            unsigned char any = 0, all = 255;
+            for (int child = 0; child < 8; child++) {
+              const size_t fx = cx * 2 + (child & 1), fy = cy * 2 + (child >> 1 & 1), fz = cz * 2 + (child >> 2);
+              const unsigned char *cell = fine + ((fx * below + fy) * below + fz) * 2;
+              any = std::max(any, cell[0]);
+              all = std::min(all, cell[1]);
+            }
+            unsigned char *cell = coarse + ((cx * size + cy) * size + cz) * 2;
+            cell[0] = any;
+            cell[1] = all;
+          }
+        }
+      }
+    }, 1);
+  }
+}
+
+size_t OccupancyPyramid::memorySize(int nbVox)
+{
+  size_t size = 1;
+  while (size * BASE_VOXELS < size_t(nbVox))
+    size *= 2;
+  size_t bytes = 0;
+  for (; size > 0; size /= 2) {
+    bytes += size * size * size * 2;
+  }
+  return bytes;
+}
+
+size_t OccupancyPyramid::memorySize() const
+{
+  size_t bytes = 0;
+  for (const std::vector<unsigned char>& level : _levels) {
+    bytes += level.capacity();
+  }
+  return bytes;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Coarser copies of an occupancy grid, laid out as Scene's _voxStorage, for
+// rays to step over empty space a whole cell at a time.
+//
+// Level 0 cells span BASE_VOXELS voxels on each side, each next level 2x2x2
+// cells of the one below, up to a single cell; the grid is padded with empty
+// voxels to a power of two so every level halves exactly, as the mip levels
+// of a texture do. A cell holds two bytes: 255 when any of its voxels is
+// occupied, then 255 when all of them are, 0 otherwise. Cells are stored
+// like the voxels, x slowest and z fastest.
+class OccupancyPyramid
+{
+public:
+  static const int BASE_VOXELS = 4;
+
+  void build(const unsigned char* occupancy, int nbVox);
+
+  int levelsCount() const { return int(_levels.size()); }
+  int levelSize(int level) const { return _baseSize >> level; } // cells per side
+  int cellVoxels(int level) const { return BASE_VOXELS << level; }
+  const unsigned char* level(int level) const { return _levels[level].data(); }
+  size_t memorySize() const;
+  // bytes build() allocates for a grid of nbVox^3 voxels
+  static size_t memorySize(int nbVox);
+
+private:
+  int _baseSize = 0;
+  std::vector<std::vector<unsigned char> > _levels;
+};
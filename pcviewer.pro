@@ -1,22 +1,68 @@
 HEADERS  = scene.h \
     viewer.h \
     mainwindow.h \
-    camera.h
+    camera.h \
+    camerastore.h \
+    clouddistance.h \
+    kdtree.h \
+    voxelizer.h \
+    plyreader.h \
+    plywriter.h \
+    silhouette.h \
+    visualhull.h \
+    hullvalidator.h \
+    freespace.h \
+    meshing.h \
+    normals.h \
+    occupancypyramid.h \
+    taskpool.h \
+    memorybudget.h \
+    spatialhash.h \
+    pointfilter.h \
+    pointstream.h \
+    pointring.h \
+    pointstore.h \
+    bufferarena.h \
+    workspace.h \
+    bench.h \
+    replay.h
 SOURCES  = scene.cpp \
     main.cpp \
     viewer.cpp \
     mainwindow.cpp \
-    camera.cpp
+    camera.cpp \
+    camerastore.cpp \
+    clouddistance.cpp \
+    kdtree.cpp \
+    voxelizer.cpp \
+    plyreader.cpp \
+    plywriter.cpp \
+    silhouette.cpp \
+    visualhull.cpp \
+    hullvalidator.cpp \
+    freespace.cpp \
+    meshing.cpp \
+    normals.cpp \
+    occupancypyramid.cpp \
+    taskpool.cpp \
+    memorybudget.cpp \
+    spatialhash.cpp \
+    pointfilter.cpp \
+    pointstream.cpp \
+    pointring.cpp \
+    pointstore.cpp \
+    bufferarena.cpp \
+    workspace.cpp \
+    bench.cpp \
+    replay.cpp
 
 QT += widgets
 
 CONFIG += c++11
 
-QMAKE_CXXFLAGS += -fopenmp
+QMAKE_CXXFLAGS += -pthread
 
-QMAKE_LFLAGS += -fopenmp
-
-LIBS += -fopenmp
+LIBS += -pthread
 
 RESOURCES += \
     resources.qrc
@@ -0,0 +1,336 @@
+#include "plyreader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include "normals.h"
+
+namespace {
+
+struct ScalarType
+{
+  const char* name;
+  const char* alias;
+  size_t      size;
+  double      colorScale; // maps integer colours into [0, 1]
+};
+
+const ScalarType SCALAR_TYPES[] = {
+  { "char",   "int8",    1, 1. / 127.        },
+  { "uchar",  "uint8",   1, 1. / 255.        },
+  { "short",  "int16",   2, 1. / 32767.      },
+  { "ushort", "uint16",  2, 1. / 65535.      },
+  { "int",    "int32",   4, 1. / 2147483647. },
+  { "uint",   "uint32",  4, 1. / 4294967295. },
+  { "float",  "float32", 4, 1.               },
+  { "double", "float64", 8, 1.               },
+};
+
+int scalarType(const std::string& name)
+{
+  for (size_t i = 0; i < sizeof(SCALAR_TYPES) / sizeof(SCALAR_TYPES[0]); ++i) {
+    if (name == SCALAR_TYPES[i].name || name == SCALAR_TYPES[i].alias)
+      return i;
+  }
+  throw std::runtime_error("unknown ply property type '" + name + "'");
+}
+
+int normalAxis(const std::string& name)
+{
+  if (name == "nx") return 0;
+  if (name == "ny") return 1;
+  if (name == "nz") return 2;
+  return -1;
+}
+
+int targetSlot(const std::string& name)
+{
+  if (name == "x") return 0;
+  if (name == "y") return 1;
+  if (name == "z") return 2;
+  if (name == "red"   || name == "diffuse_red")   return 4;
+  if (name == "green" || name == "diffuse_green") return 5;
+  if (name == "blue"  || name == "diffuse_blue")  return 6;
+  return -1;
+}
+
+template <typename T>
+double decode(const char* p, bool swap)
+{
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, p, sizeof(T));
+  if (swap)
+    std::reverse(bytes, bytes + sizeof(T));
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+double decodeScalar(int type, const char* p, bool swap)
+{
+  switch (type) {
+    case 0: return decode<int8_t>(p, swap);
+    case 1: return decode<uint8_t>(p, swap);
+    case 2: return decode<int16_t>(p, swap);
+    case 3: return decode<uint16_t>(p, swap);
+    case 4: return decode<int32_t>(p, swap);
+    case 5: return decode<uint32_t>(p, swap);
+    case 6: return decode<float>(p, swap);
+    default: return decode<double>(p, swap);
+  }
+}
+
+} // namespace
+
+
+PlyReader::PlyReader(const std::string& plyFilePath)
+  : _file(plyFilePath.c_str(), std::ios::in | std::ios::binary),
+    _is(_file),
+    _format(Ascii),
+    _recordSize(0),
+    _pointsCount(0),
+    _pointsRead(0),
+    _hasNormals(false)
+{
+  _readHeader();
+}
+
+PlyReader::PlyReader(std::istream& is)
+  : _is(is),
+    _format(Ascii),
+    _recordSize(0),
+    _pointsCount(0),
+    _pointsRead(0),
+    _hasNormals(false)
+{
+  _readHeader();
+}
+
+void PlyReader::_readHeader()
+{
+  // ensure format with magic header
+  std::string line;
+  std::getline(_is, line);
+  if (!line.empty() && line[line.size() - 1] == '\r') {
+    line.erase(line.size() - 1);
+  }
+  if (line != "ply") {
+    throw std::runtime_error("not a ply file");
+  }
+
+  // parse header, keeping the properties of 'element vertex' and the size of
+  // whatever precedes it
+  std::string element;
+  bool vertexSeen = false;
+  size_t skipRecords = 0, skipBytes = 0, elementCount = 0, elementSize = 0;
+  bool elementHasList = false;
+  while (_is.good()) {
+    std::getline(_is, line);
+    if (!line.empty() && line[line.size() - 1] == '\r') {
+      line.erase(line.size() - 1);
+    }
+    if (line == "end_header") {
+      break;
+    }
+
+    std::stringstream ss(line);
+    std::string tag1, tag2, tag3;
+    ss >> tag1 >> tag2 >> tag3;
+    if (tag1 == "format") {
+      if (tag2 == "ascii") {
+        _format = Ascii;
+      } else if (tag2 == "binary_little_endian") {
+        _format = BinaryLittleEndian;
+      } else if (tag2 == "binary_big_endian") {
+        _format = BinaryBigEndian;
+      } else {
+        throw std::runtime_error("unknown ply format '" + tag2 + "'");
+      }
+    } else if (tag1 == "element") {
+      // close the previous element if it comes before the vertices
+      if (!vertexSeen && !element.empty() && element != "vertex") {
+        if (elementHasList && _format != Ascii) {
+          throw std::runtime_error("unsupported ply: list element before vertices");
+        }
+        skipRecords += elementCount;
+        skipBytes += elementCount * elementSize;
+      }
+      if (element == "vertex") {
+        vertexSeen = true;
+      }
+      element = tag2;
+      elementCount = std::atof(tag3.c_str());
+      elementSize = 0;
+      elementHasList = false;
+      if (element == "vertex") {
+        _pointsCount = elementCount;
+      }
+    } else if (tag1 == "property") {
+      if (tag2 == "list") {
+        if (element == "vertex") {
+          throw std::runtime_error("unsupported ply: list property in vertices");
+        }
+        elementHasList = true;
+        continue;
+      }
+      const int type = scalarType(tag2);
+      if (element == "vertex") {
+        Property property;
+        property.type = type;
+        property.offset = _recordSize;
+        property.target = targetSlot(tag3);
+        property.normal = normalAxis(tag3);
+        _hasNormals |= property.normal >= 0;
+        _properties.push_back(property);
+        _recordSize += SCALAR_TYPES[type].size;
+      } else {
+        elementSize += SCALAR_TYPES[type].size;
+      }
+    }
+  }
+  if (line != "end_header") {
+    throw std::runtime_error("broken ply header");
+  }
+  // records are counted by their size, which must not be zero
+  int axes = 0;
+  for (const Property& property : _properties) {
+    axes |= property.target >= 0 && property.target < 3 ? 1 << property.target : 0;
+  }
+  if (_pointsCount > 0 && axes != 7) {
+    throw std::runtime_error("unsupported ply: vertices without x, y and z");
+  }
+
+  // move to the first vertex
+  if (_format == Ascii) {
+    for (size_t i = 0; i < skipRecords && _is.good(); ++i) {
+      std::getline(_is, line);
+    }
+  } else {
+    _is.ignore(skipBytes);
+  }
+  _dataStart = _is.tellg();
+}
+
+size_t PlyReader::read(float* dst, size_t maxPoints, uint32_t* normals)
+{
+  const size_t count = std::min(maxPoints, _pointsCount - _pointsRead);
+  if (count == 0)
+    return 0;
+
+  const size_t read = _format == Ascii ? _readAscii(dst, count, normals) : _readBinary(dst, count, normals);
+
+  // check if we've got exact number of points mentioned in header
+  if (read < count) {
+    throw std::runtime_error("broken ply file");
+  }
+  _pointsRead += read;
+  return read;
+}
+
+size_t PlyReader::readSome(float* dst, size_t maxPoints)
+{
+  if (maxPoints == 0)
+    return 0;
+
+  if (_format == Ascii) {
+    // lines carry no size: after the first, go on while more has arrived
+    size_t read = 0;
+    while (read < maxPoints && (read == 0 || _is.rdbuf()->in_avail() > 0)) {
+      if (_readAscii(dst + read * POINT_STRIDE, 1, nullptr) == 0)
+        break;
+      _pointsRead++;
+      read++;
+    }
+    return read;
+  }
+
+  // block for the first record only, then take whole records already buffered
+  _buffer.resize(_recordSize);
+  _is.read(_buffer.data(), _recordSize);
+  if (size_t(_is.gcount()) < _recordSize)
+    return 0;
+  const std::streamsize buffered = std::max<std::streamsize>(0, _is.rdbuf()->in_avail());
+  const size_t more = std::min(maxPoints - 1, size_t(buffered) / _recordSize);
+  _buffer.resize((1 + more) * _recordSize);
+  _is.read(_buffer.data() + _recordSize, more * _recordSize);
+
+  _decodeBinary(_buffer.data(), 1 + more, dst, nullptr);
+  _pointsRead += 1 + more;
+  return 1 + more;
+}
+
+void PlyReader::rewind()
+{
+  _is.clear();
+  _is.seekg(_dataStart);
+  _pointsRead = 0;
+}
+
+size_t PlyReader::_readAscii(float* dst, size_t maxPoints, uint32_t* normals)
+{
+  std::string line;
+  std::vector<double> values(_properties.size());
+  size_t i = 0;
+  for (; i < maxPoints && std::getline(_is, line); ++i) {
+    const char *s = line.c_str();
+    for (size_t j = 0; j < _properties.size(); ++j) {
+      char *end;
+      values[j] = std::strtod(s, &end);
+      s = end;
+    }
+
+    float *p = dst + i * POINT_STRIDE;
+    p[3] = _pointsRead + i;
+    p[4] = p[5] = p[6] = 1.f;
+    float n[3] = { 0.f, 0.f, 0.f };
+    for (size_t j = 0; j < _properties.size(); ++j) {
+      const Property& property = _properties[j];
+      if (property.target >= 4) {
+        p[property.target] = values[j] * SCALAR_TYPES[property.type].colorScale;
+      } else if (property.target >= 0) {
+        p[property.target] = values[j];
+      } else if (property.normal >= 0) {
+        n[property.normal] = values[j];
+      }
+    }
+    if (normals)
+      normals[i] = encodeOctahedral(n[0], n[1], n[2]);
+  }
+  return i;
+}
+
+size_t PlyReader::_readBinary(float* dst, size_t maxPoints, uint32_t* normals)
+{
+  _buffer.resize(maxPoints * _recordSize);
+  _is.read(_buffer.data(), _buffer.size());
+  const size_t count = _is.gcount() / _recordSize;
+  _decodeBinary(_buffer.data(), count, dst, normals);
+  return count;
+}
+
+void PlyReader::_decodeBinary(const char* records, size_t count, float* dst, uint32_t* normals) const
+{
+  const bool swap = _format == BinaryBigEndian;
+  for (size_t i = 0; i < count; ++i) {
+    const char *record = records + i * _recordSize;
+    float *p = dst + i * POINT_STRIDE;
+    p[3] = _pointsRead + i;
+    p[4] = p[5] = p[6] = 1.f;
+    float n[3] = { 0.f, 0.f, 0.f };
+    for (size_t j = 0; j < _properties.size(); ++j) {
+      const Property& property = _properties[j];
+      if (property.target >= 0) {
+        const double value = decodeScalar(property.type, record + property.offset, swap);
+        p[property.target] = property.target >= 4 ? value * SCALAR_TYPES[property.type].colorScale : value;
+      } else if (normals && property.normal >= 0) {
+        n[property.normal] = decodeScalar(property.type, record + property.offset, swap);
+      }
+    }
+    if (normals)
+      normals[i] = encodeOctahedral(n[0], n[1], n[2]);
+  }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+const size_t POINT_STRIDE = 7; // x, y, z, index, r, g, b
+
+// Reads the 'element vertex' section of an ascii or binary PLY file in
+// batches, converting every record to the layout Scene uploads:
+// x, y, z, row index, and r, g, b scaled into [0, 1]. Normals, when the
+// file has nx, ny, nz, come out separately packed by encodeOctahedral().
+//
+// Only the header and the current batch are ever held in memory, so callers
+// decide whether to keep the points or fold them into something smaller.
+//
+// A reader may also wrap a stream that is not a file, such as a pipe or a
+// socket: points then keep coming until the stream ends, whatever count the
+// header announces, and readSome() returns them as they arrive.
+class PlyReader
+{
+public:
+  // opens the file and parses its header, throws std::runtime_error
+  explicit PlyReader(const std::string& plyFilePath);
+
+  // parses the header from an open stream, which must outlive the reader;
+  // rewind() is not available
+  explicit PlyReader(std::istream& is);
+
+  size_t pointsCount() const { return _pointsCount; }
+  size_t pointsRead() const { return _pointsRead; }
+  bool hasNormals() const { return _hasNormals; }
+
+  // decode up to maxPoints records into dst (POINT_STRIDE floats each), and
+  // their packed normals into 'normals' unless null; returns the number
+  // read, 0 once the vertex section is exhausted
+  size_t read(float* dst, size_t maxPoints, uint32_t* normals = nullptr);
+
+  // stream readers: wait for one record, then decode those already
+  // received, up to maxPoints; returns 0 once the stream has ended
+  size_t readSome(float* dst, size_t maxPoints);
+
+  // go back to the first point, e.g. for a second pass once bounds are known
+  void rewind();
+
+private:
+  enum Format { Ascii, BinaryLittleEndian, BinaryBigEndian };
+
+  struct Property
+  {
+    int    type;   // index into the PLY scalar types table
+    size_t offset; // byte offset inside a binary record
+    int    target; // slot in the output record, -1 if dropped
+    int    normal; // axis for nx, ny, nz, -1 otherwise
+  };
+
+  void _readHeader();
+  size_t _readAscii(float* dst, size_t maxPoints, uint32_t* normals);
+  size_t _readBinary(float* dst, size_t maxPoints, uint32_t* normals);
+  void _decodeBinary(const char* records, size_t count, float* dst, uint32_t* normals) const;
+
+  std::ifstream         _file;
+  std::istream&         _is;
+  std::streampos        _dataStart;
+  Format                _format;
+  std::vector<Property> _properties;
+  size_t                _recordSize;
+  size_t                _pointsCount;
+  size_t                _pointsRead;
+  bool                  _hasNormals;
+  std::vector<char>     _buffer;
+};
@@ -0,0 +1,245 @@
+#include "plywriter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include "plyreader.h"
+#include "taskpool.h"
+#include "voxelizer.h"
+
+// records encoded per chunk, a chunk of points is 15MB
+const size_t RECORDS_PER_CHUNK = 1 << 20;
+
+// space left for the vertex count patched in by close()
+const int COUNT_WIDTH = 20;
+
+const size_t POINT_RECORD_SIZE = 3 * sizeof(float) + 3;
+
+static inline unsigned char colorByte(float c)
+{
+  return static_cast<unsigned char>(std::min(std::max(c, 0.f), 1.f) * 255.f + .5f);
+}
+
+static inline char* encodePoint(char* dst, float x, float y, float z, float r, float g, float b)
+{
+  const float xyz[3] = { x, y, z };
+  std::memcpy(dst, xyz, sizeof(xyz));
+  dst[12] = colorByte(r);
+  dst[13] = colorByte(g);
+  dst[14] = colorByte(b);
+  return dst + POINT_RECORD_SIZE;
+}
+
+
+PlyWriter::PlyWriter(const std::string& plyFilePath)
+  : _path(plyFilePath),
+    _countOffset(-1),
+    _verticesCount(0),
+    _voxSize(0.f),
+    _nbVox(0)
+{
+  _origin[0] = _origin[1] = _origin[2] = 0.f;
+  _file = std::fopen(plyFilePath.c_str(), "wb");
+  if (!_file) {
+    throw std::runtime_error("cannot write " + plyFilePath);
+  }
+  // chunks are large already, a big stdio buffer only saves syscalls on headers
+  std::setvbuf(_file, nullptr, _IOFBF, 1 << 20);
+}
+
+PlyWriter::~PlyWriter()
+{
+  if (_file) {
+    std::fclose(_file);
+  }
+}
+
+void PlyWriter::setGrid(float originX, float originY, float originZ, float voxSize, int nbVox)
+{
+  _origin[0] = originX;
+  _origin[1] = originY;
+  _origin[2] = originZ;
+  _voxSize = voxSize;
+  _nbVox = nbVox;
+}
+
+void PlyWriter::_write(const char* data, size_t size)
+{
+  if (std::fwrite(data, 1, size, _file) != size) {
+    throw std::runtime_error("cannot write " + _path);
+  }
+}
+
+template <typename Encode>
+void PlyWriter::_writeChunks(size_t chunksCount, Encode encode)
+{
+  // two sets of buffers: one being encoded, one being written
+  TaskPool& pool = TaskPool::instance();
+  const size_t batch = pool.threadsCount();
+  std::vector<std::vector<char> > buffers[2];
+  buffers[0].resize(batch);
+  buffers[1].resize(batch);
+  std::unique_ptr<TaskGroup> writing;
+  int current = 0;
+
+  for (size_t first = 0; first < chunksCount; first += batch) {
+    std::vector<std::vector<char> >& encoded = buffers[current];
+    const size_t count = std::min(batch, chunksCount - first);
+
+    pool.parallelFor(0, count, [&](size_t c, size_t) {
+      encode(first + c, encoded[c]);
+    }, 1);
+
+    if (writing) {
+      writing->wait();
+    }
+    writing.reset(new TaskGroup);
+    writing->run([this, &encoded, count]() {
+      for (size_t c = 0; c < count; c++) {
+        _write(encoded[c].data(), encoded[c].size());
+      }
+    });
+    current ^= 1;
+  }
+  if (writing) {
+    writing->wait();
+  }
+}
+
+void PlyWriter::beginPoints()
+{
+  std::string header = "ply\nformat binary_little_endian 1.0\nelement vertex ";
+  _countOffset = header.size();
+  header += std::string(COUNT_WIDTH, ' ') + "\n";
+  header += "property float x\nproperty float y\nproperty float z\n";
+  header += "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+  header += "end_header\n";
+  _write(header.data(), header.size());
+}
+
+void PlyWriter::writePoints(const float* points, size_t count, const unsigned char* occupancy)
+{
+  const int n = _nbVox;
+  const float invVoxSize = _voxSize > 0.f ? 1.f / _voxSize : 0.f;
+  const size_t chunksCount = (count + RECORDS_PER_CHUNK - 1) / RECORDS_PER_CHUNK;
+  std::vector<size_t> written(chunksCount, 0);
+
+  _writeChunks(chunksCount, [&](size_t chunk, std::vector<char>& out) {
+    const size_t begin = chunk * RECORDS_PER_CHUNK;
+    const size_t end = std::min(count, begin + RECORDS_PER_CHUNK);
+    out.resize((end - begin) * POINT_RECORD_SIZE);
+    char *dst = out.data();
+    for (size_t i = begin; i < end; i++) {
+      const float *p = points + i * POINT_STRIDE;
+      if (occupancy) {
+        const int x = voxelCell(p[0], _origin[0], invVoxSize, n);
+        const int y = voxelCell(p[1], _origin[1], invVoxSize, n);
+        const int z = voxelCell(p[2], _origin[2], invVoxSize, n);
+        if (!occupancy[(size_t(x) * n + y) * n + z])
+          continue;
+      }
+      dst = encodePoint(dst, p[0], p[1], p[2], p[4], p[5], p[6]);
+    }
+    out.resize(dst - out.data());
+    written[chunk] = out.size() / POINT_RECORD_SIZE;
+  });
+
+  for (size_t c = 0; c < chunksCount; c++) {
+    _verticesCount += written[c];
+  }
+}
+
+void PlyWriter::writeVoxels(const unsigned char* occupancy, const Voxelizer* colors)
+{
+  const int n = _nbVox;
+  const size_t slabsCount = n;
+  std::vector<size_t> written(slabsCount, 0);
+
+  // one chunk per x slab of the grid
+  _writeChunks(slabsCount, [&](size_t i, std::vector<char>& out) {
+    out.resize(size_t(n) * n * POINT_RECORD_SIZE);
+    char *dst = out.data();
+    for (int j = 0; j < n; j++) {
+      for (int k = 0; k < n; k++) {
+        const size_t v = (i * n + j) * n + k;
+        if (!occupancy[v])
+          continue;
+        const float *c = colors ? colors->color(v) : nullptr;
+        dst = encodePoint(dst,
+                          _origin[0] + (i + .5f) * _voxSize,
+                          _origin[1] + (j + .5f) * _voxSize,
+                          _origin[2] + (k + .5f) * _voxSize,
+                          c ? c[0] : 1.f, c ? c[1] : 1.f, c ? c[2] : 1.f);
+      }
+    }
+    out.resize(dst - out.data());
+    written[i] = out.size() / POINT_RECORD_SIZE;
+  });
+
+  for (size_t s = 0; s < slabsCount; s++) {
+    _verticesCount += written[s];
+  }
+}
+
+void PlyWriter::writeMesh(const Mesh& mesh)
+{
+  const size_t verticesCount = mesh.verticesCount();
+  const size_t trianglesCount = mesh.trianglesCount();
+
+  std::string header = "ply\nformat binary_little_endian 1.0\n";
+  header += "element vertex " + std::to_string(verticesCount) + "\n";
+  header += "property float x\nproperty float y\nproperty float z\n";
+  header += "property float nx\nproperty float ny\nproperty float nz\n";
+  header += "element face " + std::to_string(trianglesCount) + "\n";
+  header += "property list uchar int vertex_indices\n";
+  header += "end_header\n";
+  _write(header.data(), header.size());
+
+  // vertices already are x, y, z, nx, ny, nz floats
+  const size_t vertexSize = 6 * sizeof(float);
+  _writeChunks((verticesCount + RECORDS_PER_CHUNK - 1) / RECORDS_PER_CHUNK, [&](size_t chunk, std::vector<char>& out) {
+    const size_t begin = chunk * RECORDS_PER_CHUNK;
+    const size_t end = std::min(verticesCount, begin + RECORDS_PER_CHUNK);
+    out.resize((end - begin) * vertexSize);
+    std::memcpy(out.data(), mesh.vertices.data() + begin * 6, out.size());
+  });
+
+  const size_t faceSize = 1 + 3 * sizeof(int32_t);
+  _writeChunks((trianglesCount + RECORDS_PER_CHUNK - 1) / RECORDS_PER_CHUNK, [&](size_t chunk, std::vector<char>& out) {
+    const size_t begin = chunk * RECORDS_PER_CHUNK;
+    const size_t end = std::min(trianglesCount, begin + RECORDS_PER_CHUNK);
+    out.resize((end - begin) * faceSize);
+    char *dst = out.data();
+    for (size_t t = begin; t < end; t++) {
+      const int32_t face[3] = {
+        int32_t(mesh.indices[t * 3]), int32_t(mesh.indices[t * 3 + 1]), int32_t(mesh.indices[t * 3 + 2])
+      };
+      *dst++ = 3;
+      std::memcpy(dst, face, sizeof(face));
+      dst += sizeof(face);
+    }
+  });
+  _verticesCount = verticesCount;
+}
+
+void PlyWriter::close()
+{
+  if (!_file)
+    return;
+
+  if (_countOffset >= 0) {
+    const std::string count = std::to_string(_verticesCount);
+    if (std::fseek(_file, _countOffset, SEEK_SET) != 0) {
+      throw std::runtime_error("cannot write " + _path);
+    }
+    _write(count.data(), count.size());
+  }
+
+  const bool failed = std::fclose(_file) != 0;
+  _file = nullptr;
+  if (failed) {
+    throw std::runtime_error("cannot write " + _path);
+  }
+}
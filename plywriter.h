@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "meshing.h"
+
+class Voxelizer;
+
+// Writes binary little-endian PLY files.
+//
+// Records are encoded in parallel into large chunks; a batch of chunks is
+// written in order by a background task while the next batch is encoded,
+// so exports run at disk speed rather than encoding speed. Points and voxel
+// centres are written as x, y, z floats and red, green, blue uchars.
+class PlyWriter
+{
+public:
+  // opens the file for writing, throws std::runtime_error
+  explicit PlyWriter(const std::string& plyFilePath);
+  ~PlyWriter();
+
+  // grid used to filter points and place voxel centres, as Scene's _voxStorage
+  void setGrid(float originX, float originY, float originZ, float voxSize, int nbVox);
+
+  // start a points file; its vertex count is filled in by close(), so points
+  // may be appended batch by batch
+  void beginPoints();
+
+  // append points in Scene layout (POINT_STRIDE floats each); when
+  // 'occupancy' is given, only points falling in an occupied voxel are kept
+  void writePoints(const float* points, size_t count, const unsigned char* occupancy = nullptr);
+
+  // append the centres of occupied voxels, coloured with the mean colours of
+  // 'colors' when given, white otherwise and where no point fell
+  void writeVoxels(const unsigned char* occupancy, const Voxelizer* colors = nullptr);
+
+  // write a whole mesh file: vertices with normals, triangles as faces
+  void writeMesh(const Mesh& mesh);
+
+  // patch the vertex count and flush, throws std::runtime_error on failure
+  void close();
+
+  size_t verticesCount() const { return _verticesCount; }
+
+private:
+  template <typename Encode>
+  void _writeChunks(size_t chunksCount, Encode encode);
+  void _write(const char* data, size_t size);
+
+  FILE*  _file;
+  std::string _path;
+  long   _countOffset;   // where the patchable vertex count lives, -1 if none
+  size_t _verticesCount;
+  float  _origin[3];
+  float  _voxSize;
+  int    _nbVox;
+};
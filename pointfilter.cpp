@@ -0,0 +1,375 @@
+#include "pointfilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "plyreader.h"
+#include "spatialhash.h"
+#include "taskpool.h"
+
+// rings of cells searched around a point for its nearest neighbours
+const int MAX_RINGS = 3;
+
+const int MAX_NEIGHBOURS = 64;
+
+template <typename F>
+void PointFilter::_forEachInRing(const SpatialHash& hash, const int* cell, int ring, F f)
+{
+  for (int dx = -ring; dx <= ring; dx++) {
+    for (int dy = -ring; dy <= ring; dy++) {
+      // only the cells on the ring's surface
+      const bool side = std::abs(dx) == ring || std::abs(dy) == ring;
+      for (int dz = -ring; dz <= ring; dz += side || ring == 0 ? 1 : 2 * ring) {
+        hash.forEachInCell(cell[0] + dx, cell[1] + dy, cell[2] + dz, f);
+      }
+    }
+  }
+}
+
+// entries of a cell and of the ring of cells touching it
+struct PointFilter::Neighbourhood
+{
+  const SpatialHash::Entry* first[27];
+  const SpatialHash::Entry* last[27];
+  int cellsCount;
+
+  void gather(const SpatialHash& hash, const int* cell)
+  {
+    cellsCount = 0;
+    for (int dx = -1; dx <= 1; dx++) {
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dz = -1; dz <= 1; dz++) {
+          hash.cellEntries(cell[0] + dx, cell[1] + dy, cell[2] + dz, first[cellsCount], last[cellsCount]);
+          cellsCount += first[cellsCount] != last[cellsCount];
+        }
+      }
+    }
+  }
+};
+
+PointFilter::PointFilter(const PointFilterOptions& options)
+  : _options(options),
+    _normals(nullptr)
+{
+}
+
+size_t PointFilter::apply(float* points, size_t count)
+{
+  float spacing = _options.spacing;
+  if (_options.pointBudget > 0) {
+    spacing = std::max(spacing, spacingForBudget(points, count, _options.pointBudget));
+  }
+  if (spacing > 0.f) {
+    count = downsample(points, count, spacing);
+  }
+
+  if (_options.outliers == PointFilterOptions::StatisticalOutliers) {
+    count = removeStatisticalOutliers(points, count, _options.neighbours, _options.stdRatio);
+  } else if (_options.outliers == PointFilterOptions::RadiusOutliers && _options.radius > 0.f) {
+    count = removeRadiusOutliers(points, count, _options.radius, _options.neighbours);
+  }
+  return count;
+}
+
+void PointFilter::_bounds(const float* points, size_t count, float* min, float* max) const
+{
+  TaskPool& pool = TaskPool::instance();
+  const size_t rangesCount = pool.threadsCount();
+  std::vector<float> ranges(rangesCount * 6);
+
+  pool.parallelFor(0, rangesCount, [&](size_t r, size_t) {
+    float *bounds = &ranges[r * 6];
+    for (int axis = 0; axis < 3; axis++) {
+      bounds[axis] = std::numeric_limits<float>::max();
+      bounds[3 + axis] = std::numeric_limits<float>::lowest();
+    }
+    for (size_t i = count * r / rangesCount; i < count * (r + 1) / rangesCount; i++) {
+      const float *p = points + i * POINT_STRIDE;
+      for (int axis = 0; axis < 3; axis++) {
+        bounds[axis] = std::min(bounds[axis], p[axis]);
+        bounds[3 + axis] = std::max(bounds[3 + axis], p[axis]);
+      }
+    }
+  }, 1);
+
+  for (int axis = 0; axis < 3; axis++) {
+    min[axis] = std::numeric_limits<float>::max();
+    max[axis] = std::numeric_limits<float>::lowest();
+    for (size_t r = 0; r < rangesCount; r++) {
+      min[axis] = std::min(min[axis], ranges[r * 6 + axis]);
+      max[axis] = std::max(max[axis], ranges[r * 6 + 3 + axis]);
+    }
+  }
+}
+
+float PointFilter::_spacingForCells(const float* points, size_t count, size_t cellsCount)
+{
+  float min[3], max[3];
+  _bounds(points, count, min, max);
+  const float extent = std::max(std::max(max[0] - min[0], max[1] - min[1]), max[2] - min[2]);
+  if (!(extent > 0.f) || cellsCount == 0)
+    return 0.f;
+
+  // start as if points filled the bounds, then correct as if they lay on a
+  // surface (cells ~ 1 / spacing^2), bisecting once the target is bracketed
+  float spacing = extent / std::cbrt(float(cellsCount));
+  float tooSmall = 0.f, fits = 0.f;
+  SpatialHash hash;
+  for (int iteration = 0; iteration < 16; iteration++) {
+    hash.build(points, count, POINT_STRIDE, min, spacing);
+    const size_t cells = hash.cellsCount();
+    if (cells <= cellsCount) {
+      fits = spacing;
+      if (cells * 10 >= cellsCount * 9)
+        break;
+    } else {
+      tooSmall = spacing;
+    }
+
+    const float factor = std::sqrt(float(cells) / cellsCount);
+    float next = spacing * std::min(std::max(factor, .5f), 2.f);
+    if (fits > 0.f && tooSmall > 0.f && (next <= tooSmall || next >= fits)) {
+      next = std::sqrt(tooSmall * fits);
+    }
+    spacing = next;
+  }
+  return fits > 0.f ? fits : spacing;
+}
+
+float PointFilter::spacingForBudget(const float* points, size_t count, size_t budget)
+{
+  if (count <= budget)
+    return 0.f;
+  return _spacingForCells(points, count, budget);
+}
+
+size_t PointFilter::downsample(float* points, size_t count, float spacing)
+{
+  if (count == 0 || !(spacing > 0.f))
+    return count;
+
+  float min[3], max[3];
+  _bounds(points, count, min, max);
+  SpatialHash hash;
+  hash.build(points, count, POINT_STRIDE, min, spacing);
+
+  std::vector<unsigned char> keep(count, 0);
+  hash.forEachCell([&](const SpatialHash::Entry* first, const SpatialHash::Entry* last) {
+    double centroid[3] = { 0., 0., 0. };
+    for (const SpatialHash::Entry *e = first; e < last; e++) {
+      centroid[0] += e->position[0];
+      centroid[1] += e->position[1];
+      centroid[2] += e->position[2];
+    }
+    for (int axis = 0; axis < 3; axis++) {
+      centroid[axis] /= last - first;
+    }
+
+    uint32_t closest = first->point;
+    double closestDistance = std::numeric_limits<double>::max();
+    for (const SpatialHash::Entry *e = first; e < last; e++) {
+      const double dx = e->position[0] - centroid[0];
+      const double dy = e->position[1] - centroid[1];
+      const double dz = e->position[2] - centroid[2];
+      const double d = dx * dx + dy * dy + dz * dz;
+      if (d < closestDistance) {
+        closestDistance = d;
+        closest = e->point;
+      }
+    }
+    keep[closest] = 1;
+  });
+
+  return _compact(points, count, keep);
+}
+
+size_t PointFilter::removeStatisticalOutliers(float* points, size_t count, int neighbours, float stdRatio)
+{
+  const int k = std::min(std::max(neighbours, 1), MAX_NEIGHBOURS);
+  if (count <= size_t(k))
+    return count;
+
+  // cells holding about k points each, so a few rings find the neighbours
+  const float cellSize = _spacingForCells(points, count, std::max<size_t>(1, count / k));
+  if (!(cellSize > 0.f))
+    return count;
+  float min[3], max[3];
+  _bounds(points, count, min, max);
+  SpatialHash hash;
+  hash.build(points, count, POINT_STRIDE, min, cellSize);
+
+  // mean distance to the k nearest neighbours, infinite when they are
+  // further than the rings searched. Neighbours are gathered once per cell
+  // from the ring around it, which settles most of its points; the others
+  // search further rings on their own.
+  TaskPool& pool = TaskPool::instance();
+  std::vector<float> meanDistance(count);
+  pool.parallelFor(0, hash.bucketsCount(), [&](size_t begin, size_t end) {
+    Neighbourhood around;
+    float nearest[MAX_NEIGHBOURS];
+
+    hash.forEachCellInBuckets(begin, end, [&](const SpatialHash::Entry* first, const SpatialHash::Entry* last) {
+      int cell[3];
+      hash.cellOf(first->position, cell);
+      around.gather(hash, cell);
+
+      for (const SpatialHash::Entry *e = first; e < last; e++) {
+        const float *p = e->position;
+        int found = 0;
+        auto visit = [&](const SpatialHash::Entry& neighbour) {
+          const float *q = neighbour.position;
+          const float dx = q[0] - p[0], dy = q[1] - p[1], dz = q[2] - p[2];
+          const float d = dx * dx + dy * dy + dz * dz;
+          if (found == k && d >= nearest[k - 1])
+            return;
+          // insertion into the sorted list of the nearest ones
+          int slot = found < k ? found++ : k - 1;
+          while (slot > 0 && nearest[slot - 1] > d) {
+            nearest[slot] = nearest[slot - 1];
+            slot--;
+          }
+          nearest[slot] = d;
+        };
+
+        for (int c = 0; c < around.cellsCount; c++) {
+          for (const SpatialHash::Entry *neighbour = around.first[c]; neighbour < around.last[c]; neighbour++) {
+            if (neighbour != e) {
+              visit(*neighbour);
+            }
+          }
+        }
+        // points outside the rings searched so far are at least ring - 1 cells away
+        for (int ring = 2; ring <= MAX_RINGS; ring++) {
+          const float reach = (ring - 1) * cellSize;
+          if (found == k && nearest[k - 1] <= reach * reach)
+            break;
+          _forEachInRing(hash, cell, ring, visit);
+        }
+
+        if (found < k) {
+          meanDistance[e->point] = std::numeric_limits<float>::infinity();
+          continue;
+        }
+        float sum = 0.f;
+        for (int n = 0; n < k; n++) {
+          sum += std::sqrt(nearest[n]);
+        }
+        meanDistance[e->point] = sum / k;
+      }
+    });
+  });
+
+  const size_t rangesCount = pool.threadsCount();
+  std::vector<double> sums(rangesCount * 3, 0.);
+  pool.parallelFor(0, rangesCount, [&](size_t r, size_t) {
+    double *sum = &sums[r * 3];
+    for (size_t i = count * r / rangesCount; i < count * (r + 1) / rangesCount; i++) {
+      if (std::isinf(meanDistance[i]))
+        continue;
+      sum[0] += 1.;
+      sum[1] += meanDistance[i];
+      sum[2] += double(meanDistance[i]) * meanDistance[i];
+    }
+  }, 1);
+  double n = 0., sum = 0., sumSquares = 0.;
+  for (size_t r = 0; r < rangesCount; r++) {
+    n += sums[r * 3];
+    sum += sums[r * 3 + 1];
+    sumSquares += sums[r * 3 + 2];
+  }
+  if (n == 0.)
+    return count;
+  const double mean = sum / n;
+  const double deviation = std::sqrt(std::max(0., sumSquares / n - mean * mean));
+  const float cutoff = float(mean + stdRatio * deviation);
+
+  std::vector<unsigned char> keep(count);
+  pool.parallelFor(0, count, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      keep[i] = meanDistance[i] <= cutoff;
+    }
+  });
+  return _compact(points, count, keep);
+}
+
+size_t PointFilter::removeRadiusOutliers(float* points, size_t count, float radius, int neighbours)
+{
+  if (count == 0 || !(radius > 0.f))
+    return count;
+
+  float min[3], max[3];
+  _bounds(points, count, min, max);
+  SpatialHash hash;
+  hash.build(points, count, POINT_STRIDE, min, radius);
+
+  const float radiusSquared = radius * radius;
+  std::vector<unsigned char> keep(count);
+  TaskPool::instance().parallelFor(0, hash.bucketsCount(), [&](size_t begin, size_t end) {
+    Neighbourhood around;
+
+    hash.forEachCellInBuckets(begin, end, [&](const SpatialHash::Entry* first, const SpatialHash::Entry* last) {
+      int cell[3];
+      hash.cellOf(first->position, cell);
+      around.gather(hash, cell);
+
+      // dense areas settle after a few neighbours
+      for (const SpatialHash::Entry *e = first; e < last; e++) {
+        const float *p = e->position;
+        int found = 0;
+        for (int c = 0; c < around.cellsCount && found < neighbours; c++) {
+          for (const SpatialHash::Entry *neighbour = around.first[c]; neighbour < around.last[c] && found < neighbours; neighbour++) {
+            const float *q = neighbour->position;
+            const float dx = q[0] - p[0], dy = q[1] - p[1], dz = q[2] - p[2];
+            found += neighbour != e && dx * dx + dy * dy + dz * dz <= radiusSquared;
+          }
+        }
+        keep[e->point] = found >= neighbours;
+      }
+    });
+  });
+  return _compact(points, count, keep);
+}
+
+size_t PointFilter::_compact(float* points, size_t count, const std::vector<unsigned char>& keep) const
+{
+  TaskPool& pool = TaskPool::instance();
+  const size_t rangesCount = pool.threadsCount() * 4;
+  std::vector<size_t> offsets(rangesCount + 1, 0);
+
+  pool.parallelFor(0, rangesCount, [&](size_t r, size_t) {
+    size_t kept = 0;
+    for (size_t i = count * r / rangesCount; i < count * (r + 1) / rangesCount; i++) {
+      kept += keep[i];
+    }
+    offsets[r + 1] = kept;
+  }, 1);
+  for (size_t r = 0; r < rangesCount; r++) {
+    offsets[r + 1] += offsets[r];
+  }
+
+  // kept points go through a copy, ranges would overwrite each other in place
+  const size_t keptCount = offsets[rangesCount];
+  std::vector<float> kept(keptCount * POINT_STRIDE);
+  std::vector<uint32_t> keptNormals(_normals ? keptCount : 0);
+  pool.parallelFor(0, rangesCount, [&](size_t r, size_t) {
+    float *dst = kept.data() + offsets[r] * POINT_STRIDE;
+    uint32_t *normal = _normals ? keptNormals.data() + offsets[r] : nullptr;
+    for (size_t i = count * r / rangesCount; i < count * (r + 1) / rangesCount; i++) {
+      if (keep[i]) {
+        std::memcpy(dst, points + i * POINT_STRIDE, POINT_STRIDE * sizeof(float));
+        dst += POINT_STRIDE;
+        if (normal)
+          *normal++ = _normals[i];
+      }
+    }
+  }, 1);
+  pool.parallelFor(0, keptCount, [&](size_t begin, size_t end) {
+    std::memcpy(points + begin * POINT_STRIDE, kept.data() + begin * POINT_STRIDE,
+                (end - begin) * POINT_STRIDE * sizeof(float));
+    if (_normals)
+      std::copy(keptNormals.begin() + begin, keptNormals.begin() + end, _normals + begin);
+  });
+  return keptCount;
+}
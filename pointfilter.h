@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "spatialhash.h"
+
+// Preprocessing applied to loaded points before they are uploaded.
+struct PointFilterOptions
+{
+  enum Outliers { NoOutliers, StatisticalOutliers, RadiusOutliers };
+
+  float    spacing = 0.f;      // voxel-grid downsampling cell side, 0 for none
+  size_t   pointBudget = 0;    // pick the spacing to keep at most this many points
+  Outliers outliers = NoOutliers;
+  int      neighbours = 8;     // statistical: k nearest, radius: fewest neighbours kept
+  float    stdRatio = 1.f;     // statistical: cut at mean + stdRatio * deviation
+  float    radius = 0.f;       // radius: neighbourhood radius
+
+  bool isEmpty() const { return spacing <= 0.f && pointBudget == 0 && outliers == NoOutliers; }
+};
+
+// Reduces a cloud in Scene layout (POINT_STRIDE floats per point) in place.
+//
+// Downsampling keeps, for each occupied cell of a grid of the given spacing,
+// the source point closest to the cell's centroid. Statistical outlier
+// removal drops points whose mean distance to their k nearest neighbours is
+// above the cloud's mean by more than stdRatio deviations; radius outlier
+// removal drops points with too few neighbours within the radius.
+//
+// Only whole source points are kept, so their row index (the fourth float)
+// still points into the source file. Kept points move to the front of the
+// array in their original order. Every stage runs on the task pool, with a
+// SpatialHash for neighbourhoods.
+class PointFilter
+{
+public:
+  explicit PointFilter(const PointFilterOptions& options);
+
+  // packed normals of the points, one each, moved along with them; null for none
+  void setNormals(uint32_t* normals) { _normals = normals; }
+
+  // downsample, then remove outliers; returns how many points are kept
+  size_t apply(float* points, size_t count);
+
+  size_t downsample(float* points, size_t count, float spacing);
+  size_t removeStatisticalOutliers(float* points, size_t count, int neighbours, float stdRatio);
+  size_t removeRadiusOutliers(float* points, size_t count, float radius, int neighbours);
+
+  // smallest tried spacing keeping at most 'budget' points, 0 if all fit
+  float spacingForBudget(const float* points, size_t count, size_t budget);
+
+private:
+  void _bounds(const float* points, size_t count, float* min, float* max) const;
+  float _spacingForCells(const float* points, size_t count, size_t cellsCount);
+  struct Neighbourhood;
+
+  template <typename F>
+  static void _forEachInRing(const SpatialHash& hash, const int* cell, int ring, F f);
+  size_t _compact(float* points, size_t count, const std::vector<unsigned char>& keep) const;
+
+  PointFilterOptions _options;
+  uint32_t *_normals;
+};
@@ -0,0 +1,120 @@
+#include "pointring.h"
+
+#include <QOpenGLContext>
+#include <cstring>
+
+#include "plyreader.h"
+
+// buffer storage and sync enums, not in every GL header Qt ships with
+const GLbitfield RING_MAP_WRITE       = 0x0002;
+const GLbitfield RING_MAP_PERSISTENT  = 0x0040;
+const GLbitfield RING_MAP_COHERENT    = 0x0080;
+const GLbitfield RING_DYNAMIC_STORAGE = 0x0100;
+const GLenum     RING_SYNC_GPU_COMMANDS_COMPLETE = 0x9117;
+const GLbitfield RING_SYNC_FLUSH_COMMANDS = 0x0001;
+const quint64    RING_FENCE_TIMEOUT = 1000000000; // ns, a frame is long gone by then
+
+PointRing::PointRing()
+  : _mapped(nullptr),
+    _fence(nullptr),
+    _capacity(0),
+    _written(0),
+    _fenceSync(nullptr),
+    _clientWaitSync(nullptr),
+    _deleteSync(nullptr)
+{
+}
+
+void PointRing::create(size_t capacity)
+{
+  initializeOpenGLFunctions();
+  _capacity = std::max<size_t>(1, capacity);
+  _written = 0;
+
+  _buffer.create();
+  _buffer.bind();
+  const GLsizeiptr bytes = _capacity * POINT_STRIDE * sizeof(GLfloat);
+
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  const QPair<int, int> version = context->format().version();
+  const bool hasStorage = !context->isOpenGLES()
+      && (version >= qMakePair(4, 4) || context->hasExtension("GL_ARB_buffer_storage"));
+  const bool hasSync = !context->isOpenGLES()
+      && (version >= qMakePair(3, 2) || context->hasExtension("GL_ARB_sync"));
+  if (hasStorage && hasSync) {
+    const BufferStorage bufferStorage = reinterpret_cast<BufferStorage>(context->getProcAddress("glBufferStorage"));
+    const MapBufferRange mapBufferRange = reinterpret_cast<MapBufferRange>(context->getProcAddress("glMapBufferRange"));
+    _fenceSync = reinterpret_cast<FenceSync>(context->getProcAddress("glFenceSync"));
+    _clientWaitSync = reinterpret_cast<ClientWaitSync>(context->getProcAddress("glClientWaitSync"));
+    _deleteSync = reinterpret_cast<DeleteSync>(context->getProcAddress("glDeleteSync"));
+    if (bufferStorage && mapBufferRange && _fenceSync && _clientWaitSync && _deleteSync) {
+      // dynamic storage keeps glBufferSubData usable should mapping fail
+      const GLbitfield access = RING_MAP_WRITE | RING_MAP_PERSISTENT | RING_MAP_COHERENT;
+      bufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, access | RING_DYNAMIC_STORAGE);
+      _mapped = static_cast<float*>(mapBufferRange(GL_ARRAY_BUFFER, 0, bytes, access));
+      return;
+    }
+  }
+  glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+}
+
+void PointRing::destroy()
+{
+  // deleting the buffer unmaps it
+  if (_fence)
+    _deleteSync(_fence);
+  _fence = nullptr;
+  _mapped = nullptr;
+  _buffer.destroy();
+}
+
+void PointRing::append(const float* points, size_t count, float* mirror)
+{
+  if (count > _capacity) {
+    // older points would be overwritten by this very batch
+    points += (count - _capacity) * POINT_STRIDE;
+    _written += count - _capacity;
+    count = _capacity;
+  }
+  if (count == 0)
+    return;
+
+  if (_fence) {
+    _clientWaitSync(_fence, RING_SYNC_FLUSH_COMMANDS, RING_FENCE_TIMEOUT);
+    _deleteSync(_fence);
+    _fence = nullptr;
+  }
+
+  const size_t first = _written % _capacity;
+  const size_t tail = std::min(count, _capacity - first);
+  if (!_mapped)
+    _buffer.bind();
+  _write(first, points, tail, mirror);
+  _write(0, points + tail * POINT_STRIDE, count - tail, mirror);
+  if (!_mapped)
+    _buffer.release();
+  _written += count;
+}
+
+void PointRing::fence()
+{
+  if (!_mapped)
+    return;
+  if (_fence)
+    _deleteSync(_fence);
+  _fence = _fenceSync(RING_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void PointRing::_write(size_t first, const float* points, size_t count, float* mirror)
+{
+  if (count == 0)
+    return;
+  const size_t floats = count * POINT_STRIDE;
+  if (_mapped) {
+    std::memcpy(_mapped + first * POINT_STRIDE, points, floats * sizeof(float));
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER, first * POINT_STRIDE * sizeof(GLfloat), floats * sizeof(GLfloat), points);
+  }
+  if (mirror)
+    std::memcpy(mirror + first * POINT_STRIDE, points, floats * sizeof(float));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <algorithm>
+#include <cstddef>
+
+// Fixed-capacity vertex buffer of points in Scene layout (POINT_STRIDE
+// floats each) that live points are appended to, the newest overwriting
+// the oldest once it is full.
+//
+// Where the context has buffer storage (GL 4.4 or ARB_buffer_storage) the
+// buffer is mapped once, persistently and coherently, so appending is a
+// plain copy; the fence set after drawing keeps it from overwriting points
+// the GPU still reads. Other contexts fall back to glBufferSubData. Points
+// are drawn in any order, so the filled part is always one range from 0.
+class PointRing : protected QOpenGLFunctions
+{
+public:
+  PointRing();
+
+  // allocate with the context current; the buffer is left bound so vertex
+  // attributes can be pointed at it
+  void create(size_t capacity);
+  void destroy();
+
+  void bind() { _buffer.bind(); }
+  void release() { _buffer.release(); }
+
+  // append points, of which only the last capacity() survive; 'mirror',
+  // when given, holds capacity() points and receives the same writes
+  void append(const float* points, size_t count, float* mirror = nullptr);
+
+  // once the draw calls reading the buffer are issued
+  void fence();
+
+  size_t capacity() const { return _capacity; }
+  size_t size() const { return std::min(_written, _capacity); } // points to draw
+  size_t written() const { return _written; }
+  bool isPersistent() const { return _mapped != nullptr; }
+
+private:
+  typedef void  (QOPENGLF_APIENTRYP BufferStorage)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+  typedef void* (QOPENGLF_APIENTRYP MapBufferRange)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+  typedef void* (QOPENGLF_APIENTRYP FenceSync)(GLenum condition, GLbitfield flags);
+  typedef GLenum (QOPENGLF_APIENTRYP ClientWaitSync)(void* sync, GLbitfield flags, quint64 timeout);
+  typedef void  (QOPENGLF_APIENTRYP DeleteSync)(void* sync);
+
+  void _write(size_t first, const float* points, size_t count, float* mirror);
+
+  QOpenGLBuffer  _buffer;
+  float          *_mapped; // persistent mapping, null on the fallback path
+  void           *_fence;  // set after the last draw, while mapped
+  size_t         _capacity;
+  size_t         _written;
+
+  FenceSync      _fenceSync;
+  ClientWaitSync _clientWaitSync;
+  DeleteSync     _deleteSync;
+};
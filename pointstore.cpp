@@ -0,0 +1,457 @@
+#include "pointstore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "plyreader.h"
+#include "taskpool.h"
+
+const int MORTON_BITS = 10;      // cells per axis of the curve, as a power of two
+const int CHUNK_CELL_BITS = 4;   // the same for the cells chunks are cut from
+const size_t ENCODE_GRAIN = 4;   // chunks per task
+
+namespace {
+
+// how a chunk holds its colours
+enum ColourCoding : uint8_t
+{
+  ColourFloats,  // like the other columns
+  ColourPalette, // palette of bytes, bit-packed indices
+  ColourBytes    // three bytes per point
+};
+
+// float bits as an integer that orders like the float
+uint32_t orderedBits(float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+float fromOrderedBits(uint32_t ordered)
+{
+  const uint32_t bits = (ordered & 0x80000000u) ? ordered & 0x7fffffffu : ~ordered;
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// a colour channel as PlyReader reads it from a byte
+float byteColour(int byte)
+{
+  return float(byte * (1. / 255.));
+}
+
+// the byte 'value' was read from, -1 when it was not read from one
+int colourByte(float value)
+{
+  if (!(value >= 0.f && value <= 1.f))
+    return -1;
+  const int byte = int(value * 255.f + .5f);
+  const float decoded = byteColour(byte);
+  return std::memcmp(&decoded, &value, sizeof(value)) == 0 ? byte : -1;
+}
+
+uint32_t spreadBits(uint32_t v)
+{
+  // 10 bits to every third of 30
+  v = (v | (v << 16)) & 0x030000ffu;
+  v = (v | (v << 8))  & 0x0300f00fu;
+  v = (v | (v << 4))  & 0x030c30c3u;
+  v = (v | (v << 2))  & 0x09249249u;
+  return v;
+}
+
+void putVarint(std::vector<uint8_t>& data, uint32_t value)
+{
+  while (value >= 0x80) {
+    data.push_back(uint8_t(value | 0x80));
+    value >>= 7;
+  }
+  data.push_back(uint8_t(value));
+}
+
+// how a column predicts each value from the previous ones
+enum Prediction : uint8_t
+{
+  PredictPrevious, // the previous value
+  PredictLinear    // the previous value plus the previous step, for points along a scan line
+};
+
+void putPredicted(std::vector<uint8_t>& data, const uint32_t* values, size_t count, Prediction prediction)
+{
+  data.push_back(prediction);
+  uint32_t previous = 0, step = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint32_t predicted = prediction == PredictLinear ? previous + step : previous;
+    const uint32_t delta = values[i] - predicted;
+    step = values[i] - previous;
+    previous = values[i];
+    putVarint(data, (delta << 1) ^ uint32_t(int32_t(delta) >> 31));
+  }
+}
+
+// column 'column' of the points in 'order', as zigzag varints of the
+// differences of their ordered bits from a prediction, the smaller of both
+void encodeColumn(const float* points, const uint32_t* order, size_t count, int column, std::vector<uint8_t>& data,
+                  std::vector<uint32_t>& values, std::vector<uint8_t>& scratch)
+{
+  values.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    values[i] = orderedBits(points[size_t(order[i]) * POINT_STRIDE + column]);
+  }
+  scratch.clear();
+  putPredicted(scratch, values.data(), count, PredictPrevious);
+  const size_t size = data.size();
+  putPredicted(data, values.data(), count, PredictLinear);
+  if (data.size() - size > scratch.size()) {
+    data.resize(size);
+    data.insert(data.end(), scratch.begin(), scratch.end());
+  }
+}
+
+template <Prediction prediction>
+const uint8_t* decodePredicted(const uint8_t* in, size_t count, int column, float* points)
+{
+  uint32_t previous = 0, step = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint32_t zigzag = *in++;
+    if (zigzag & 0x80) {
+      zigzag &= 0x7f;
+      for (int shift = 7; ; shift += 7) {
+        const uint8_t byte = *in++;
+        zigzag |= uint32_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+          break;
+      }
+    }
+    const uint32_t delta = (zigzag >> 1) ^ (0u - (zigzag & 1));
+    const uint32_t value = (prediction == PredictLinear ? previous + step : previous) + delta;
+    step = value - previous;
+    previous = value;
+    points[i * POINT_STRIDE + column] = fromOrderedBits(value);
+  }
+  return in;
+}
+
+const uint8_t* decodeColumn(const uint8_t* in, size_t count, int column, float* points)
+{
+  return *in == PredictLinear ? decodePredicted<PredictLinear>(in + 1, count, column, points)
+                              : decodePredicted<PredictPrevious>(in + 1, count, column, points);
+}
+
+} // namespace
+
+PointStore::PointStore(size_t chunkPoints)
+  : _chunkPoints(std::max<size_t>(chunkPoints, 1)),
+    _chunkFirsts(1, 0),
+    _compressedSize(0),
+    _uses(0)
+{
+}
+
+void PointStore::clear()
+{
+  std::vector<std::vector<uint8_t> >().swap(_chunks);
+  _chunkFirsts.assign(1, 0);
+  _compressedSize = 0;
+  std::lock_guard<std::mutex> lock(_hotMutex);
+  _hot.clear();
+}
+
+void PointStore::append(const float* points, size_t count, uint32_t* normals)
+{
+  if (count == 0)
+    return;
+  TaskPool& pool = TaskPool::instance();
+
+  // Morton codes of the points in the bounding box
+  float min[3], max[3], scale[3];
+  for (int axis = 0; axis < 3; axis++) {
+    min[axis] = std::numeric_limits<float>::max();
+    max[axis] = std::numeric_limits<float>::lowest();
+  }
+  for (size_t i = 0; i < count; i++) {
+    for (int axis = 0; axis < 3; axis++) {
+      min[axis] = std::min(min[axis], points[i * POINT_STRIDE + axis]);
+      max[axis] = std::max(max[axis], points[i * POINT_STRIDE + axis]);
+    }
+  }
+  for (int axis = 0; axis < 3; axis++) {
+    scale[axis] = max[axis] > min[axis] ? (1 << MORTON_BITS) / (max[axis] - min[axis]) : 0.f;
+  }
+  std::vector<uint32_t> codes(count);
+  std::vector<uint64_t> keys(count);
+  pool.parallelFor(0, count, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      uint32_t code = 0;
+      for (int axis = 0; axis < 3; axis++) {
+        // NaN coordinates fall into the first cell
+        const float cell = (points[i * POINT_STRIDE + axis] - min[axis]) * scale[axis];
+        const uint32_t c = cell > 0.f ? std::min(uint32_t(cell), uint32_t(1 << MORTON_BITS) - 1) : 0;
+        code |= spreadBits(c) << axis;
+      }
+      codes[i] = code;
+      keys[i] = uint64_t(code >> 3 * (MORTON_BITS - CHUNK_CELL_BITS)) << 32 | i;
+    }
+  }, 1 << 16);
+
+  // chunks follow the coarse cells, their points in the order given
+  std::sort(keys.begin(), keys.end());
+  std::vector<uint32_t> order(count);
+  for (size_t i = 0; i < count; i++) {
+    order[i] = uint32_t(keys[i]);
+  }
+  std::vector<uint64_t>().swap(keys);
+
+  // each chunk coded apart; scans keep close points
+  // next to each other, other orders are better off along the curve
+  const size_t chunks = (count + _chunkPoints - 1) / _chunkPoints;
+  std::vector<std::vector<uint8_t> > coded(chunks);
+  pool.parallelFor(0, chunks, [&](size_t begin, size_t end) {
+    std::vector<uint32_t> curve;
+    std::vector<uint8_t> alongCurve;
+    for (size_t c = begin; c < end; c++) {
+      uint32_t *chunk = order.data() + c * _chunkPoints;
+      const size_t n = std::min(_chunkPoints, count - c * _chunkPoints);
+      _encode(points, chunk, n, coded[c]);
+
+      curve.assign(chunk, chunk + n);
+      std::sort(curve.begin(), curve.end(), [&codes](uint32_t a, uint32_t b) {
+        return codes[a] < codes[b] || (codes[a] == codes[b] && a < b);
+      });
+      alongCurve.clear();
+      _encode(points, curve.data(), n, alongCurve);
+      if (alongCurve.size() < coded[c].size()) {
+        coded[c].swap(alongCurve);
+        std::copy(curve.begin(), curve.end(), chunk);
+      }
+      coded[c].shrink_to_fit();
+    }
+  }, ENCODE_GRAIN);
+  std::vector<uint32_t>().swap(codes);
+
+  if (normals) {
+    std::vector<uint32_t> sorted(count);
+    for (size_t i = 0; i < count; i++) {
+      sorted[i] = normals[order[i]];
+    }
+    std::copy(sorted.begin(), sorted.end(), normals);
+  }
+
+  for (size_t c = 0; c < chunks; c++) {
+    _compressedSize += coded[c].size();
+    _chunks.push_back(std::vector<uint8_t>());
+    _chunks.back().swap(coded[c]);
+    _chunkFirsts.push_back(_chunkFirsts.back() + std::min(_chunkPoints, count - c * _chunkPoints));
+  }
+}
+
+void PointStore::_encode(const float* points, const uint32_t* order, size_t count, std::vector<uint8_t>& data)
+{
+  // colours: a palette while there are few, bytes when they all are
+  bool bytes = true;
+  std::vector<uint32_t> palette;
+  uint32_t slotColours[1024]; // colour + 1, 0 for a free slot
+  uint8_t slotIndices[1024];
+  std::fill(slotColours, slotColours + 1024, 0u);
+  std::vector<uint8_t> indices(count);
+  for (size_t i = 0; i < count && bytes; i++) {
+    const float *p = points + size_t(order[i]) * POINT_STRIDE;
+    const int r = colourByte(p[4]), g = colourByte(p[5]), b = colourByte(p[6]);
+    bytes = r >= 0 && g >= 0 && b >= 0;
+    if (!bytes || palette.size() > 256)
+      continue;
+    const uint32_t colour = uint32_t(r) << 16 | uint32_t(g) << 8 | uint32_t(b);
+    uint32_t slot = (colour * 2654435761u) >> 22;
+    while (slotColours[slot] && slotColours[slot] != colour + 1)
+      slot = (slot + 1) & 1023;
+    if (!slotColours[slot]) {
+      slotColours[slot] = colour + 1;
+      slotIndices[slot] = uint8_t(palette.size());
+      palette.push_back(colour);
+    }
+    indices[i] = slotIndices[slot];
+  }
+  const ColourCoding coding = !bytes ? ColourFloats : palette.size() <= 256 ? ColourPalette : ColourBytes;
+
+  data.reserve(count * 8);
+  data.push_back(coding);
+  std::vector<uint32_t> values;
+  std::vector<uint8_t> scratch;
+  for (int column = 0; column < 4; column++) {
+    encodeColumn(points, order, count, column, data, values, scratch);
+  }
+  if (coding == ColourFloats) {
+    for (size_t column = 4; column < POINT_STRIDE; column++) {
+      encodeColumn(points, order, count, column, data, values, scratch);
+    }
+  } else if (coding == ColourPalette) {
+    data.push_back(uint8_t(palette.size() - 1));
+    for (uint32_t colour : palette) {
+      data.push_back(uint8_t(colour >> 16));
+      data.push_back(uint8_t(colour >> 8));
+      data.push_back(uint8_t(colour));
+    }
+    int bits = 0;
+    while ((size_t(1) << bits) < palette.size())
+      bits++;
+    uint64_t pending = 0;
+    int pendingBits = 0;
+    for (size_t i = 0; i < count; i++) {
+      pending |= uint64_t(indices[i]) << pendingBits;
+      pendingBits += bits;
+      while (pendingBits >= 8) {
+        data.push_back(uint8_t(pending));
+        pending >>= 8;
+        pendingBits -= 8;
+      }
+    }
+    if (pendingBits > 0)
+      data.push_back(uint8_t(pending));
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      const float *p = points + size_t(order[i]) * POINT_STRIDE;
+      for (size_t column = 4; column < POINT_STRIDE; column++) {
+        data.push_back(uint8_t(colourByte(p[column])));
+      }
+    }
+  }
+}
+
+void PointStore::_decode(size_t chunk, float* points) const
+{
+  const size_t count = _chunkFirsts[chunk + 1] - _chunkFirsts[chunk];
+  const uint8_t *in = _chunks[chunk].data();
+  const ColourCoding coding = ColourCoding(*in++);
+  for (int column = 0; column < 4; column++) {
+    in = decodeColumn(in, count, column, points);
+  }
+  if (coding == ColourFloats) {
+    for (size_t column = 4; column < POINT_STRIDE; column++) {
+      in = decodeColumn(in, count, column, points);
+    }
+  } else if (coding == ColourPalette) {
+    const size_t colours = size_t(*in++) + 1;
+    float palette[256 * 3];
+    for (size_t c = 0; c < colours * 3; c++) {
+      palette[c] = byteColour(*in++);
+    }
+    int bits = 0;
+    while ((size_t(1) << bits) < colours)
+      bits++;
+    const uint32_t mask = (1u << bits) - 1;
+    uint64_t pending = 0;
+    int pendingBits = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (pendingBits < bits) {
+        pending |= uint64_t(*in++) << pendingBits;
+        pendingBits += 8;
+      }
+      const float *colour = palette + (pending & mask) * 3;
+      pending >>= bits;
+      pendingBits -= bits;
+      std::copy(colour, colour + 3, points + i * POINT_STRIDE + 4);
+    }
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      for (size_t column = 4; column < POINT_STRIDE; column++) {
+        points[i * POINT_STRIDE + column] = byteColour(*in++);
+      }
+    }
+  }
+}
+
+size_t PointStore::memorySize() const
+{
+  size_t bytes = _chunks.capacity() * sizeof(std::vector<uint8_t>) + _chunkFirsts.capacity() * sizeof(size_t);
+  for (const std::vector<uint8_t>& chunk : _chunks) {
+    bytes += chunk.capacity();
+  }
+  std::lock_guard<std::mutex> lock(_hotMutex);
+  for (const HotChunk& hot : _hot) {
+    bytes += hot.points->capacity() * sizeof(float);
+  }
+  return bytes;
+}
+
+size_t PointStore::_chunkOf(size_t point) const
+{
+  return std::upper_bound(_chunkFirsts.begin(), _chunkFirsts.end(), point) - _chunkFirsts.begin() - 1;
+}
+
+std::shared_ptr<const std::vector<float> > PointStore::_hotChunk(size_t chunk) const
+{
+  {
+    std::lock_guard<std::mutex> lock(_hotMutex);
+    for (HotChunk& hot : _hot) {
+      if (hot.chunk == chunk) {
+        hot.lastUse = ++_uses;
+        return hot.points;
+      }
+    }
+  }
+
+  // decoded unlocked, other chunks may be decoded meanwhile
+  std::shared_ptr<std::vector<float> > points(
+    new std::vector<float>((_chunkFirsts[chunk + 1] - _chunkFirsts[chunk]) * POINT_STRIDE));
+  _decode(chunk, points->data());
+
+  std::lock_guard<std::mutex> lock(_hotMutex);
+  for (HotChunk& hot : _hot) {
+    if (hot.chunk == chunk)
+      return hot.points;
+  }
+  if (_hot.size() < HOT_CHUNKS) {
+    _hot.push_back(HotChunk());
+  } else {
+    // the least recently used makes room; readers still holding it keep it
+    std::sort(_hot.begin(), _hot.end(), [](const HotChunk& a, const HotChunk& b) { return a.lastUse > b.lastUse; });
+  }
+  HotChunk& hot = _hot.back();
+  hot.chunk = chunk;
+  hot.lastUse = ++_uses;
+  hot.points = points;
+  return hot.points;
+}
+
+void PointStore::read(size_t first, size_t count, float* points) const
+{
+  if (count == 0)
+    return;
+  const size_t end = first + count;
+  TaskPool::instance().parallelFor(_chunkOf(first), _chunkOf(end - 1) + 1, [&](size_t begin, size_t last) {
+    for (size_t c = begin; c < last; c++) {
+      const size_t from = std::max(_chunkFirsts[c], first);
+      const size_t to = std::min(_chunkFirsts[c + 1], end);
+      float *target = points + (from - first) * POINT_STRIDE;
+      if (from == _chunkFirsts[c] && to == _chunkFirsts[c + 1]) {
+        _decode(c, target);
+      } else {
+        const std::shared_ptr<const std::vector<float> > hot = _hotChunk(c);
+        std::copy(hot->begin() + (from - _chunkFirsts[c]) * POINT_STRIDE,
+                  hot->begin() + (to - _chunkFirsts[c]) * POINT_STRIDE, target);
+      }
+    }
+  }, 1);
+}
+
+void PointStore::forEach(size_t batchPoints, const std::function<void(const float* points, size_t first, size_t count)>& body) const
+{
+  std::vector<float> batch;
+  for (size_t c = 0; c < chunksCount(); ) {
+    size_t last = c + 1;
+    while (last < chunksCount() && _chunkFirsts[last + 1] - _chunkFirsts[c] <= batchPoints)
+      last++;
+    const size_t first = _chunkFirsts[c], count = _chunkFirsts[last] - first;
+    batch.resize(count * POINT_STRIDE);
+    TaskPool::instance().parallelFor(c, last, [&](size_t begin, size_t end) {
+      for (size_t k = begin; k < end; k++) {
+        _decode(k, batch.data() + (_chunkFirsts[k] - first) * POINT_STRIDE);
+      }
+    }, 1);
+    body(batch.data(), first, count);
+    c = last;
+  }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Points of POINT_STRIDE floats kept compressed in memory, in chunks of a
+// fixed number of points, for clouds that must stay resident on the CPU side
+// at a fraction of 28 bytes per point.
+//
+// Points handed to append() are cut into chunks along a coarse Morton curve
+// of their bounding box, so each chunk covers a compact piece of space.
+// Inside a chunk, points stay in the order given, which keeps a scan's
+// neighbours together, unless ordering them along a fine curve codes
+// smaller. Each chunk is coded on its own, losslessly:
+//  - x, y, z and the row index as the difference of their float bits from a
+//    prediction, the previous point's or its extension along a scan line,
+//    whichever codes smaller; the bits are mapped so that integer order
+//    follows float order, so close values are a few units apart, zigzag and
+//    varint coded in a byte or two;
+//  - colours read from bytes, as most PLY files hold them, as a palette of
+//    the chunk's colours and indices of as many bits as it needs when it has
+//    256 colours at most, as three bytes otherwise; other colours like the
+//    other columns.
+//
+// Chunks decode in parallel on the task pool. Reads of a part of a chunk go
+// through a small cache of the chunks decoded last, so slices that do not
+// fall on chunk bounds, or reads of points close together, decode each
+// chunk once.
+class PointStore
+{
+public:
+  static const size_t DEFAULT_CHUNK_POINTS = 4096;
+  static const size_t HOT_CHUNKS = 16; // decoded chunks cached
+
+  explicit PointStore(size_t chunkPoints = DEFAULT_CHUNK_POINTS);
+
+  void clear();
+
+  // compress 'count' points, fewer than 2^32, POINT_STRIDE floats each;
+  // 'normals', one per point or null, is reordered in place as the points are
+  void append(const float* points, size_t count, uint32_t* normals = nullptr);
+
+  size_t size() const { return _chunkFirsts.back(); }
+  size_t chunkPoints() const { return _chunkPoints; }
+  size_t chunksCount() const { return _chunkFirsts.size() - 1; }
+  size_t compressedSize() const { return _compressedSize; }
+  // compressed chunks, their index and the cache
+  size_t memorySize() const;
+
+  // decode points [first, first + count) into 'points'
+  void read(size_t first, size_t count, float* points) const;
+  // hand every point to 'body' in order, by batches of whole chunks of
+  // about 'batchPoints' points, each decoded in parallel
+  void forEach(size_t batchPoints, const std::function<void(const float* points, size_t first, size_t count)>& body) const;
+
+private:
+  struct HotChunk
+  {
+    size_t   chunk;
+    uint64_t lastUse;
+    std::shared_ptr<const std::vector<float> > points;
+  };
+
+  size_t _chunkOf(size_t point) const;
+  std::shared_ptr<const std::vector<float> > _hotChunk(size_t chunk) const;
+  static void _encode(const float* points, const uint32_t* order, size_t count, std::vector<uint8_t>& data);
+  void _decode(size_t chunk, float* points) const;
+
+  size_t               _chunkPoints;
+  std::vector<std::vector<uint8_t> > _chunks;
+  std::vector<size_t>  _chunkFirsts; // first point of each chunk, then the points count
+  size_t               _compressedSize;
+
+  mutable std::mutex            _hotMutex;
+  mutable std::vector<HotChunk> _hot;
+  mutable uint64_t              _uses;
+};
@@ -0,0 +1,195 @@
+#include "pointstream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <streambuf>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "plyreader.h"
+
+namespace {
+
+const size_t STREAM_BUFFER = 1 << 20;  // bytes read from the descriptor at once
+const size_t STREAM_BATCH = 1 << 16;   // points decoded at once
+const int    POLL_MILLISECONDS = 50;   // how often a waiting read checks for shutdown
+
+// Reads a descriptor through poll() so that waiting for data notices a
+// shutdown request, and so that a pipe opened without blocking waits for
+// its writer instead of reading an end of file.
+class DescriptorBuffer : public std::streambuf
+{
+public:
+  DescriptorBuffer(int fd, const std::atomic<bool>& stopping)
+    : _fd(fd),
+      _stopping(stopping),
+      _buffer(STREAM_BUFFER)
+  {
+    setg(_buffer.data(), _buffer.data(), _buffer.data());
+  }
+
+  ~DescriptorBuffer() { ::close(_fd); }
+
+protected:
+  int_type underflow() override
+  {
+    if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    while (!_stopping) {
+      pollfd request = { _fd, POLLIN, 0 };
+      const int ready = ::poll(&request, 1, POLL_MILLISECONDS);
+      if (ready < 0 && errno != EINTR)
+        break;
+      if (ready <= 0)
+        continue;
+      const ssize_t n = ::read(_fd, _buffer.data(), _buffer.size());
+      if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        continue;
+      if (n <= 0)
+        break;
+      setg(_buffer.data(), _buffer.data(), _buffer.data() + n);
+      return traits_type::to_int_type(*gptr());
+    }
+    return traits_type::eof();
+  }
+
+private:
+  int                      _fd;
+  const std::atomic<bool>& _stopping;
+  std::vector<char>        _buffer;
+};
+
+} // namespace
+
+
+PointStream::PointStream(const std::string& path, size_t capacity)
+  : _path(path),
+    _capacity(capacity),
+    _stopping(false),
+    _finished(false),
+    _received(0),
+    _dropped(0),
+    _pendingFirst(0)
+{
+  _thread = std::thread(&PointStream::_run, this);
+}
+
+PointStream::~PointStream()
+{
+  _stopping = true;
+  _thread.join();
+}
+
+size_t PointStream::take(std::vector<float>& points, size_t maxPoints)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  const size_t count = std::min(maxPoints, _pending.size() / POINT_STRIDE - _pendingFirst);
+  const float *first = _pending.data() + _pendingFirst * POINT_STRIDE;
+  points.insert(points.end(), first, first + count * POINT_STRIDE);
+  _pendingFirst += count;
+  if (_pendingFirst * POINT_STRIDE == _pending.size()) {
+    _pending.clear();
+    _pendingFirst = 0;
+  }
+  return count;
+}
+
+size_t PointStream::pendingCount() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _pending.size() / POINT_STRIDE - _pendingFirst;
+}
+
+std::string PointStream::error() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _error;
+}
+
+int PointStream::_open()
+{
+  while (!_stopping) {
+    struct stat status;
+    if (::stat(_path.c_str(), &status) != 0) {
+      if (errno != ENOENT)
+        throw std::runtime_error("cannot open '" + _path + "': " + std::strerror(errno));
+      std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MILLISECONDS));
+      continue;
+    }
+
+    if (!S_ISSOCK(status.st_mode)) {
+      // pipes are opened without waiting for a writer, reads wait instead
+      const int fd = ::open(_path.c_str(), O_RDONLY | O_NONBLOCK);
+      if (fd < 0)
+        throw std::runtime_error("cannot open '" + _path + "': " + std::strerror(errno));
+      return fd;
+    }
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (_path.size() >= sizeof(address.sun_path))
+      throw std::runtime_error("socket path too long '" + _path + "'");
+    std::strcpy(address.sun_path, _path.c_str());
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+      throw std::runtime_error(std::string("cannot create socket: ") + std::strerror(errno));
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0)
+      return fd;
+    const int error = errno;
+    ::close(fd);
+    // the producer is not listening yet
+    if (error != ECONNREFUSED)
+      throw std::runtime_error("cannot connect to '" + _path + "': " + std::strerror(error));
+    std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MILLISECONDS));
+  }
+  return -1;
+}
+
+void PointStream::_run()
+{
+  try {
+    const int fd = _open();
+    if (fd >= 0) {
+      DescriptorBuffer buffer(fd, _stopping);
+      std::istream is(&buffer);
+      PlyReader reader(is);
+
+      std::vector<float> batch(STREAM_BATCH * POINT_STRIDE);
+      while (const size_t n = reader.readSome(batch.data(), STREAM_BATCH)) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending.insert(_pending.end(), batch.data(), batch.data() + n * POINT_STRIDE);
+        _received += n;
+
+        // the consumer is behind: forget the oldest, they would be
+        // overwritten in its ring anyway
+        const size_t queued = _pending.size() / POINT_STRIDE - _pendingFirst;
+        if (queued > _capacity) {
+          _pendingFirst += queued - _capacity;
+          _dropped += queued - _capacity;
+        }
+        if (_pendingFirst > _capacity) {
+          _pending.erase(_pending.begin(), _pending.begin() + _pendingFirst * POINT_STRIDE);
+          _pendingFirst = 0;
+        }
+      }
+    }
+  } catch (const std::exception& e) {
+    if (!_stopping) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _error = e.what();
+    }
+  }
+  _finished = true;
+}
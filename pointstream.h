@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Points sent by a live producer over a UNIX socket or a named pipe.
+//
+// The producer writes a PLY header followed by vertex records, binary or
+// ascii, for as long as it runs; the header's vertex count is ignored.
+// A thread of its own (it mostly waits on the socket, so it stays off the
+// task pool) decodes records into Scene layout as they arrive and queues
+// them until take() moves them out. Only the newest 'capacity' points are
+// kept queued, older ones are dropped when the consumer falls behind.
+class PointStream
+{
+public:
+  // connects to a listening socket, or opens a pipe, in the background;
+  // waits for the path to appear
+  PointStream(const std::string& path, size_t capacity);
+  ~PointStream();
+
+  // move up to maxPoints queued points (POINT_STRIDE floats each) to the
+  // end of 'points', oldest first; returns how many were moved
+  size_t take(std::vector<float>& points, size_t maxPoints);
+
+  size_t pendingCount() const;
+  size_t receivedCount() const { return _received; }
+  size_t droppedCount() const { return _dropped; }
+
+  // the producer closed the stream, or it failed
+  bool isFinished() const { return _finished; }
+  std::string error() const;
+
+private:
+  void _run();
+  int _open();
+
+  std::string         _path;
+  size_t              _capacity;
+  std::atomic<bool>   _stopping;
+  std::atomic<bool>   _finished;
+  std::atomic<size_t> _received;
+  std::atomic<size_t> _dropped;
+
+  mutable std::mutex  _mutex;
+  std::vector<float>  _pending; // queued points, from _pendingFirst on
+  size_t              _pendingFirst;
+  std::string         _error;
+
+  std::thread         _thread;
+};
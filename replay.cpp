@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "plyreader.h"
+#include "replay.h"
+
+const size_t REPLAY_RECORD_SIZE = 3 * sizeof(float) + 3; // x, y, z, red, green, blue
+const int    REPLAY_SLICES_PER_SECOND = 100;             // sends of a paced replay
+
+// opens the pipe at 'path', or waits for a client on a socket created there
+static int openStream(const std::string& path)
+{
+  struct stat status;
+  if (::stat(path.c_str(), &status) == 0 && S_ISFIFO(status.st_mode)) {
+    std::printf("waiting for a reader on %s\n", path.c_str());
+    std::fflush(stdout);
+    const int fd = ::open(path.c_str(), O_WRONLY);
+    if (fd < 0)
+      throw std::runtime_error("cannot open '" + path + "': " + std::strerror(errno));
+    return fd;
+  }
+
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    throw std::runtime_error("socket path too long '" + path + "'");
+  std::strcpy(address.sun_path, path.c_str());
+
+  const int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ::unlink(path.c_str());
+  if (server < 0
+      || ::bind(server, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+      || ::listen(server, 1) != 0) {
+    throw std::runtime_error("cannot listen on '" + path + "': " + std::strerror(errno));
+  }
+  std::printf("waiting for a viewer on %s\n", path.c_str());
+  std::fflush(stdout);
+  const int fd = ::accept(server, nullptr, nullptr);
+  ::close(server);
+  ::unlink(path.c_str());
+  if (fd < 0)
+    throw std::runtime_error("cannot accept on '" + path + "': " + std::strerror(errno));
+  return fd;
+}
+
+// false once the reader went away
+static bool writeAll(int fd, const char* data, size_t size)
+{
+  while (size > 0) {
+    const ssize_t n = ::write(fd, data, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+static void encodePoints(const float* points, size_t count, char* records)
+{
+  for (size_t i = 0; i < count; i++) {
+    const float *p = points + i * POINT_STRIDE;
+    char *record = records + i * REPLAY_RECORD_SIZE;
+    std::memcpy(record, p, 3 * sizeof(float));
+    for (int c = 0; c < 3; c++) {
+      const float color = std::min(std::max(p[4 + c], 0.f), 1.f);
+      record[3 * sizeof(float) + c] = char(std::lround(color * 255.f));
+    }
+  }
+}
+
+int runReplay(const QString& plyPath, const QString& streamPath, double rate, bool loop)
+{
+  // a viewer closing the stream ends the replay instead of the process
+  std::signal(SIGPIPE, SIG_IGN);
+
+  try {
+    PlyReader reader(plyPath.toStdString());
+    const int fd = openStream(streamPath.toStdString());
+
+    char header[256];
+    const int headerSize = std::snprintf(header, sizeof(header),
+      "ply\nformat binary_little_endian 1.0\nelement vertex %zu\n"
+      "property float x\nproperty float y\nproperty float z\n"
+      "property uchar red\nproperty uchar green\nproperty uchar blue\nend_header\n",
+      reader.pointsCount());
+
+    // paced replays send a slice of points every 1/REPLAY_SLICES_PER_SECOND s
+    const size_t slice = rate > 0. ? std::max<size_t>(1, size_t(rate / REPLAY_SLICES_PER_SECOND)) : size_t(1) << 16;
+    std::vector<float> points(slice * POINT_STRIDE);
+    std::vector<char> records(slice * REPLAY_RECORD_SIZE);
+
+    const auto start = std::chrono::steady_clock::now();
+    size_t sent = 0;
+    bool open = writeAll(fd, header, headerSize);
+    while (open) {
+      size_t n = reader.read(points.data(), slice);
+      if (n == 0 && loop && reader.pointsCount() > 0) {
+        reader.rewind();
+        n = reader.read(points.data(), slice);
+      }
+      if (n == 0)
+        break;
+
+      if (rate > 0.) {
+        std::this_thread::sleep_until(start + std::chrono::duration<double>(sent / rate));
+      }
+      encodePoints(points.data(), n, records.data());
+      open = writeAll(fd, records.data(), n * REPLAY_RECORD_SIZE);
+      sent += open ? n : 0;
+    }
+    ::close(fd);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("sent %zu points in %.1f s, %.2f M points/s%s\n", sent, seconds, sent / seconds * 1e-6,
+                open ? "" : ", the reader went away");
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "replay failed: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <QString>
+
+// Live stream producer, run with
+// 'pcviewer --replay points.ply /tmp/scan.sock [--rate N] [--loop]'.
+// Plays the points of a PLY file at N points per second (0: as fast as the
+// reader takes them) as binary PLY records into a named pipe, if 'streamPath'
+// is one, or else to the first client of a UNIX socket listening there.
+int runReplay(const QString& plyPath, const QString& streamPath, double rate, bool loop);
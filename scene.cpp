@@ -1,38 +1,212 @@
 #include "scene.h"
 
 #include <QMouseEvent>
+#include <QOpenGLPixelTransferOptions>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QTimer>
 #include <cmath>
 #include <iostream>
 #include <fstream>
 #include <cstring>
 #include <sstream>
 #include <cassert>
-#include <omp.h>
+#include <limits>
+
+#include "freespace.h"
+#include "normals.h"
+#include "occupancypyramid.h"
+#include "plyreader.h"
+#include "plywriter.h"
+#include "visualhull.h"
+
+const size_t PLY_BATCH = 1 << 20; // points decoded per read
+const size_t COMPRESSION_SAMPLE = 1 << 16; // points compressed to size the rest
+const size_t LIVE_POINTS_PER_FRAME = 1 << 19; // appended to the ring per paint
+const int    LIVE_POLL_MILLISECONDS = 15;     // checks for newly received points
+const size_t SCAN_POINTS_PER_FRAME = 1 << 21; // copied to the point buffer per paint
+const int    SCAN_POLL_MILLISECONDS = 15;     // checks on scans being read
+const float  SPLAT_DEPTH = 0.005f; // of the space size, blended splats lie this close to the nearest
+const GLenum SPLAT_FORMAT = 0x881A; // GL_RGBA16F, sums of weighted colours
+const GLenum POINT_SPRITE = 0x8861; // GL_POINT_SPRITE, gl_PointCoord on compatibility contexts
+const int    OCCUPANCY_TEXTURE_UNIT = 1; // unit 0 holds the splat sums while resolving
+const int    PYRAMID_TEXTURE_UNIT = 2;      // raymarched voxels, besides the occupancy
+const int    VOXEL_COLORS_TEXTURE_UNIT = 3;
+const size_t NO_DISTANCES = std::numeric_limits<size_t>::max(); // distances written nowhere
+
+SceneConfig SceneConfig::load(const QString& configPath)
+{
+  QFile file;
+  file.setFileName(configPath);
+  file.open(QIODevice::ReadOnly);
+  QString buff = file.readAll();
+  QStringList list = buff.split('\n');
+  if (list.size() < 4) {
+    throw std::runtime_error("not a config file");
+  }
 
-const size_t POINT_STRIDE =  7; // x, y, z, index, r, g, b
+  SceneConfig config;
+  config.plyPath = list[0];
+  config.bundlePath = list[1];
+  config.maskPath = list[2];
+  config.hImg = list[3].toInt();
+
+  // optional 'key=value' lines after the paths
+  for (int i = 4; i < list.size(); i++) {
+    const QString key = list[i].section('=', 0, 0).trimmed();
+    const QString value = list[i].section('=', 1).trimmed();
+    if (key == "stream_voxels") {
+      config.options.streamVoxels = value.toInt() != 0;
+    } else if (key == "downsample") {
+      config.options.filter.spacing = value.toFloat();
+    } else if (key == "point_budget") {
+      config.options.filter.pointBudget = value.toULongLong();
+    } else if (key == "outliers") {
+      config.options.filter.outliers = value == "statistical" ? PointFilterOptions::StatisticalOutliers
+                                     : value == "radius" ? PointFilterOptions::RadiusOutliers
+                                     : PointFilterOptions::NoOutliers;
+    } else if (key == "outlier_neighbours") {
+      config.options.filter.neighbours = value.toInt();
+    } else if (key == "outlier_std_ratio") {
+      config.options.filter.stdRatio = value.toFloat();
+    } else if (key == "outlier_radius") {
+      config.options.filter.radius = value.toFloat();
+    } else if (key == "live_stream") {
+      config.options.liveStream = value;
+    } else if (key == "live_capacity") {
+      config.options.liveCapacity = value.toULongLong();
+    } else if (key == "unseen_voxels") {
+      config.options.keepUnseenVoxels = value == "keep";
+    } else if (key == "ray_step") {
+      config.options.rayStep = std::max<size_t>(1, value.toULongLong());
+    } else if (key == "scan") {
+      config.options.scans.append(value);
+    } else if (key == "gpu_budget") {
+      config.options.gpuBudget = value.toULongLong();
+    } else if (key == "texture_budget") {
+      config.options.textureBudget = value.toULongLong();
+    } else if (key == "memory_budget") {
+      config.options.memoryBudget = value.toULongLong();
+    } else if (key == "normals") {
+      config.options.normals = value != "off";
+    } else if (key == "reference") {
+      config.options.reference = value;
+    } else if (key == "compress_points") {
+      config.options.compressPoints = value.toULongLong();
+    }
+  }
+  return config;
+}
 
-unsigned char *tmp;
 
-Scene::Scene(const QString& plyFilePath, const QString& bundlePath, QString& maskPath, int hImg, QWidget* parent)
+Scene::Scene(const SceneConfig& config, QWidget* parent)
   : QOpenGLWidget(parent),
     _pointSize(1),
-    _fov_v()
+    _indicesBufferMesh(QOpenGLBuffer::IndexBuffer),
+    _fov_v(),
+    _options(config.options)
 {
-  _hImg = hImg;
-  _maskPath = maskPath;
-  _loadPLY(plyFilePath);
-  _loadBundle(bundlePath);
-  _voxStorage = new unsigned char[_nbVox*_nbVox*_nbVox];
-  memset(_voxStorage, 1, _nbVox*_nbVox*_nbVox * sizeof(unsigned char));
-  index = 0;
-  _currentCamera.setViewMatrix(_listView.at(0));
-  _projectionMatrix = _listProjection.at(0);
-  _indicesBufferVox = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
-  _spaceSize = qMax(qMax(_pointsBoundMax[0] - _pointsBoundMin[0],_pointsBoundMax[1] - _pointsBoundMin[1]), _pointsBoundMax[2] - _pointsBoundMin[2]);
-  _createVox();
-
+  _hImg = config.hImg;
+  _maskPath = config.maskPath;
+  _plyFilePath = config.plyPath;
+  if (_options.memoryBudget > 0)
+    MemoryBudget::instance().setLimit(_options.memoryBudget * (size_t(1) << 20));
+  _loadBundle(config.bundlePath);
+  // masks decode on the pool while this thread parses the points
+  _startLoadingMasks();
+  // if loading throws, ~Scene does not run: the decoding is stopped here
+  // before the members it reads are destroyed
+  try {
+    if (_options.liveStream.isEmpty()) {
+      _loadPLY(config.plyPath);
+    } else {
+      // points come from the stream only, a ring of the newest ones; QVector
+      // sizes are ints
+      _options.streamVoxels = false;
+      _options.normals = false;
+      _options.compressPoints = 0;
+      _options.liveCapacity = std::min(std::max<size_t>(1, _options.liveCapacity),
+                                       size_t(std::numeric_limits<int>::max()) / POINT_STRIDE);
+      // the CPU copy of the ring is reserved up front, keep it within the budget
+      const size_t room = MemoryBudget::instance().available() / (POINT_STRIDE * sizeof(float));
+      if (room < _options.liveCapacity) {
+        std::cerr << "live stream: " << _options.liveCapacity << " points exceed the memory budget, keeping "
+                  << room << std::endl;
+        _options.liveCapacity = std::max<size_t>(1, room);
+      }
+      _resetBounds();
+      _pointsCount = _sourcePointsCount = 0;
+      _pointsData.reserve(_options.liveCapacity * POINT_STRIDE);
+      _pointsMemory.set(_pointsData.capacity() * sizeof(float));
+      _liveStream.reset(new PointStream(_options.liveStream.toStdString(), _options.liveCapacity));
+
+      // received points are appended by paintGL
+      _liveTimer = new QTimer(this);
+      connect(_liveTimer, &QTimer::timeout, [this]() {
+        if (_liveStream->pendingCount() > 0) {
+          update();
+        } else if (_liveStream->isFinished()) {
+          _liveTimer->stop();
+          if (!_liveStream->error().empty())
+            std::cerr << "live stream: " << _liveStream->error() << std::endl;
+        }
+      });
+      _liveTimer->start(LIVE_POLL_MILLISECONDS);
+    }
+    if (!_liveStream) {
+      // the points and the extra scans share one buffer of the budget's size,
+      // or just fit the points without scans; QOpenGLBuffer sizes are ints
+      const size_t maxPoints = size_t(std::numeric_limits<int>::max()) / (POINT_STRIDE * sizeof(GLfloat));
+      const size_t budget = _options.gpuBudget * (size_t(1) << 20) / (POINT_STRIDE * sizeof(GLfloat));
+      // none when streaming voxels
+      const size_t resident = _pointStore ? _pointStore->size() : _pointsData.size() / POINT_STRIDE;
+      const size_t capacity = _options.scans.isEmpty() ? resident : std::max(budget, resident);
+      _workspace.reset(new Workspace(std::min(capacity, maxPoints), _options.normals));
+      const uint32_t *normals = _options.normals ? _normalsData.data() : nullptr;
+      if (_pointStore) {
+        _workspace->addStore(_plyFilePath.toStdString(), _pointStore.get(), normals);
+      } else {
+        _workspace->addPoints(_plyFilePath.toStdString(), _pointsData.constData(), resident, normals);
+      }
+      for (const QString& scan : _options.scans) {
+        _workspace->addScan(scan.toStdString());
+      }
+      // scans are read on the pool while the view comes up
+      for (size_t i = 0; i < _workspace->scansCount(); i++) {
+        _workspace->load(i);
+      }
 
-  tmp = new unsigned char[_nbVox*_nbVox*_nbVox];
+      // points are compared to the reference once, kept points only
+      if (!_options.reference.isEmpty() && !_options.streamVoxels) {
+        try {
+          compareToReference();
+        } catch (const std::exception& e) {
+          std::cerr << "reference: " << e.what() << std::endl;
+        }
+      }
+    }
+    _voxStorage = new unsigned char[_nbVox*_nbVox*_nbVox];
+    memset(_voxStorage, 1, _nbVox*_nbVox*_nbVox * sizeof(unsigned char));
+    _accountVoxels();
+    index = 0;
+    _currentCamera.setViewMatrix(_listView.at(0));
+    _projectionMatrix = _listProjection.at(0);
+    _indicesBufferVox = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+    _fitSpace();
+
+    // nothing to draw but the occupancy when points are not kept
+    if (_options.streamVoxels) {
+      _drawPoints = false;
+      _drawVoxels = true;
+      intersect();
+    }
+  } catch (...) {
+    _masksLoading->cancel();
+    _masksLoading.reset();
+    throw;
+  }
+  MemoryBudget::instance().log("memory after loading");
 
   setMouseTracking(true);
 }
@@ -40,79 +214,218 @@ Scene::Scene(const QString& plyFilePath, const QString& bundlePath, QString& mas
 
 void Scene::_loadPLY(const QString& plyFilePath) {
 
-  _pointsBoundMax[0] = std::numeric_limits<float>::min();
-  _pointsBoundMax[1] = std::numeric_limits<float>::min();
-  _pointsBoundMax[2] = std::numeric_limits<float>::min();
-  _pointsBoundMin[0] = std::numeric_limits<float>::max();
-  _pointsBoundMin[1] = std::numeric_limits<float>::max();
-  _pointsBoundMin[2] = std::numeric_limits<float>::max();
+  _resetBounds();
+
+  PlyReader reader(plyFilePath.toStdString());
+  _pointsCount = reader.pointsCount();
+  _sourcePointsCount = _pointsCount;
+  if (_options.streamVoxels)
+    _options.normals = false;
+  const bool readNormals = _options.normals && reader.hasNormals();
+  size_t pointBytes = POINT_STRIDE * sizeof(float) + (_options.normals ? sizeof(uint32_t) : 0);
+
+  // compressed batch by batch as read, unless filters or normal estimation
+  // need every point at once; the cloud is compressed after them then
+  const bool compress = _options.compressPoints > 0 && !_options.streamVoxels;
+  const bool compressWhileReading = compress && _options.filter.isEmpty() && (readNormals || !_options.normals);
+  QElapsedTimer compressionTimer;
+  double compressionMs = 0.;
+  std::vector<float> batch;
+  std::vector<uint32_t> normalsBatch;
+  size_t readAhead = 0; // points of the first batch, read to size the compressed points
+  if (compressWhileReading) {
+    batch.resize(PLY_BATCH * POINT_STRIDE);
+    if (readNormals)
+      normalsBatch.resize(PLY_BATCH);
+    readAhead = reader.read(batch.data(), PLY_BATCH, readNormals ? normalsBatch.data() : nullptr);
+    PointStore sample(_options.compressPoints);
+    sample.append(batch.data(), std::min(readAhead, COMPRESSION_SAMPLE));
+    // with a margin, other parts of the cloud may compress worse
+    const size_t sampleBytes = sample.compressedSize() * 5 / 4 / std::max<size_t>(sample.size(), 1) + 1;
+    pointBytes = sampleBytes + (_options.normals ? sizeof(uint32_t) : 0);
+    _pointStore.reset(new PointStore(_options.compressPoints));
+  }
 
-  // open stream
-  std::fstream is;
-  is.open(plyFilePath.toStdString().c_str(), std::fstream::in);
+  // a cloud over the memory budget keeps every keepEvery-th point, decimated
+  // as it is read
+  size_t keepEvery = 1;
+  if (!_options.streamVoxels) {
+    const size_t bytes = _pointsCount * pointBytes;
+    const size_t room = MemoryBudget::instance().available();
+    if (bytes > room) {
+      keepEvery = bytes / std::max(room, pointBytes) + 1;
+      std::cerr << "'" << plyFilePath.toStdString() << "' exceeds the memory budget, keeping one point in "
+                << keepEvery << std::endl;
+    }
+  }
 
-  // ensure format with magic header
-  std::string line;
-  std::getline(is, line);
-  if (line != "ply") {
-    throw std::runtime_error("not a ply file");
+  // when streaming voxels only one batch is resident, bounds are all this
+  // first pass keeps; intersect() folds the points in on the second one
+  if (_options.streamVoxels || keepEvery > 1) {
+    batch.resize(PLY_BATCH * POINT_STRIDE);
+    if (readNormals)
+      normalsBatch.resize(PLY_BATCH);
+  }
+  if (compressWhileReading) {
+    if (_options.normals)
+      _normalsData.reserve((_pointsCount + keepEvery - 1) / keepEvery);
+  } else if (!_options.streamVoxels) {
+    _pointsData.resize((_pointsCount + keepEvery - 1) / keepEvery * POINT_STRIDE);
+    if (_options.normals)
+      _normalsData.resize((_pointsCount + keepEvery - 1) / keepEvery);
   }
 
-  // parse header looking only for 'element vertex' section size
-  _pointsCount = 0;
-  while (is.good()) {
-    std::getline(is, line);
-    if (line == "end_header") {
-      break;
-    } else {
-      std::stringstream ss(line);
-      std::string tag1, tag2, tag3;
-      ss >> tag1 >> tag2 >> tag3;
-      if (tag1 == "element" && tag2 == "vertex") {
-        _pointsCount = std::atof(tag3.c_str());
+  size_t kept = 0;
+  for (size_t first = 0; first < _pointsCount; ) {
+    float *p = batch.empty() ? _pointsData.data() + first * POINT_STRIDE : batch.data();
+    uint32_t *normals = !readNormals ? nullptr
+                      : normalsBatch.empty() ? _normalsData.data() + first : normalsBatch.data();
+    const size_t n = readAhead ? readAhead : reader.read(p, PLY_BATCH, normals);
+    readAhead = 0;
+    if (compressWhileReading) {
+      // kept points move to the front of the batch
+      size_t k = 0;
+      for (size_t i = (keepEvery - first % keepEvery) % keepEvery; i < n; i += keepEvery, k++) {
+        if (k == i)
+          continue;
+        std::copy(p + i * POINT_STRIDE, p + (i + 1) * POINT_STRIDE, p + k * POINT_STRIDE);
+        if (normals)
+          normals[k] = normals[i];
+      }
+      _updateBounds(p, k);
+      compressionTimer.start();
+      _pointStore->append(p, k, normals);
+      compressionMs += compressionTimer.nsecsElapsed() * 1e-6;
+      if (normals)
+        _normalsData.insert(_normalsData.end(), normals, normals + k);
+      kept += k;
+    } else if (keepEvery > 1) {
+      float *keep = _pointsData.data() + kept * POINT_STRIDE;
+      size_t k = 0;
+      for (size_t i = (keepEvery - first % keepEvery) % keepEvery; i < n; i += keepEvery, k++) {
+        std::copy(p + i * POINT_STRIDE, p + (i + 1) * POINT_STRIDE, keep + k * POINT_STRIDE);
+        if (normals)
+          _normalsData[kept + k] = normals[i];
       }
+      _updateBounds(keep, k);
+      kept += k;
+    } else {
+      _updateBounds(p, n);
     }
+    first += n;
   }
-
-  // read and parse 'element vertex' section
-  if (_pointsCount > 0) {
+  if (keepEvery > 1 || compressWhileReading)
+    _pointsCount = kept;
+  _accountPoints();
+
+  // drop noise and redundant points before anything is built from them;
+  // kept points keep their row index, and their normals
+  if (!_options.streamVoxels && !_options.filter.isEmpty()) {
+    PointFilter filter(_options.filter);
+    filter.setNormals(readNormals ? _normalsData.data() : nullptr);
+    _pointsCount = filter.apply(_pointsData.data(), _pointsCount);
     _pointsData.resize(_pointsCount * POINT_STRIDE);
-
-    std::stringstream ss;
-    float *p = _pointsData.data();
-    for (size_t i = 0; is.good() && i < _pointsCount; ++i) {
-      float x, y, z, nx, ny, nz, r, g, b;
-      std::getline(is, line);
-      ss.str(line);
-
-      ss >> x >> y >> z >> nx >> ny >> nz >> r >> g >> b;
-
-      *p++ = x;
-      *p++ = y;
-      *p++ = z;
-      *p++ = i;
-      *p++ = r/255.;
-      *p++ = g/255.;
-      *p++ = b/255.;
-
-      ss.clear();
-
-      // update bounds
-      _pointsBoundMax[0] = std::max(x, _pointsBoundMax[0]);
-      _pointsBoundMax[1] = std::max(y, _pointsBoundMax[1]);
-      _pointsBoundMax[2] = std::max(z, _pointsBoundMax[2]);
-      _pointsBoundMin[0] = std::min(x, _pointsBoundMin[0]);
-      _pointsBoundMin[1] = std::min(y, _pointsBoundMin[1]);
-      _pointsBoundMin[2] = std::min(z, _pointsBoundMin[2]);
+    _pointsData.squeeze();
+    if (_options.normals) {
+      _normalsData.resize(_pointsCount);
+      _normalsData.shrink_to_fit();
     }
+    _accountPoints();
+    _resetBounds();
+    _updateBounds(_pointsData.constData(), _pointsCount);
+  }
 
-    // check if we've got exact number of points mentioned in header
-    if (p - _pointsData.data() < _pointsData.size()) {
-      throw std::runtime_error("broken ply file");
-    }
+  // a cloud without normals gets them from its filtered points
+  if (_options.normals && !readNormals) {
+    QElapsedTimer timer;
+    timer.start();
+    NormalEstimator().estimate(_pointsData.constData(), _pointsCount, _normalsData.data());
+    TaskPool::instance().reportTiming("normal estimation", timer.nsecsElapsed() * 1e-6);
+  }
+
+  if (compress && !compressWhileReading) {
+    compressionTimer.start();
+    _pointStore.reset(new PointStore(_options.compressPoints));
+    _pointStore->append(_pointsData.constData(), _pointsCount, _options.normals ? _normalsData.data() : nullptr);
+    QVector<float>().swap(_pointsData);
+    compressionMs = compressionTimer.nsecsElapsed() * 1e-6;
+    _accountPoints();
   }
+  if (compress)
+    TaskPool::instance().reportTiming("point compression", compressionMs);
 }
 
+void Scene::_accountPoints() {
+  _pointsMemory.set(_pointsData.capacity() * sizeof(float) + _normalsData.capacity() * sizeof(uint32_t)
+                    + (_pointStore ? _pointStore->memorySize() : 0));
+}
+
+void Scene::forEachPoints(const std::function<void(const float* points, size_t first, size_t count)>& body) const {
+  if (_pointStore) {
+    _pointStore->forEach(PLY_BATCH, body);
+  } else if (_pointsCount > 0 && !_options.streamVoxels) {
+    body(_pointsData.constData(), 0, _pointsCount);
+  }
+}
+
+void Scene::_resetBounds() {
+  _pointsBoundMax[0] = std::numeric_limits<float>::lowest();
+  _pointsBoundMax[1] = std::numeric_limits<float>::lowest();
+  _pointsBoundMax[2] = std::numeric_limits<float>::lowest();
+  _pointsBoundMin[0] = std::numeric_limits<float>::max();
+  _pointsBoundMin[1] = std::numeric_limits<float>::max();
+  _pointsBoundMin[2] = std::numeric_limits<float>::max();
+}
+
+void Scene::_updateBounds(const float* points, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    const float *p = points + i * POINT_STRIDE;
+    _pointsBoundMax[0] = std::max(p[0], _pointsBoundMax[0]);
+    _pointsBoundMax[1] = std::max(p[1], _pointsBoundMax[1]);
+    _pointsBoundMax[2] = std::max(p[2], _pointsBoundMax[2]);
+    _pointsBoundMin[0] = std::min(p[0], _pointsBoundMin[0]);
+    _pointsBoundMin[1] = std::min(p[1], _pointsBoundMin[1]);
+    _pointsBoundMin[2] = std::min(p[2], _pointsBoundMin[2]);
+  }
+}
+
+
+void Scene::_fitSpace() {
+  // the cube holding every point, empty until there is one
+  _spaceSize = 0.f;
+  if (_pointsBoundMin[0] <= _pointsBoundMax[0]) {
+    _spaceSize = qMax(qMax(_pointsBoundMax[0] - _pointsBoundMin[0],_pointsBoundMax[1] - _pointsBoundMin[1]), _pointsBoundMax[2] - _pointsBoundMin[2]);
+  }
+  _createVox();
+}
+
+void Scene::_ingestLivePoints() {
+  _liveBatch.clear();
+  const size_t n = _liveStream->take(_liveBatch, LIVE_POINTS_PER_FRAME);
+  if (n == 0)
+    return;
+
+  // the CPU copy takes the same slots, so intersect() and export see the ring
+  const size_t filled = std::min(_livePoints.written() + n, _livePoints.capacity());
+  if (size_t(_pointsData.size()) < filled * POINT_STRIDE)
+    _pointsData.resize(filled * POINT_STRIDE);
+  _livePoints.append(_liveBatch.data(), n, _pointsData.data());
+  _pointsCount = _livePoints.size();
+  _sourcePointsCount = _liveStream->receivedCount();
+
+  // bounds only grow, overwritten points still count
+  const QVector3D boundMin = _pointsBoundMin, boundMax = _pointsBoundMax;
+  _updateBounds(_liveBatch.data(), n);
+  if (boundMin != _pointsBoundMin || boundMax != _pointsBoundMax) {
+    _fitSpace();
+    _voxVerticesDirty = true;
+  }
+  emit pointsChanged();
+
+  // more than a frame's worth arrived
+  if (_liveStream->pendingCount() > 0)
+    update();
+}
 
 void Scene::_loadBundle(const QString& bundleFilePath)
 {
@@ -179,6 +492,35 @@ void Scene::_loadBundle(const QString& bundleFilePath)
         _listView.append(RT);
         _listProjection.append(createPerspectiveMatrix(_fov_v.at(i), h / w, 0.01f, 100.0f));
     }
+    _cameraEnabled.assign(_listView.length(), 1);
+    _updateCameras();
+}
+
+void Scene::_updateCameras()
+{
+    _cameras.clear();
+    _cameraCentres.clear();
+    _cameraViews.clear();
+    for (int i = 0; i < _listProjection.length(); i++) {
+        if (!_cameraEnabled[i])
+            continue;
+        _cameraViews.push_back(uint32_t(i));
+        const QMatrix4x4 projectionView = _listProjection.at(i) * _listView.at(i);
+        _cameras.add(projectionView.constData());
+        const QVector4D centre = _listView.at(i).inverted().column(3);
+        _cameraCentres.push_back(centre.x());
+        _cameraCentres.push_back(centre.y());
+        _cameraCentres.push_back(centre.z());
+    }
+}
+
+std::vector<const Silhouette*> Scene::_cameraMasks() const
+{
+    std::vector<const Silhouette*> masks;
+    for (uint32_t view : _cameraViews) {
+        masks.push_back(&_masks[view]);
+    }
+    return masks;
 }
 
 void Scene::_createVox() {
@@ -251,7 +593,12 @@ QMatrix4x4 Scene::createPerspectiveMatrix(float fov_v, float aspect, float near,
 
 Scene::~Scene()
 {
+  _liveStream.reset();
+  _masksLoading->cancel();
+  _masksLoading.reset();
   _cleanup();
+  delete _indicesBufferVox;
+  delete [] _voxStorage;
 }
 
 
@@ -262,16 +609,42 @@ void Scene::_cleanup()
 
   makeCurrent();
   _vertexBufferPoints.destroy();
+  _vertexBufferNormals.destroy();
+  _livePoints.destroy();
+  _gpuPointsMemory.set(0);
+  _gpuMeshMemory.set(0);
+  _occupancyTexture.reset();
+  _gpuOccupancyMemory.set(0);
+  _pyramidTexture.reset();
+  _gpuPyramidMemory.set(0);
+  _voxelColorsTexture.reset();
+  _gpuVoxelColorsMemory.set(0);
+  _occupancyDirty = _pyramidDirty = _voxelColorsDirty = true;
+  _shadersRaymarch.reset();
+  _vertexBufferDistances.destroy();
+  _gpuDistancesMemory.set(0);
+  _distancesFirst = NO_DISTANCES;
   _shadersPoints.reset();
-  delete _indicesBufferVox;
-  delete [] _voxStorage;
-  delete [] tmp;
+  _splatBuffer.reset();
+  _vertexBufferResolve.destroy();
+  _shadersResolve.reset();
+  _vertexBufferMesh.destroy();
+  _indicesBufferMesh.destroy();
+  _shadersMesh.reset();
+  _vaoVox.destroy();
+  _vaoSpace.destroy();
+  _vertexBufferVox.destroy();
+  _vertexBufferSpace.destroy();
+  _indicesBufferVox->destroy();
+  _shadersVox.reset();
   doneCurrent();
 }
 
 
 void Scene::initializeGL()
 {
+  QElapsedTimer timer;
+  timer.start();
   connect(context(), &QOpenGLContext::aboutToBeDestroyed, this, &Scene::_cleanup);
 
   initializeOpenGLFunctions();
@@ -284,26 +657,60 @@ void Scene::initializeGL()
   // create points shaders and map attributes
   //
   _shadersPoints.reset(new QOpenGLShaderProgram());
-  auto vsPointsLoaded = _shadersPoints->addShaderFromSourceFile(QOpenGLShader::Vertex, ":/vertex_shader_points.glsl");
-  auto fsPointsLoaded = _shadersPoints->addShaderFromSourceFile(QOpenGLShader::Fragment, ":/fragment_shader_points.glsl");
+  auto vsPointsLoaded = _shadersPoints->addCacheableShaderFromSourceFile(QOpenGLShader::Vertex, ":/vertex_shader_points.glsl");
+  auto fsPointsLoaded = _shadersPoints->addCacheableShaderFromSourceFile(QOpenGLShader::Fragment, ":/fragment_shader_points.glsl");
   assert(vsPointsLoaded && fsPointsLoaded);
   // vector attributes
   _shadersPoints->bindAttributeLocation("vertex", 0);
   _shadersPoints->bindAttributeLocation("pointRowIndex", 1);
   _shadersPoints->bindAttributeLocation("color", 2);
-  // constants
-  _shadersPoints->bind();
-  _shadersPoints->setUniformValue("lightPos", QVector3D(0, 0, 50));
-  _shadersPoints->setUniformValue("pointsCount", static_cast<GLfloat>(_pointsCount));
+  _shadersPoints->bindAttributeLocation("normal", 3);
+  _shadersPoints->bindAttributeLocation("referenceDistance", 4);
+  // uniforms are set per frame, once linked
   _shadersPoints->link();
-  _shadersPoints->release();
+
+  // blending splats needs float colour targets to sum into
+  QOpenGLContext *ctx = context();
+  if (!ctx->isOpenGLES())
+    _multiDrawArrays = reinterpret_cast<MultiDrawArrays>(ctx->getProcAddress("glMultiDrawArrays"));
+  _hasRaymarching = !ctx->isOpenGLES() && ctx->format().majorVersion() >= 3;
+  emit raymarchingChecked(_hasRaymarching);
+  _hasFloatTargets = !ctx->isOpenGLES() && QOpenGLFramebufferObject::hasOpenGLFramebufferObjects()
+      && (ctx->format().majorVersion() >= 3
+          || (ctx->hasExtension("GL_ARB_texture_float") && ctx->hasExtension("GL_ARB_color_buffer_float")));
+
+  _shadersResolve.reset(new QOpenGLShaderProgram());
+  auto vsResolveLoaded = _shadersResolve->addCacheableShaderFromSourceFile(QOpenGLShader::Vertex, ":/vertex_shader_resolve.glsl");
+  auto fsResolveLoaded = _shadersResolve->addCacheableShaderFromSourceFile(QOpenGLShader::Fragment, ":/fragment_shader_resolve.glsl");
+  assert(vsResolveLoaded && fsResolveLoaded);
+  _shadersResolve->bindAttributeLocation("vertex", 0);
+  _shadersResolve->link();
+
+  // a quad covering the view
+  const GLfloat resolveQuad[] = { -1.f, -1.f, 1.f, -1.f, -1.f, 1.f, 1.f, 1.f };
+  _vaoResolve.create();
+  _vaoResolve.bind();
+  _vertexBufferResolve.create();
+  _vertexBufferResolve.bind();
+  _vertexBufferResolve.allocate(resolveQuad, sizeof(resolveQuad));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+  _vertexBufferResolve.release();
+  _vaoResolve.release();
 
   // create array container and load points into buffer
   _vaoPoints.create();
   _vaoPoints.bind();
-  _vertexBufferPoints.create();
-  _vertexBufferPoints.bind();
-  _vertexBufferPoints.allocate(_pointsData.constData(), _pointsData.size() * sizeof(GLfloat));
+  if (_liveStream) {
+    _livePoints.create(_options.liveCapacity);
+  } else {
+    // filled by _uploadScans() a slice per frame
+    _vertexBufferPoints.create();
+    _vertexBufferPoints.bind();
+    _vertexBufferPoints.allocate(int(_workspace->arena().capacity() * POINT_STRIDE * sizeof(GLfloat)));
+  }
+  const size_t bufferPoints = _liveStream ? _options.liveCapacity : _workspace->arena().capacity();
+  _gpuPointsMemory.set(bufferPoints * POINT_STRIDE * sizeof(GLfloat));
   QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
   f->glEnableVertexAttribArray(0);
   f->glEnableVertexAttribArray(1);
@@ -314,9 +721,52 @@ void Scene::initializeGL()
   f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 7*sizeof(GLfloat), (GLvoid*)vertex_offset);
   f->glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 7*sizeof(GLfloat), (GLvoid*)pointRowIndex_offset);
   f->glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 7*sizeof(GLfloat), (GLvoid*)color_offset);
-  _vertexBufferPoints.release();
+  if (_liveStream) {
+    _livePoints.release();
+  } else {
+    _vertexBufferPoints.release();
+  }
+  if (_workspace && _workspace->hasNormals()) {
+    // a short pair per point, the octahedral normal; enabled by _renderPoints()
+    _vertexBufferNormals.create();
+    _vertexBufferNormals.bind();
+    _vertexBufferNormals.allocate(int(_workspace->arena().capacity() * sizeof(uint32_t)));
+    f->glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, 0, (GLvoid*)0);
+    _vertexBufferNormals.release();
+    _gpuPointsMemory.set(bufferPoints * (POINT_STRIDE * sizeof(GLfloat) + sizeof(uint32_t)));
+  }
   _vaoPoints.release();
 
+  //
+  // create surface shaders, the mesh itself is uploaded once extracted
+  //
+  _shadersMesh.reset(new QOpenGLShaderProgram());
+  auto vsMeshLoaded = _shadersMesh->addCacheableShaderFromSourceFile(QOpenGLShader::Vertex, ":/vertex_shader_mesh.glsl");
+  auto fsMeshLoaded = _shadersMesh->addCacheableShaderFromSourceFile(QOpenGLShader::Fragment, ":/fragment_shader_mesh.glsl");
+  assert(vsMeshLoaded && fsMeshLoaded);
+  _shadersMesh->bindAttributeLocation("vertex", 0);
+  _shadersMesh->bindAttributeLocation("normal", 1);
+  _shadersMesh->link();
+
+  _vaoMesh.create();
+  _vaoMesh.bind();
+  _vertexBufferMesh.create();
+  _vertexBufferMesh.bind();
+  QOpenGLFunctions *m = QOpenGLContext::currentContext()->functions();
+  m->glEnableVertexAttribArray(0);
+  m->glEnableVertexAttribArray(1);
+  m->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (GLvoid*)0);
+  m->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (GLvoid*)(3*sizeof(GLfloat)));
+  _indicesBufferMesh.create();
+  _indicesBufferMesh.bind();
+  _vaoMesh.release();
+
+  // voxel and space resources wait for _createVoxResources()
+  TaskPool::instance().reportTiming("initializeGL", timer.nsecsElapsed() * 1e-6);
+}
+
+void Scene::_createVoxResources()
+{
   //
   // create voxels shaders
   //
@@ -326,10 +776,7 @@ void Scene::initializeGL()
   assert(vsVoxLoaded && fsVoxLoaded);
   // vector attributes
   _shadersVox->bindAttributeLocation("vertex", 0);
-  // constants
-  _shadersVox->bind();
   _shadersVox->link();
-  _shadersVox->release();
 
   // create array container and load voxels into buffer
   _vaoVox.create();
@@ -337,9 +784,8 @@ void Scene::initializeGL()
   _vertexBufferVox.create();
   _vertexBufferVox.bind();
   _vertexBufferVox.allocate(_voxVertices.constData(), _voxVertices.size() * sizeof(GLfloat));
-  QOpenGLFunctions *g = QOpenGLContext::currentContext()->functions();
-  g->glEnableVertexAttribArray(0);
-  g->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
 
   _indicesBufferVox->create();
   _indicesBufferVox->bind();
@@ -347,20 +793,32 @@ void Scene::initializeGL()
   _vaoVox.release();
 
   //
-  // create array container and load voxels into buffer
+  // create array container and load space into buffer, sharing the cube's indices
   //
   _vaoSpace.create();
   _vaoSpace.bind();
   _vertexBufferSpace.create();
   _vertexBufferSpace.bind();
   _vertexBufferSpace.allocate(_spaceVertices.constData(), _spaceVertices.size() * sizeof(GLfloat));
-  QOpenGLFunctions *h = QOpenGLContext::currentContext()->functions();
-  h->glEnableVertexAttribArray(0);
-  h->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
   _indicesBufferVox->bind();
-  _indicesBufferVox->allocate(_voxIndices.constData(), _voxIndices.size() * sizeof(GLuint));
   _vaoSpace.release();
+
+  // raymarched voxels draw the resolve quad; a driver without GLSL 1.30
+  // keeps the cubes
+  if (_hasRaymarching) {
+    _shadersRaymarch.reset(new QOpenGLShaderProgram());
+    _shadersRaymarch->bindAttributeLocation("vertex", 0);
+    if (!_shadersRaymarch->addCacheableShaderFromSourceFile(QOpenGLShader::Vertex, ":/vertex_shader_raymarch.glsl")
+        || !_shadersRaymarch->addCacheableShaderFromSourceFile(QOpenGLShader::Fragment, ":/fragment_shader_raymarch.glsl")
+        || !_shadersRaymarch->link()) {
+      _hasRaymarching = false;
+      emit raymarchingChecked(false);
+    }
+  }
+
+  _voxVerticesDirty = false;
 }
 
 void Scene::paintGL()
@@ -370,44 +828,66 @@ void Scene::paintGL()
   glEnable(GL_DEPTH_TEST);
   glDepthFunc(GL_LESS);
   glEnable(GL_VERTEX_PROGRAM_POINT_SIZE); //required for gl_PointSize
+  if (!context()->isOpenGLES() && context()->format().profile() != QSurfaceFormat::CoreProfile)
+    glEnable(POINT_SPRITE);
 
   //
   // set camera
   //
   const auto viewMatrix = _projectionMatrix *  _currentCamera.viewMatrix() * _worldMatrix;
 
+  if (_liveStream)
+    _ingestLivePoints();
+  if (_workspace)
+    _uploadScans();
+
+  // voxel and space cubes are built once first shown, then follow the grid
+  // size and the bounds
+  if ((_drawVoxels || _drawSpace) && !_vaoVox.isCreated()) {
+      _createVoxResources();
+  } else if (_voxVerticesDirty && _vaoVox.isCreated()) {
+      _vertexBufferVox.bind();
+      _vertexBufferVox.allocate(_voxVertices.constData(), _voxVertices.size() * sizeof(GLfloat));
+      _vertexBufferVox.release();
+      _vertexBufferSpace.bind();
+      _vertexBufferSpace.allocate(_spaceVertices.constData(), _spaceVertices.size() * sizeof(GLfloat));
+      _vertexBufferSpace.release();
+      _voxVerticesDirty = false;
+  }
+
   //
   // draw points cloud
   //
   if (_drawPoints){
-      _vaoPoints.bind();
-      _shadersPoints->bind();
-      _shadersPoints->setUniformValue("pointsCount", static_cast<GLfloat>(_pointsCount));
-      _shadersPoints->setUniformValue("mvpMatrix", viewMatrix);
-      _shadersPoints->setUniformValue("pointSize", _pointSize);
-      glDrawArrays(GL_POINTS, 0, _pointsData.size());
-      _shadersPoints->release();
-      _vaoPoints.release();
+      _renderPoints(_currentCamera.viewMatrix() * _worldMatrix);
   }
 
     //
     // draw voxels
     //
-  if(_drawVoxels) {
-
-
+  if (_drawVoxels && _hasRaymarching && _voxelRendering != VoxelsCubes) {
+      _renderRaymarchedVoxels(viewMatrix);
+  } else if(_drawVoxels) {
       _vaoVox.bind();
       _shadersVox->bind();
       _shadersVox->setUniformValue("mvpMatrix", viewMatrix);
       float voxSize = _spaceSize/_nbVox;
+      // paint voxels with the mean colour of their points once intersected
+      const bool hasColors = _voxelizer.finalized() && _voxelizer.nbVox() == _nbVox;
       for ( int i = 0; i < _nbVox; i++){
           for (int j = 0; j < _nbVox; j++) {
               for (int k = 0; k < _nbVox; k++) {
-                  if (_voxStorage[i*_nbVox*_nbVox + j*_nbVox + k]) {
+                  const int v = i*_nbVox*_nbVox + j*_nbVox + k;
+                  if (_voxStorage[v]) {
                       _shadersVox->setUniformValue("xt", _pointsBoundMin[0]+i*voxSize);
                       _shadersVox->setUniformValue("yt", _pointsBoundMin[1]+j*voxSize);
                       _shadersVox->setUniformValue("zt", _pointsBoundMin[2]+k*voxSize);
                       _shadersVox->setUniformValue("flag", 1);
+                      const float *voxColor = hasColors ? _voxelizer.color(v) : nullptr;
+                      if (voxColor)
+                          _shadersVox->setUniformValue("voxColor", QVector3D(voxColor[0], voxColor[1], voxColor[2]));
+                      else
+                          _shadersVox->setUniformValue("voxColor", QVector3D(1., 1., 1.));
                       glDrawElements(GL_TRIANGLES, 12*3, GL_UNSIGNED_INT, (GLvoid*)0);
                   }
               }
@@ -439,6 +919,27 @@ void Scene::paintGL()
 
   }
 
+  //
+  // draw extracted surface, a single indexed draw
+  //
+  if (_drawSurface) {
+      _vaoMesh.bind();
+      if (_meshDirty) {
+          _vertexBufferMesh.bind();
+          _vertexBufferMesh.allocate(_mesh.vertices.data(), _mesh.vertices.size() * sizeof(GLfloat));
+          _indicesBufferMesh.bind();
+          _indicesBufferMesh.allocate(_mesh.indices.data(), _mesh.indices.size() * sizeof(GLuint));
+          _gpuMeshMemory.set(_mesh.vertices.size() * sizeof(GLfloat) + _mesh.indices.size() * sizeof(GLuint));
+          _meshDirty = false;
+      }
+      _shadersMesh->bind();
+      _shadersMesh->setUniformValue("mvpMatrix", viewMatrix);
+      _shadersMesh->setUniformValue("lightPos", _currentCamera.viewMatrix().inverted().column(3).toVector3D());
+      glDrawElements(GL_TRIANGLES, _mesh.indices.size(), GL_UNSIGNED_INT, (GLvoid*)0);
+      _shadersMesh->release();
+      _vaoMesh.release();
+  }
+
   //
   // draw voxels space
   //
@@ -462,10 +963,350 @@ void Scene::paintGL()
 
 }
 
+void Scene::_renderPoints(const QMatrix4x4& modelViewMatrix)
+{
+  if (_workspace)
+    _workspace->drawRanges(_drawFirsts, _drawCounts);
+  PointRendering rendering = _pointRendering;
+  if (rendering == PointsBlended && !_hasFloatTargets)
+    rendering = PointsDepthPrepass;
+
+  _vaoPoints.bind();
+  _shadersPoints->bind();
+  _shadersPoints->setUniformValue("pointsCount", static_cast<GLfloat>(_pointsCount));
+  _shadersPoints->setUniformValue("modelViewMatrix", modelViewMatrix);
+  _shadersPoints->setUniformValue("projectionMatrix", _projectionMatrix);
+  _shadersPoints->setUniformValue("pointSize", _pointSize);
+  _shadersPoints->setUniformValue("roundPoints", _roundPoints);
+  _shadersPoints->setUniformValue("accumulate", false);
+  _shadersPoints->setUniformValue("depthOffset", 0.f);
+
+  // unlit points leave the normals buffer alone
+  const bool lit = _lightPoints && _vertexBufferNormals.isCreated();
+  if (lit) {
+    glEnableVertexAttribArray(3);
+  } else {
+    glDisableVertexAttribArray(3);
+  }
+  _shadersPoints->setUniformValue("lit", lit);
+
+  // likewise the distances, uploaded the first time they are shown
+  // and written again wherever the config's points are resident now
+  const bool showDistances = _showDistances && !_distances.empty() && _workspace;
+  if (showDistances) {
+    const Workspace::Scan& points = _workspace->scan(0);
+    const size_t first = points.state == Workspace::Resident ? points.first : NO_DISTANCES;
+    if (_distancesDirty || first != _distancesFirst)
+      _uploadDistances(first);
+    glEnableVertexAttribArray(4);
+    _shadersPoints->setUniformValue("referenceRange", std::max(_distanceRange, std::numeric_limits<float>::min()));
+  } else {
+    glDisableVertexAttribArray(4);
+  }
+  _shadersPoints->setUniformValue("showDistances", showDistances);
+
+  // the grid's origin and size follow the bounds, only its bytes need uploading;
+  // points are left alone when the texture is over the budget
+  if (_pointClassification != ClassifyNone && _occupancyDirty)
+    _uploadOccupancy();
+  const bool classify = _pointClassification != ClassifyNone && !_occupancyTexture.isNull();
+  _shadersPoints->setUniformValue("classification", classify ? int(_pointClassification) : 0);
+  if (classify) {
+    _occupancyTexture->bind(OCCUPANCY_TEXTURE_UNIT, QOpenGLTexture::ResetTextureUnit);
+    _shadersPoints->setUniformValue("occupancy", OCCUPANCY_TEXTURE_UNIT);
+    _shadersPoints->setUniformValue("gridOrigin", _pointsBoundMin);
+    _shadersPoints->setUniformValue("gridSize", _spaceSize);
+  }
+
+  if (rendering == PointsDirect) {
+    _drawPointRanges();
+
+  } else if (rendering == PointsDepthPrepass) {
+    // nearest depth only, then shade the fragments that reach it; the same
+    // program computes the same depths in both passes
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    _drawPointRanges();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    _drawPointRanges();
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+
+  } else {
+    const QSize size = this->size() * devicePixelRatio();
+    if (_splatBuffer.isNull() || _splatBuffer->size() != size) {
+      _splatBuffer.reset(new QOpenGLFramebufferObject(size, QOpenGLFramebufferObject::Depth, GL_TEXTURE_2D, SPLAT_FORMAT));
+    }
+    _splatBuffer->bind();
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glClearColor(0, 0, 0, 1.0);
+
+    // visibility: the nearest depth, pushed back by the splat depth
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    _shadersPoints->setUniformValue("depthOffset", _spaceSize * SPLAT_DEPTH);
+    _drawPointRanges();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    // sum the weighted colours of every splat in front of it
+    _shadersPoints->setUniformValue("depthOffset", 0.f);
+    _shadersPoints->setUniformValue("accumulate", true);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    _drawPointRanges();
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    _splatBuffer->release();
+
+    // divide the sums into the view, then give it the points' depth for
+    // whatever is drawn next
+    glDisable(GL_DEPTH_TEST);
+    _vaoResolve.bind();
+    _shadersResolve->bind();
+    _shadersResolve->setUniformValue("accumulation", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _splatBuffer->texture());
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    _shadersResolve->release();
+    _vaoResolve.release();
+    glEnable(GL_DEPTH_TEST);
+
+    _vaoPoints.bind();
+    _shadersPoints->bind();
+    _shadersPoints->setUniformValue("accumulate", false);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    _drawPointRanges();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  }
+
+  _shadersPoints->release();
+  _vaoPoints.release();
+  if (_liveStream)
+    _livePoints.fence();
+}
+
+bool Scene::_texturesFit(size_t bytes, size_t released) const
+{
+  const size_t held = _gpuOccupancyMemory.bytes() + _gpuPyramidMemory.bytes() + _gpuVoxelColorsMemory.bytes();
+  return held - released + bytes <= _options.textureBudget * (size_t(1) << 20);
+}
+
+void Scene::_uploadOccupancy()
+{
+  // a byte per voxel; z varies fastest in _voxStorage, so it is the width
+  _occupancyDirty = false;
+  const size_t cells = size_t(_nbVox) * _nbVox * _nbVox;
+  if (!_texturesFit(cells, _gpuOccupancyMemory.bytes())) {
+    std::cerr << "voxels: a " << _nbVox << "^3 occupancy texture exceeds texture_budget" << std::endl;
+    _occupancyTexture.reset();
+    _gpuOccupancyMemory.set(0);
+    return;
+  }
+  if (_occupancyTexture.isNull() || _occupancyTexture->width() != _nbVox) {
+    _occupancyTexture.reset(new QOpenGLTexture(QOpenGLTexture::Target3D));
+    _occupancyTexture->setSize(_nbVox, _nbVox, _nbVox);
+    _occupancyTexture->setFormat(QOpenGLTexture::R8_UNorm);
+    _occupancyTexture->setMipLevels(1);
+    _occupancyTexture->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+    _occupancyTexture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    _occupancyTexture->allocateStorage(QOpenGLTexture::Red, QOpenGLTexture::UInt8);
+    _gpuOccupancyMemory.set(cells);
+  }
+  QOpenGLPixelTransferOptions transfer;
+  transfer.setAlignment(1);
+  _occupancyTexture->setData(QOpenGLTexture::Red, QOpenGLTexture::UInt8, _voxStorage, &transfer);
+}
+
+void Scene::_renderRaymarchedVoxels(const QMatrix4x4& mvpMatrix)
+{
+  // textures follow the grid, its origin and size are uniforms; over the
+  // budget, rays step through every voxel and faces are white
+  if (_occupancyDirty)
+    _uploadOccupancy();
+  if (_occupancyTexture.isNull())
+    return;
+  const bool skip = _voxelRendering == VoxelsRaymarchedSkipping;
+  if (skip && _pyramidDirty)
+    _uploadOccupancyPyramid();
+  const bool skipping = skip && !_pyramidTexture.isNull();
+  const bool colored = _voxelizer.finalized() && _voxelizer.nbVox() == _nbVox;
+  if (colored && _voxelColorsDirty)
+    _uploadVoxelColors();
+  const bool hasColors = colored && !_voxelColorsTexture.isNull();
+
+  const QSize size = this->size() * devicePixelRatio();
+  _vaoResolve.bind();
+  _shadersRaymarch->bind();
+  _shadersRaymarch->setUniformValue("mvpMatrix", mvpMatrix);
+  _shadersRaymarch->setUniformValue("inverseMvp", mvpMatrix.inverted());
+  _shadersRaymarch->setUniformValue("pixelNdc", QVector2D(2.f / size.width(), 2.f / size.height()));
+  _shadersRaymarch->setUniformValue("gridOrigin", _pointsBoundMin);
+  _shadersRaymarch->setUniformValue("voxelSize", _spaceSize / _nbVox);
+  _shadersRaymarch->setUniformValue("nbVox", _nbVox);
+  _occupancyTexture->bind(OCCUPANCY_TEXTURE_UNIT, QOpenGLTexture::ResetTextureUnit);
+  _shadersRaymarch->setUniformValue("occupancy", OCCUPANCY_TEXTURE_UNIT);
+  _shadersRaymarch->setUniformValue("pyramid", PYRAMID_TEXTURE_UNIT);
+  _shadersRaymarch->setUniformValue("pyramidLevels", skipping ? _pyramidTexture->mipLevels() : 0);
+  if (skipping)
+    _pyramidTexture->bind(PYRAMID_TEXTURE_UNIT, QOpenGLTexture::ResetTextureUnit);
+  _shadersRaymarch->setUniformValue("colors", VOXEL_COLORS_TEXTURE_UNIT);
+  _shadersRaymarch->setUniformValue("hasColors", hasColors);
+  if (hasColors)
+    _voxelColorsTexture->bind(VOXEL_COLORS_TEXTURE_UNIT, QOpenGLTexture::ResetTextureUnit);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  _shadersRaymarch->release();
+  _vaoResolve.release();
+}
+
+void Scene::_uploadOccupancyPyramid()
+{
+  QElapsedTimer timer;
+  timer.start();
+  _pyramidDirty = false;
+  const size_t bytes = OccupancyPyramid::memorySize(_nbVox);
+  if (!MemoryBudget::instance().fits(bytes) || !_texturesFit(bytes, _gpuPyramidMemory.bytes())) {
+    std::cerr << "voxels: the occupancy pyramid exceeds the memory budget or texture_budget" << std::endl;
+    _pyramidTexture.reset();
+    _gpuPyramidMemory.set(0);
+    return;
+  }
+  OccupancyPyramid pyramid;
+  MemoryAccount pyramidMemory(MemoryBudget::Voxels);
+  pyramidMemory.set(bytes);
+  pyramid.build(_voxStorage, _nbVox);
+  const int size = pyramid.levelSize(0);
+  if (_pyramidTexture.isNull() || _pyramidTexture->width() != size) {
+    _pyramidTexture.reset(new QOpenGLTexture(QOpenGLTexture::Target3D));
+    _pyramidTexture->setSize(size, size, size);
+    _pyramidTexture->setFormat(QOpenGLTexture::RG8_UNorm);
+    _pyramidTexture->setMipLevels(pyramid.levelsCount());
+    _pyramidTexture->setMinMagFilters(QOpenGLTexture::NearestMipMapNearest, QOpenGLTexture::Nearest);
+    _pyramidTexture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    _pyramidTexture->allocateStorage(QOpenGLTexture::RG, QOpenGLTexture::UInt8);
+    _gpuPyramidMemory.set(pyramid.memorySize());
+  }
+  QOpenGLPixelTransferOptions transfer;
+  transfer.setAlignment(1);
+  for (int level = 0; level < pyramid.levelsCount(); level++) {
+    _pyramidTexture->setData(level, QOpenGLTexture::RG, QOpenGLTexture::UInt8, pyramid.level(level), &transfer);
+  }
+  TaskPool::instance().reportTiming("occupancy pyramid", timer.nsecsElapsed() * 1e-6);
+}
+
+void Scene::_uploadVoxelColors()
+{
+  // as bytes, white where no point fell like the cubes; none at all when
+  // they do not fit, on the host while converting or on the GPU
+  _voxelColorsDirty = false;
+  const size_t cells = size_t(_nbVox) * _nbVox * _nbVox;
+  if (!MemoryBudget::instance().fits(cells * 3) || !_texturesFit(cells * 3, _gpuVoxelColorsMemory.bytes())) {
+    std::cerr << "voxels: colours of a " << _nbVox << "^3 grid exceed the memory budget or texture_budget" << std::endl;
+    _voxelColorsTexture.reset();
+    _gpuVoxelColorsMemory.set(0);
+    return;
+  }
+  std::vector<unsigned char> bytes(cells * 3);
+  MemoryAccount bytesMemory(MemoryBudget::Voxels);
+  bytesMemory.set(bytes.size());
+  TaskPool::instance().parallelFor(0, cells, [&](size_t begin, size_t end) {
+    for (size_t v = begin; v < end; v++) {
+      const float *color = _voxelizer.color(v);
+      for (int c = 0; c < 3; c++) {
+        const float value = color ? color[c] : 1.f;
+        bytes[v * 3 + c] = static_cast<unsigned char>(std::min(std::max(value, 0.f), 1.f) * 255.f + .5f);
+      }
+    }
+  });
+
+  if (_voxelColorsTexture.isNull() || _voxelColorsTexture->width() != _nbVox) {
+    _voxelColorsTexture.reset(new QOpenGLTexture(QOpenGLTexture::Target3D));
+    _voxelColorsTexture->setSize(_nbVox, _nbVox, _nbVox);
+    _voxelColorsTexture->setFormat(QOpenGLTexture::RGB8_UNorm);
+    _voxelColorsTexture->setMipLevels(1);
+    _voxelColorsTexture->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+    _voxelColorsTexture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    _voxelColorsTexture->allocateStorage(QOpenGLTexture::RGB, QOpenGLTexture::UInt8);
+    _gpuVoxelColorsMemory.set(cells * 3);
+  }
+  QOpenGLPixelTransferOptions transfer;
+  transfer.setAlignment(1);
+  _voxelColorsTexture->setData(QOpenGLTexture::RGB, QOpenGLTexture::UInt8, bytes.data(), &transfer);
+}
+
+void Scene::_uploadDistances(size_t first)
+{
+  // the scans have none, they keep their colours
+  const size_t capacity = _workspace->arena().capacity();
+  if (!_vertexBufferDistances.isCreated()) {
+    const std::vector<GLfloat> none(capacity, -1.f);
+    _vertexBufferDistances.create();
+    _vertexBufferDistances.bind();
+    _vertexBufferDistances.allocate(none.data(), int(capacity * sizeof(GLfloat)));
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+    _gpuDistancesMemory.set(capacity * sizeof(GLfloat));
+  } else {
+    _vertexBufferDistances.bind();
+  }
+  // the config's points are the first scan; where they were before, another
+  // scan may have been loaded since
+  if (_distancesFirst != NO_DISTANCES && _distancesFirst != first) {
+    const std::vector<GLfloat> none(_distances.size(), -1.f);
+    _vertexBufferDistances.write(int(_distancesFirst * sizeof(GLfloat)), none.data(),
+                                 int(none.size() * sizeof(GLfloat)));
+  }
+  if (first != NO_DISTANCES) {
+    _vertexBufferDistances.write(int(first * sizeof(GLfloat)), _distances.data(),
+                                 int(_distances.size() * sizeof(GLfloat)));
+  }
+  _vertexBufferDistances.release();
+  _distancesFirst = first;
+  _distancesDirty = false;
+}
+
+void Scene::_drawPointRanges()
+{
+  if (_liveStream) {
+    glDrawArrays(GL_POINTS, 0, _livePoints.size());
+  } else if (_multiDrawArrays) {
+    _multiDrawArrays(GL_POINTS, _drawFirsts.data(), _drawCounts.data(), GLsizei(_drawFirsts.size()));
+  } else {
+    for (size_t i = 0; i < _drawFirsts.size(); i++) {
+      glDrawArrays(GL_POINTS, _drawFirsts[i], _drawCounts[i]);
+    }
+  }
+}
+
+void Scene::_uploadScans()
+{
+  const size_t revision = _workspace->revision();
+  _vertexBufferPoints.bind();
+  _workspace->upload(SCAN_POINTS_PER_FRAME, [this](size_t first, const float* points, const uint32_t* normals, size_t count) {
+    _vertexBufferPoints.write(int(first * POINT_STRIDE * sizeof(GLfloat)), points, int(count * POINT_STRIDE * sizeof(GLfloat)));
+    if (normals) {
+      _vertexBufferNormals.bind();
+      _vertexBufferNormals.write(int(first * sizeof(uint32_t)), normals, int(count * sizeof(uint32_t)));
+      _vertexBufferPoints.bind();
+    }
+  });
+  _vertexBufferPoints.release();
+  if (_workspace->revision() != revision)
+    emit scansChanged();
+
+  // scans still being read, or more than a frame's worth to copy
+  if (_workspace->isBusy())
+    QTimer::singleShot(SCAN_POLL_MILLISECONDS, this, [this]() { update(); });
+}
+
 void Scene::resizeGL(int w, int h)
 {
     for(int i = 0 ; i < _listProjection.length() ; ++i)
         _listProjection[i] = createPerspectiveMatrix(_fov_v.at(i), float(h) / float(w), 0.01f, 100.0f);
+    _updateCameras();
 }
 
 void Scene::mouseMoveEvent(QMouseEvent *event)
@@ -495,87 +1336,391 @@ void Scene::setPointSize(size_t size) {
 }
 
 void Scene::setVoxelSize(int nb) {
-  _nbVox = nb;
+  // the voxelizer's tables are for the old grid
+  _voxelizer = Voxelizer();
   delete [] _voxStorage;
-  delete [] tmp;
+  _voxStorage = nullptr;
+  _accountVoxels();
+
+  // a coarser grid when the requested one would not fit
+  const int requested = nb;
+  while (nb > 1 && !MemoryBudget::instance().fits(_voxelsMemorySize(nb)))
+    nb--;
+  _nbVox = nb;
   _voxStorage = new unsigned char[_nbVox*_nbVox*_nbVox];
-  tmp =  new unsigned char[_nbVox*_nbVox*_nbVox];
   memset(_voxStorage, 1, _nbVox*_nbVox*_nbVox * sizeof(unsigned char));
-  memset(tmp, 1, _nbVox*_nbVox*_nbVox*sizeof(unsigned char));
-  _createVox(); QOpenGLVertexArrayObject::Binder vaoPointsBinder(&_vaoPoints);
+  _accountVoxels();
+  _occupancyDirty = true;
+  _pyramidDirty = true;
+  _voxelColorsDirty = true;
+  if (nb != requested) {
+    MemoryBudget::instance().log("memory limits the grid to " + std::to_string(nb) + "^3");
+    emit voxelSizeLimited(requested, nb);
+  }
+  _createVox();
+  // uploaded by the next paintGL, with the context current
+  _voxVerticesDirty = true;
+  update();
+}
 
-  _vertexBufferVox.bind();
-  _vertexBufferVox.allocate(_voxVertices.constData(), _voxVertices.size() * sizeof(GLfloat));
-  QOpenGLFunctions *g = QOpenGLContext::currentContext()->functions();
-  g->glEnableVertexAttribArray(0);
-  g->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-  _vertexBufferVox.release();
+void Scene::setCarveEngine(int engine) {
+  _carveEngine = static_cast<CarveEngine>(engine);
+}
+
+void Scene::setFreeSpaceCarving(bool enabled) {
+  _freeSpaceCarving = enabled;
+}
+
+void Scene::setRayStep(int step) {
+  _options.rayStep = std::max(step, 1);
+}
+
+void Scene::setPointRendering(int rendering) {
+  _pointRendering = static_cast<PointRendering>(rendering);
+  update();
+}
+
+void Scene::setPointClassification(int classification) {
+  _pointClassification = static_cast<PointClassification>(classification);
+  update();
+}
+
+void Scene::setVoxelRendering(int rendering) {
+  _voxelRendering = static_cast<VoxelRendering>(rendering);
+  update();
+}
+
+void Scene::setRoundPoints(bool round) {
+  _roundPoints = round;
+  update();
+}
+
+void Scene::setPointLighting(bool lit) {
+  _lightPoints = lit;
+  update();
+}
+
+void Scene::setDistanceColouring(bool enabled) {
+  _showDistances = enabled;
   update();
 }
 
+void Scene::setDistanceRange(double range) {
+  _distanceRange = float(range);
+  update();
+}
+
+void Scene::loadScan(int scan) {
+  _workspace->load(scan);
+  emit scansChanged();
+  update();
+}
+
+void Scene::unloadScan(int scan) {
+  _workspace->unload(scan);
+  emit scansChanged();
+  update();
+}
+
+void Scene::setScanVisible(int scan, bool visible) {
+  _workspace->setVisible(scan, visible);
+  update();
+}
+
+void Scene::setMinPointsPerVoxel(int nb) {
+  assert(nb > 0);
+  _minPointsPerVoxel = nb;
+  // re-threshold the last intersection without binning points again
+  if (_voxelizer.finalized() && _voxelizer.nbVox() == _nbVox) {
+    _voxelizer.threshold(_minPointsPerVoxel, _voxStorage);
+    _occupancyDirty = true;
+    _pyramidDirty = true;
+    update();
+  }
+}
+
 void Scene::intersect() {
-    float voxSize = _spaceSize/_nbVox;
-    const float *p = _pointsData.constData();
-    memset(_voxStorage, 0, _nbVox*_nbVox*_nbVox*sizeof(unsigned char));
-#pragma omp parallel for shared(voxSize, _voxStorage, _pointsBoundMin, p)
-    for (size_t i = 0; i < _pointsCount * 7; i += 7) {
-        int x = (p[i]+ - _pointsBoundMin[0]) / voxSize;
-        int y = (p[i+1] - _pointsBoundMin[1]) / voxSize;
-        int z = (p[i+2] - _pointsBoundMin[2]) / voxSize;
-        _voxStorage[x*_nbVox*_nbVox + y*_nbVox + z] = 1;
+    // the voxelizer's tables only exist from here on; a coarser grid when
+    // they do not fit next to it
+    const int requested = _nbVox;
+    int nb = _nbVox;
+    while (nb > 1 && !MemoryBudget::instance().fits(_voxelsMemorySize(nb) + Voxelizer::peakMemorySize(nb, _pointsCount),
+                                                    _voxelsMemory.bytes()))
+        nb--;
+    if (nb != requested) {
+        setVoxelSize(nb);
+        MemoryBudget::instance().log("memory limits intersect to " + std::to_string(nb) + "^3");
+        emit voxelSizeLimited(requested, nb);
+    }
+
+    _voxelizer.reset(_pointsBoundMin[0], _pointsBoundMin[1], _pointsBoundMin[2], _spaceSize, _nbVox);
+    if (_options.streamVoxels) {
+        // points are not resident, fold the file in batch by batch
+        PlyReader reader(_plyFilePath.toStdString());
+        std::vector<float> batch(PLY_BATCH * POINT_STRIDE);
+        while (size_t n = reader.read(batch.data(), PLY_BATCH)) {
+            _voxelizer.accumulate(batch.data(), n, POINT_STRIDE);
+        }
+    } else {
+        forEachPoints([this](const float* points, size_t, size_t count) {
+            _voxelizer.accumulate(points, count, POINT_STRIDE);
+        });
     }
+    _voxelizer.finalize();
+    _voxelizer.threshold(_minPointsPerVoxel, _voxStorage);
+    _accountVoxels();
+    _occupancyDirty = true;
+    _pyramidDirty = true;
+    _voxelColorsDirty = true;
+    MemoryBudget::instance().log("memory after intersect");
     update();
 }
 
 void Scene::carve() {
-    memset(tmp, 1, _nbVox*_nbVox*_nbVox*sizeof(unsigned char));
-    for (int i = 0; i < _listProjection.length() ; i++) {
-        carveView(i);
+    _loadMasks();
+    VisualHull hull(_pointsBoundMin[0], _pointsBoundMin[1], _pointsBoundMin[2], _spaceSize/_nbVox, _nbVox);
+    const std::vector<const Silhouette*> masks = _cameraMasks();
+    hull.setCameras(&_cameras, masks.data());
+    hull.setUnseenVoxels(_options.keepUnseenVoxels ? VisualHull::KeepUnseen : VisualHull::CarveUnseen);
+
+    if (_carveEngine == CarveIntervals) {
+        hull.carveIntervals(_voxStorage);
+    } else {
+        hull.carveVoxels(_voxStorage);
+    }
+    emit carved(hull.skippedPairs(), hull.viewTilePairs());
+
+    // points are not resident while streaming voxels; compressed ones are
+    // decoded for the carve, which needs all of them at once
+    // and its ray masks, fewer of them than threads when the budget is short
+    const bool decode = _pointStore != nullptr;
+    const size_t decodedBytes = decode ? _pointsCount * POINT_STRIDE * sizeof(float) : 0;
+    const size_t threads = size_t(TaskPool::instance().threadsCount());
+    size_t maskSlots = threads;
+    while (maskSlots > 1 && !MemoryBudget::instance().fits(decodedBytes + FreeSpaceCarver::memorySize(_nbVox, maskSlots)))
+        maskSlots--;
+    const size_t carveBytes = FreeSpaceCarver::memorySize(_nbVox, maskSlots);
+    if (_freeSpaceCarving && !MemoryBudget::instance().fits(decodedBytes + carveBytes)) {
+        std::cerr << "free-space carving: the memory budget cannot hold the ray masks"
+                  << (decode ? " and the decoded points" : "") << std::endl;
+    } else if (_freeSpaceCarving && !_options.streamVoxels && _pointsCount > 0) {
+        QElapsedTimer timer;
+        timer.start();
+        std::vector<float> decoded;
+        MemoryAccount decodedMemory(MemoryBudget::Points);
+        if (decode) {
+            decoded.resize(_pointsCount * POINT_STRIDE);
+            decodedMemory.set(decodedBytes);
+            _pointStore->read(0, _pointsCount, decoded.data());
+        }
+        MemoryAccount carveMemory(MemoryBudget::Voxels);
+        carveMemory.set(carveBytes);
+        if (maskSlots < threads)
+            MemoryBudget::instance().log("memory limits free-space carving to " + std::to_string(maskSlots) + " ray masks");
+        FreeSpaceCarver carver(_pointsBoundMin[0], _pointsBoundMin[1], _pointsBoundMin[2], _spaceSize/_nbVox, _nbVox);
+        carver.setCameras(&_cameras, _cameraCentres.data());
+        carver.setRayStep(_options.rayStep);
+        carver.setMaskSlots(maskSlots);
+        carver.carve(decode ? decoded.data() : _pointsData.constData(), _pointsCount, POINT_STRIDE, _voxStorage);
+        const double milliseconds = timer.nsecsElapsed() * 1e-6;
+        TaskPool::instance().reportTiming("free-space carving", milliseconds);
+        emit freeSpaceCarved(carver.raysCount(), carver.freedCount(), milliseconds);
     }
+    _occupancyDirty = true;
+    _pyramidDirty = true;
+    MemoryBudget::instance().log("memory after carve");
     update();
 }
 
-void Scene::carveView(int v) {
-    float voxSize = _spaceSize/_nbVox;
-    float halSize = voxSize * .5;
-    float t[3];
-    t[0] = _pointsBoundMin[0] + halSize;
-    t[1] = _pointsBoundMin[1] + halSize;
-    t[2] = _pointsBoundMin[2] + halSize;
-    QVector4D X, X2;
-    QImage mask(_maskPath+"/mask_"+QString::number(v)+".jpg");
-    int h = mask.height(), w = mask.width();
-    const auto viewMatrix = _listProjection.at(v) * _listView.at(v);
-#pragma omp parallel for private(X, X2) shared(voxSize, _voxStorage, _pointsBoundMin, _nbVox, tmp, t) collapse(3)
-    for (int i = 0; i < _nbVox ; i++) {
-        for (int j = 0; j < _nbVox; j++) {
-            for (int k = 0; k < _nbVox; k++){
-                X2.setX(i * voxSize + t[0]);
-                X2.setY(j * voxSize + t[1]);
-                X2.setZ(k * voxSize + t[2]);
-                X2.setW(1.0);
-
-                X = viewMatrix * X2;
-
-                float x = X.x() / X.z();
-                float y = X.y() / -X.z();
-
-                if (abs(x) >= 1. || abs(y) >= 1.) {
-                    tmp[i*_nbVox*_nbVox + j*_nbVox + k] = 0;
-                    continue;
-                }
-
-                float xNDC = (x + 2. / 2.) / 2.;
-                float yNDC = (y + 2. / 2.) / 2.;
-
-                float xRaster = std::floor(xNDC * w);
-                float yRaster = std::floor(yNDC * h);
-
-                if (mask.pixelColor(xRaster,yRaster).red() != 255){
-                    tmp[i*_nbVox*_nbVox + j*_nbVox + k] = 0;
-                }
-            }
+void Scene::validateHull() {
+    QElapsedTimer timer;
+    timer.start();
+    _loadMasks();
+
+    // every view, so that a disabled one shows whether it agrees again
+    CameraStore cameras;
+    std::vector<const Silhouette*> masks;
+    for (int i = 0; i < _listProjection.length(); i++) {
+        const QMatrix4x4 projectionView = _listProjection.at(i) * _listView.at(i);
+        cameras.add(projectionView.constData());
+        masks.push_back(&_masks[i]);
+    }
+    HullValidator validator(_pointsBoundMin[0], _pointsBoundMin[1], _pointsBoundMin[2], _spaceSize/_nbVox, _nbVox);
+    validator.setCameras(&cameras, masks.data());
+    validator.validate(_voxStorage, _cameraConsistency);
+
+    const double milliseconds = timer.nsecsElapsed() * 1e-6;
+    TaskPool::instance().reportTiming("hull validation", milliseconds);
+    emit hullValidated(milliseconds);
+}
+
+void Scene::setCameraEnabled(int view, bool enabled) {
+    _cameraEnabled[view] = enabled;
+    _updateCameras();
+}
+
+void Scene::extractSurface() {
+    const float voxSize = _spaceSize/_nbVox;
+    SurfaceExtractor extractor(_pointsBoundMin[0], _pointsBoundMin[1], _pointsBoundMin[2], voxSize, _nbVox);
+
+    // place vertices from the masks' distance instead of halfway between centres
+    std::vector<float> distance;
+    MemoryAccount distanceMemory(MemoryBudget::Voxels);
+    if (_smoothSurface && !_listView.isEmpty()) {
+        _loadMasks();
+        TaskPool::instance().parallelFor(0, _masks.size(), [this](size_t v, size_t) {
+            _masks[v].computeDistance();
+        }, 1, CancellationToken(), "mask distances");
+        _accountMasks();
+
+        VisualHull hull(_pointsBoundMin[0], _pointsBoundMin[1], _pointsBoundMin[2], voxSize, _nbVox);
+        const std::vector<const Silhouette*> masks = _cameraMasks();
+        hull.setCameras(&_cameras, masks.data());
+        hull.setUnseenVoxels(_options.keepUnseenVoxels ? VisualHull::KeepUnseen : VisualHull::CarveUnseen);
+        distance.resize(size_t(_nbVox) * _nbVox * _nbVox);
+        distanceMemory.set(distance.size() * sizeof(float));
+        hull.distanceField(distance.data());
+        extractor.setDistanceField(distance.data());
+    }
+
+    extractor.extract(_voxStorage, _mesh);
+    _meshMemory.set(_mesh.vertices.capacity() * sizeof(float) + _mesh.indices.capacity() * sizeof(uint32_t));
+    _meshDirty = true;
+    MemoryBudget::instance().log("memory after surface extraction");
+    emit surfaceExtracted(_mesh.verticesCount(), _mesh.trianglesCount());
+    update();
+}
+
+void Scene::compareToReference() {
+  QElapsedTimer timer;
+  timer.start();
+
+  // only the reference's positions are kept, and only until indexed
+  PlyReader reader(_options.reference.toStdString());
+  const size_t count = reader.pointsCount();
+  if (count == 0)
+    throw std::runtime_error("the reference has no points");
+  if (!MemoryBudget::instance().fits(count * 3 * sizeof(float) + KdTree::memorySize(count)
+                                     + _pointsCount * sizeof(float), _distances.capacity() * sizeof(float)))
+    throw std::runtime_error("the memory budget cannot hold the reference");
+  MemoryAccount referenceMemory(MemoryBudget::Points);
+  std::vector<float> reference(count * 3);
+  referenceMemory.set(reference.capacity() * sizeof(float));
+  std::vector<float> batch(PLY_BATCH * POINT_STRIDE);
+  for (size_t first = 0; first < count; ) {
+    const size_t n = reader.read(batch.data(), std::min(PLY_BATCH, count - first));
+    if (n == 0)
+      throw std::runtime_error("the reference ends before its last point");
+    for (size_t i = 0; i < n; i++) {
+      std::copy(batch.data() + i * POINT_STRIDE, batch.data() + i * POINT_STRIDE + 3, reference.data() + (first + i) * 3);
+    }
+    first += n;
+  }
+
+  CloudDistance distance;
+  referenceMemory.set(reference.capacity() * sizeof(float) + KdTree::memorySize(count));
+  distance.setReference(reference.data(), count, 3);
+  std::vector<float>().swap(reference);
+  referenceMemory.set(distance.memorySize());
+
+  _distances.resize(_pointsCount);
+  _distancesMemory.set(_distances.capacity() * sizeof(float));
+  forEachPoints([&](const float* points, size_t first, size_t count) {
+    distance.compute(points, count, POINT_STRIDE, _distances.data() + first);
+  });
+  _distanceHistogram = CloudDistance::histogram(_distances.data(), _pointsCount);
+  _distanceRange = _distanceHistogram.percentile95;
+  _distancesDirty = true;
+  TaskPool::instance().reportTiming("cloud distance", timer.nsecsElapsed() * 1e-6);
+  MemoryBudget::instance().log("memory after comparing to the reference");
+  update();
+}
+
+void Scene::exportPoints(const QString& path, bool insideVoxelsOnly) {
+    PlyWriter writer(path.toStdString());
+    writer.setGrid(_pointsBoundMin[0], _pointsBoundMin[1], _pointsBoundMin[2], _spaceSize/_nbVox, _nbVox);
+    writer.beginPoints();
+    const unsigned char *occupancy = insideVoxelsOnly ? _voxStorage : nullptr;
+    if (_options.streamVoxels) {
+        // points are not resident, copy them over batch by batch
+        PlyReader reader(_plyFilePath.toStdString());
+        std::vector<float> batch(PLY_BATCH * POINT_STRIDE);
+        while (size_t n = reader.read(batch.data(), PLY_BATCH)) {
+            writer.writePoints(batch.data(), n, occupancy);
+        }
+    } else {
+        forEachPoints([&](const float* points, size_t, size_t count) {
+            writer.writePoints(points, count, occupancy);
+        });
+    }
+    writer.close();
+}
+
+void Scene::exportVoxels(const QString& path) {
+    PlyWriter writer(path.toStdString());
+    writer.setGrid(_pointsBoundMin[0], _pointsBoundMin[1], _pointsBoundMin[2], _spaceSize/_nbVox, _nbVox);
+    writer.beginPoints();
+    const bool hasColors = _voxelizer.finalized() && _voxelizer.nbVox() == _nbVox;
+    writer.writeVoxels(_voxStorage, hasColors ? &_voxelizer : nullptr);
+    writer.close();
+}
+
+void Scene::exportMesh(const QString& path) {
+    PlyWriter writer(path.toStdString());
+    writer.writeMesh(_mesh);
+    writer.close();
+}
+
+void Scene::_startLoadingMasks() {
+    _masks.resize(_listView.length());
+    _masksLoading.reset(new TaskGroup("decode masks"));
+    const CancellationToken token = _masksLoading->token();
+    _masksLoading->run([this, token]() {
+        TaskPool::instance().parallelFor(0, _masks.size(), [this](size_t v, size_t) {
+            _masks[v] = _decodeMask(v);
+        }, 1, token);
+        _accountMasks();
+    });
+}
+
+void Scene::_loadMasks() {
+    _masksLoading->wait();
+}
+
+void Scene::_accountMasks() {
+    size_t bytes = 0;
+    for (const Silhouette& mask : _masks) {
+        bytes += mask.memorySize();
+    }
+    _masksMemory.set(bytes);
+}
+
+size_t Scene::_voxelsMemorySize(int nb) const {
+    // occupancy and a distance field to smooth the surface; the voxelizer's
+    // tables are checked by intersect()
+    const size_t cells = size_t(nb) * nb * nb;
+    return cells * (sizeof(unsigned char) + sizeof(float));
+}
+
+void Scene::_accountVoxels() {
+    const size_t cells = _voxStorage ? size_t(_nbVox) * _nbVox * _nbVox : 0;
+    _voxelsMemory.set(cells * sizeof(unsigned char) + _voxelizer.memorySize());
+}
+
+Silhouette Scene::_decodeMask(int v) const {
+    const QImage mask = QImage(_maskPath+"/mask_"+QString::number(v)+".jpg").convertToFormat(QImage::Format_RGB32);
+    if (mask.isNull()) {
+        // nothing is inside a missing mask
+        return Silhouette(1, 1, std::vector<unsigned char>(1, 0));
+    }
+
+    const int w = mask.width(), h = mask.height();
+    std::vector<unsigned char> inside(size_t(w) * h);
+    for (int y = 0; y < h; y++) {
+        const QRgb *row = reinterpret_cast<const QRgb*>(mask.constScanLine(y));
+        for (int x = 0; x < w; x++) {
+            inside[size_t(y) * w + x] = qRed(row[x]) == 255;
         }
     }
-    memcpy(_voxStorage, tmp, _nbVox*_nbVox*_nbVox*sizeof(unsigned char));
+    return Silhouette(w, h, inside);
 }
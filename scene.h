@@ -5,37 +5,173 @@
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLBuffer>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLTexture>
 #include <QMatrix4x4>
+#include <QStringList>
 #include <QMatrix3x3>
 #include <QVector3D>
 
 #include <unistd.h>
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include "camera.h"
+#include "camerastore.h"
+#include "clouddistance.h"
+#include "hullvalidator.h"
+#include "memorybudget.h"
+#include "meshing.h"
+#include "pointfilter.h"
+#include "pointring.h"
+#include "pointstore.h"
+#include "pointstream.h"
+#include "silhouette.h"
+#include "taskpool.h"
+#include "voxelizer.h"
+#include "workspace.h"
+
+// optional settings, read from 'key=value' lines following the config paths
+struct SceneOptions
+{
+  bool streamVoxels = false; // voxelize while reading the PLY, keep no points
+  PointFilterOptions filter; // applied to the loaded points, unless streaming
+  QString liveStream;        // socket or pipe sending points, read instead of the PLY
+  size_t liveCapacity = 10000000; // live points kept, the oldest are overwritten
+  bool keepUnseenVoxels = false; // carving leaves voxels outside a view alone
+  size_t rayStep = 1;        // free-space carving casts rays from every step-th point
+  QStringList scans;         // more PLY files drawn with the points, loaded on demand
+  size_t gpuBudget = 1024;   // MB of point buffer shared by the points and the scans
+  size_t textureBudget = 2048; // MB of voxel textures: occupancy, its pyramid, colours
+  size_t memoryBudget = 0;   // MB of host memory, 0 for three quarters of the machine's
+  bool normals = true;       // read from the PLY or estimated, for lit points
+  QString reference;         // PLY the points are compared against, by nearest distance
+  size_t compressPoints = 0; // points per chunk when kept compressed, 0 keeps them plain
+};
+
+// paths and options read from a viewer config file
+struct SceneConfig
+{
+  QString      plyPath;
+  QString      bundlePath;
+  QString      maskPath;
+  int          hImg = 0;
+  SceneOptions options;
+
+  static SceneConfig load(const QString& configPath);
+};
+
+class QTimer;
 
 class Scene : public QOpenGLWidget, protected QOpenGLFunctions
 {
   Q_OBJECT
 
 public:
-  Scene(const QString& plyFilePath, const QString& bundlePath, QString& maskPath, int hImg, QWidget* parent = 0);
+  enum CarveEngine
+  {
+    CarveVoxels,   // test every voxel centre in every view
+    CarveIntervals // intersect silhouette intervals along grid columns
+  };
+
+  enum PointRendering
+  {
+    PointsDirect,       // shade every fragment of every point
+    PointsDepthPrepass, // nearest depth first, then shade fragments at that depth only
+    PointsBlended       // average the colours of the splats close to the nearest depth
+  };
+
+  // points against the occupancy grid, looked up on the GPU as they are drawn
+  enum PointClassification
+  {
+    ClassifyNone,       // points keep their colours
+    ClassifyTint,       // green inside occupied voxels, red outside
+    ClassifyInsideOnly, // points outside occupied voxels are hidden
+    ClassifyHighlight   // points outside occupied voxels are dimmed
+  };
+
+  enum VoxelRendering
+  {
+    VoxelsCubes,             // a cube per occupied voxel, then its edges
+    VoxelsRaymarched,        // rays through the grid texture, a voxel at a time
+    VoxelsRaymarchedSkipping // likewise, stepping over empty cells of the pyramid
+  };
+
+  // cubes cost a draw per occupied voxel, past this grid they take seconds a frame
+  static const int CUBES_MAX_VOXELS = 128;
+
+  Scene(const SceneConfig& config, QWidget* parent = 0);
   ~Scene();
+
+  const unsigned char* voxels() const { return _voxStorage; }
+  int nbVox() const { return _nbVox; }
+  size_t pointsCount() const { return _pointsCount; }
+  size_t sourcePointsCount() const { return _sourcePointsCount; } // before filtering, or received live
+  const Workspace* workspace() const { return _workspace.get(); } // null for a live stream
+  const PointStore* pointStore() const { return _pointStore.get(); } // null unless compressed
+  bool hasRaymarching() const { return _hasRaymarching; } // false until initializeGL, see raymarchingChecked
+
+  // the kept points in order, by batches, decoded when compressed; none
+  // when streaming voxels
+  void forEachPoints(const std::function<void(const float* points, size_t first, size_t count)>& body) const;
+
+  // distance of each point to the config's reference cloud, read again;
+  // throws std::runtime_error
+  void compareToReference();
+  bool hasDistances() const { return !_distances.empty(); }
+  const DistanceHistogram& distanceHistogram() const { return _distanceHistogram; }
+
+  // agreement of each view's mask with the voxels, from the last validateHull()
+  const std::vector<CameraConsistency>& cameraConsistency() const { return _cameraConsistency; }
+  bool isCameraEnabled(int view) const { return _cameraEnabled[view] != 0; }
+
+  // write binary PLY files, throw std::runtime_error
+  void exportPoints(const QString& path, bool insideVoxelsOnly);
+  void exportVoxels(const QString& path);
+  void exportMesh(const QString& path);
   QVector<QMatrix4x4> _listView;
   Camera              _currentCamera; // Peut bouger
   int index;
   bool _drawPoints = true;
   bool _drawSpace = false;
   bool _drawVoxels = false;
+  bool _drawSurface = false;
+  bool _smoothSurface = false;
 
 public slots:
   void setPointSize(size_t size);
   void setVoxelSize(int nb);
+  void setMinPointsPerVoxel(int nb);
+  void setCarveEngine(int engine);
+  void setFreeSpaceCarving(bool enabled);
+  void setRayStep(int step);
+  void setPointRendering(int rendering);
+  void setRoundPoints(bool round);
+  void setPointClassification(int classification);
+  void setPointLighting(bool lit);
+  void setVoxelRendering(int rendering);
+  void setDistanceColouring(bool enabled);
+  void setDistanceRange(double range); // shown in red, zero in blue
+  void loadScan(int scan);
+  void unloadScan(int scan);
+  void setScanVisible(int scan, bool visible);
   void intersect();
   void carve();
+  void validateHull(); // renders the voxels into every view, disabled ones too
+  void setCameraEnabled(int view, bool enabled); // disabled views are left out of carving
+  void extractSurface();
 
 signals:
   void pickpointsChanged(const QVector<QVector3D> points);
+  void surfaceExtracted(int verticesCount, int trianglesCount);
+  void pointsChanged();
+  void carved(qulonglong skippedPairs, qulonglong viewTilePairs);
+  void freeSpaceCarved(qulonglong rays, qulonglong freedVoxels, double milliseconds);
+  void voxelSizeLimited(int requested, int nbVox); // the memory budget allowed a coarser grid only
+  void scansChanged();
+  void hullValidated(double milliseconds);
+  void raymarchingChecked(bool available); // on initializeGL, again if the program then fails to build
 
 
 protected:
@@ -50,8 +186,31 @@ private slots:
 
 private:
   void _loadPLY(const QString& plyFilePath);
+  void _resetBounds();
+  void _updateBounds(const float* points, size_t count);
+  void _accountPoints();
+  void _fitSpace();
+  void _ingestLivePoints();
   void _loadBundle(const QString& bundleFilePath);
+  void _updateCameras();
+  std::vector<const Silhouette*> _cameraMasks() const;
+  void _startLoadingMasks();
+  void _loadMasks();
+  void _accountMasks();
+  size_t _voxelsMemorySize(int nb) const;
+  void _accountVoxels();
+  Silhouette _decodeMask(int view) const;
   void _createVox();
+  void _createVoxResources();
+  void _uploadScans();
+  void _renderPoints(const QMatrix4x4& modelViewMatrix);
+  void _drawPointRanges();
+  bool _texturesFit(size_t bytes, size_t released = 0) const;
+  void _uploadOccupancy();
+  void _renderRaymarchedVoxels(const QMatrix4x4& mvpMatrix);
+  void _uploadOccupancyPyramid();
+  void _uploadVoxelColors();
+  void _uploadDistances(size_t first);
   void _cleanup();
   QMatrix4x4 createPerspectiveMatrix(float fov_v, float aspect, float near, float far);
 
@@ -59,7 +218,6 @@ private:
   void setXRotation(int angle);
   void setYRotation(int angle);
   void setZRotation(int angle);
-  void carveView(int v);
 
   QVector2D project(QVector4D v);
 
@@ -68,27 +226,99 @@ private:
   QPoint _prevMousePosition;
   QOpenGLVertexArrayObject _vaoPoints;
   QOpenGLBuffer _vertexBufferPoints;
+  QOpenGLBuffer _vertexBufferNormals; // packed normals laid out like _vertexBufferPoints, if any
   QScopedPointer<QOpenGLShaderProgram> _shadersPoints;
+  PointRing _livePoints; // replaces _vertexBufferPoints for a live stream
+
+  // _vertexBufferPoints holds every scan of the workspace, drawn in one call
+  typedef void (QOPENGLF_APIENTRYP MultiDrawArrays)(GLenum mode, const GLint* first, const GLsizei* count, GLsizei drawcount);
+  std::unique_ptr<Workspace> _workspace;
+  MultiDrawArrays    _multiDrawArrays = nullptr;
+  std::vector<GLint>   _drawFirsts;
+  std::vector<GLsizei> _drawCounts;
+  PointRendering _pointRendering = PointsDirect;
+  bool _roundPoints = false;
+  bool _lightPoints = true; // shade by the normals, otherwise they are not fetched
+
+  // _voxStorage as a 3D texture, uploaded when it changed and points use it
+  PointClassification _pointClassification = ClassifyNone;
+  QScopedPointer<QOpenGLTexture> _occupancyTexture;
+  bool _occupancyDirty = true;
+
+  // distances to the reference, a float per point of the buffer, negative
+  // for the scans'; created once points are coloured by them
+  QOpenGLBuffer _vertexBufferDistances;
+  bool _showDistances = false;
+  bool _distancesDirty = true;
+  size_t _distancesFirst = size_t(-1); // where they were last written, the config's points then
+  float _distanceRange = 0.f;
+
+  // PointsBlended sums splat colours off screen, then divides them by weight
+  bool _hasFloatTargets = false;
+  QScopedPointer<QOpenGLFramebufferObject> _splatBuffer;
+  QScopedPointer<QOpenGLShaderProgram> _shadersResolve;
+  QOpenGLVertexArrayObject _vaoResolve;
+  QOpenGLBuffer _vertexBufferResolve;
 
   QOpenGLVertexArrayObject _vaoVox;
   QOpenGLBuffer _vertexBufferVox;
+  bool _voxVerticesDirty = false;
   QOpenGLBuffer *_indicesBufferVox;
   QScopedPointer<QOpenGLShaderProgram> _shadersVox;
 
+  // raymarched voxels: a pass over the view with the grid and its pyramid as
+  // textures, the cost of a frame follows its pixels rather than the voxels;
+  // needs GLSL 1.30 (GL 3.0), voxels are drawn as cubes otherwise
+  VoxelRendering _voxelRendering = VoxelsRaymarchedSkipping;
+  bool _hasRaymarching = false;
+  QScopedPointer<QOpenGLShaderProgram> _shadersRaymarch;
+  QScopedPointer<QOpenGLTexture> _pyramidTexture; // OccupancyPyramid, a mip level per level
+  bool _pyramidDirty = true;
+  QScopedPointer<QOpenGLTexture> _voxelColorsTexture; // the voxelizer's mean colours, as bytes
+  bool _voxelColorsDirty = true;
+
   QOpenGLVertexArrayObject _vaoSpace;
   QOpenGLBuffer _vertexBufferSpace;
 
+  QOpenGLVertexArrayObject _vaoMesh;
+  QOpenGLBuffer _vertexBufferMesh;
+  QOpenGLBuffer _indicesBufferMesh;
+  QScopedPointer<QOpenGLShaderProgram> _shadersMesh;
+  bool _meshDirty = false;
+
   int                 _nbVox = 32;
+  unsigned            _minPointsPerVoxel = 1;
+  Voxelizer           _voxelizer;
+  CarveEngine         _carveEngine = CarveIntervals;
+  bool                _freeSpaceCarving = false; // carve() also clears what rays to the points cross
+  QString             _maskPath;
+  std::vector<Silhouette> _masks; // one per view, decoded in the background
+  std::unique_ptr<TaskGroup> _masksLoading; // _loadMasks() waits for it, after the two above
+  Mesh                _mesh;       // surface extracted from _voxStorage
   float               _spaceSize;
   int                 _hImg;
   unsigned char       *_voxStorage;
   QVector<double>     _fov_v;
   QVector<QMatrix4x4> _listProjection;
+  CameraStore         _cameras; // projection * view of each enabled bundle camera
+  std::vector<float>  _cameraCentres; // x, y, z of each of _cameras
+  std::vector<uint32_t> _cameraViews; // view of each camera, enabled views only
+  std::vector<char>   _cameraEnabled; // per view, cleared for views found inconsistent
+  std::vector<CameraConsistency> _cameraConsistency; // per view, after validateHull()
   QMatrix4x4          _projectionMatrix;
   QMatrix4x4          _worldMatrix;
 
-  QVector<float> _pointsData;
+  std::unique_ptr<PointStream> _liveStream;
+  std::vector<float> _liveBatch;
+  QTimer             *_liveTimer = nullptr;
+
+  QVector<float> _pointsData; // for a live stream, mirrors _livePoints
+  std::unique_ptr<PointStore> _pointStore; // replaces _pointsData with compress_points
+  std::vector<uint32_t> _normalsData; // packed, one per point, unless options.normals is off
+  std::vector<float> _distances; // to the reference, one per point
+  DistanceHistogram  _distanceHistogram;
   size_t         _pointsCount;
+  size_t         _sourcePointsCount;
   QVector3D      _pointsBoundMin;
   QVector3D      _pointsBoundMax;
   QVector3D      _ray;
@@ -97,5 +327,19 @@ private:
   QVector<float>          _spaceVertices;
   QVector<unsigned int>   _voxIndices;
 
-  QString _maskPath;
+  // bytes held, by category of the memory budget
+  MemoryAccount _pointsMemory{MemoryBudget::Points};
+  MemoryAccount _voxelsMemory{MemoryBudget::Voxels}; // _voxStorage and _voxelizer
+  MemoryAccount _masksMemory{MemoryBudget::Masks};
+  MemoryAccount _meshMemory{MemoryBudget::Meshes};
+  MemoryAccount _gpuPointsMemory{MemoryBudget::GpuBuffers};
+  MemoryAccount _gpuMeshMemory{MemoryBudget::GpuBuffers};
+  MemoryAccount _gpuOccupancyMemory{MemoryBudget::GpuBuffers};
+  MemoryAccount _gpuPyramidMemory{MemoryBudget::GpuBuffers};
+  MemoryAccount _gpuVoxelColorsMemory{MemoryBudget::GpuBuffers};
+  MemoryAccount _distancesMemory{MemoryBudget::Points};
+  MemoryAccount _gpuDistancesMemory{MemoryBudget::GpuBuffers};
+
+  QString _plyFilePath;
+  SceneOptions _options;
 };
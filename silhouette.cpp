@@ -0,0 +1,135 @@
+#include "silhouette.h"
+
+#include <cassert>
+#include <cmath>
+
+// squared distance standing for 'no pixel of that side in sight'
+const float FAR_AWAY = 1e20f;
+
+// cf: Felzenszwalb and Huttenlocher, Distance Transforms of Sampled Functions.
+// In place 1D squared distance transform of f, with n samples spaced by 'step'.
+static void distanceTransform1D(float* f, int n, int step, std::vector<float>& d,
+                                std::vector<int>& v, std::vector<float>& z)
+{
+  d.resize(n);
+  v.resize(n);
+  z.resize(n + 1);
+
+  int k = 0;
+  v[0] = 0;
+  z[0] = -FAR_AWAY;
+  z[1] = FAR_AWAY;
+  for (int q = 1; q < n; q++) {
+    const float fq = f[q * step] + float(q) * q;
+    float s = (fq - (f[v[k] * step] + float(v[k]) * v[k])) / (2.f * (q - v[k]));
+    while (s <= z[k]) {
+      k--;
+      s = (fq - (f[v[k] * step] + float(v[k]) * v[k])) / (2.f * (q - v[k]));
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = FAR_AWAY;
+  }
+
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k + 1] < q)
+      k++;
+    d[q] = float(q - v[k]) * (q - v[k]) + f[v[k] * step];
+  }
+  for (int q = 0; q < n; q++) {
+    f[q * step] = d[q];
+  }
+}
+
+Silhouette::Silhouette()
+  : _width(0),
+    _height(0),
+    _rowStart(1, 0),
+    _columnStart(1, 0)
+{
+}
+
+Silhouette::Silhouette(int width, int height, const std::vector<unsigned char>& inside)
+  : _width(width),
+    _height(height),
+    _inside(inside)
+{
+  assert(inside.size() == size_t(width) * height);
+
+  _rowStart.reserve(height + 1);
+  for (int y = 0; y < height; ++y) {
+    _rowStart.push_back(_rowRuns.size());
+    const unsigned char *row = &_inside[y * width];
+    for (int x = 0; x < width; ) {
+      if (!row[x]) {
+        ++x;
+        continue;
+      }
+      Run run;
+      run.begin = x;
+      while (x < width && row[x])
+        ++x;
+      run.end = x;
+      _rowRuns.push_back(run);
+    }
+  }
+  _rowStart.push_back(_rowRuns.size());
+
+  _columnStart.reserve(width + 1);
+  for (int x = 0; x < width; ++x) {
+    _columnStart.push_back(_columnRuns.size());
+    for (int y = 0; y < height; ) {
+      if (!_inside[y * width + x]) {
+        ++y;
+        continue;
+      }
+      Run run;
+      run.begin = y;
+      while (y < height && _inside[y * width + x])
+        ++y;
+      run.end = y;
+      _columnRuns.push_back(run);
+    }
+  }
+  _columnStart.push_back(_columnRuns.size());
+}
+
+void Silhouette::computeDistance()
+{
+  if (hasDistance() || isEmpty())
+    return;
+
+  // squared distance to the nearest pixel of the other side, for both sides
+  std::vector<float> toInside(_inside.size()), toOutside(_inside.size());
+  for (size_t i = 0; i < _inside.size(); i++) {
+    toInside[i] = _inside[i] ? 0.f : FAR_AWAY;
+    toOutside[i] = _inside[i] ? FAR_AWAY : 0.f;
+  }
+
+  std::vector<float> d, z;
+  std::vector<int> v;
+  for (float* f : { toInside.data(), toOutside.data() }) {
+    for (int x = 0; x < _width; x++) {
+      distanceTransform1D(f + x, _height, _width, d, v, z);
+    }
+    for (int y = 0; y < _height; y++) {
+      distanceTransform1D(f + y * _width, _width, 1, d, v, z);
+    }
+  }
+
+  // the boundary runs half a pixel away from the nearest pixel across it
+  _distance.resize(_inside.size());
+  for (size_t i = 0; i < _inside.size(); i++) {
+    _distance[i] = _inside[i] ? .5f - std::sqrt(toOutside[i]) : std::sqrt(toInside[i]) - .5f;
+  }
+}
+
+size_t Silhouette::memorySize() const
+{
+  return _inside.size()
+      + (_rowRuns.size() + _columnRuns.size()) * sizeof(Run)
+      + (_rowStart.size() + _columnStart.size()) * sizeof(int)
+      + _distance.size() * sizeof(float);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// A decoded silhouette mask, kept both as a bitmap and as runs of inside
+// pixels per row and per column so that a line through the image can be
+// intersected with the silhouette without visiting every pixel it crosses.
+class Silhouette
+{
+public:
+  struct Run
+  {
+    int begin; // first inside pixel
+    int end;   // one past the last inside pixel
+  };
+
+  Silhouette();
+  // 'inside' holds width*height bytes, row by row, non-zero inside the silhouette
+  Silhouette(int width, int height, const std::vector<unsigned char>& inside);
+
+  int width() const { return _width; }
+  int height() const { return _height; }
+  bool isEmpty() const { return _width == 0 || _height == 0; }
+
+  bool contains(int x, int y) const { return _inside[y * _width + x] != 0; }
+
+  // runs of row y, ordered by x
+  const Run* rowBegin(int y) const { return _rowRuns.data() + _rowStart[y]; }
+  const Run* rowEnd(int y) const { return _rowRuns.data() + _rowStart[y + 1]; }
+
+  // runs of column x, ordered by y
+  const Run* columnBegin(int x) const { return _columnRuns.data() + _columnStart[x]; }
+  const Run* columnEnd(int x) const { return _columnRuns.data() + _columnStart[x + 1]; }
+
+  // signed distance in pixels from each pixel centre to the silhouette
+  // boundary, negative inside; built on demand as it costs 4 bytes per pixel
+  void computeDistance();
+  bool hasDistance() const { return !_distance.empty(); }
+  float distance(int x, int y) const { return _distance[y * _width + x]; }
+
+  // bytes held by the bitmap, both run tables and the distance map
+  size_t memorySize() const;
+
+private:
+  int _width;
+  int _height;
+  std::vector<unsigned char> _inside;
+  std::vector<Run> _rowRuns;
+  std::vector<int> _rowStart;
+  std::vector<Run> _columnRuns;
+  std::vector<int> _columnStart;
+  std::vector<float> _distance;
+};
@@ -0,0 +1,134 @@
+#include "spatialhash.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+// buckets are first grouped into 2^PARTITION_BITS partitions
+const int PARTITION_BITS = 10;
+
+SpatialHash::SpatialHash()
+  : _cellSize(0.f),
+    _invCellSize(0.f),
+    _bucketsCount(1),
+    _cellsCount(0),
+    _offsets(2, 0)
+{
+  _origin[0] = _origin[1] = _origin[2] = 0.f;
+}
+
+void SpatialHash::cellOf(const float* p, int* cell) const
+{
+  for (int axis = 0; axis < 3; axis++) {
+    const float c = (p[axis] - _origin[axis]) * _invCellSize;
+    // NaN lands in cell 0
+    cell[axis] = c > 0.f ? int(std::min(c, float(MAX_CELLS - 1))) : 0;
+  }
+}
+
+void SpatialHash::build(const float* points, size_t count, size_t stride,
+                        const float* origin, float cellSize)
+{
+  TaskPool& pool = TaskPool::instance();
+  _origin[0] = origin[0];
+  _origin[1] = origin[1];
+  _origin[2] = origin[2];
+  _cellSize = cellSize;
+  _invCellSize = cellSize > 0.f ? 1.f / cellSize : 0.f;
+
+  // about one cell per bucket for clouds with a few points per cell
+  _bucketsCount = 1;
+  while (_bucketsCount < count / 2)
+    _bucketsCount <<= 1;
+
+  // entries are sorted on their bucket in two passes that each keep their
+  // writes within cache: first into partitions of consecutive buckets, one
+  // histogram per range of points, then into buckets inside each partition
+  int bucketBits = 0;
+  while ((size_t(1) << bucketBits) < _bucketsCount)
+    bucketBits++;
+  const int shift = std::max(0, bucketBits - PARTITION_BITS);
+  const size_t partitionsCount = _bucketsCount >> shift;
+  const size_t rangesCount = pool.threadsCount();
+  std::vector<size_t> cursors(rangesCount * partitionsCount, 0);
+  std::vector<size_t> partitionStart(partitionsCount + 1, 0);
+  std::vector<Entry> partitioned(count);
+
+  pool.parallelFor(0, rangesCount, [&](size_t r, size_t) {
+    size_t *cursor = &cursors[r * partitionsCount];
+    int cell[3];
+    for (size_t i = count * r / rangesCount; i < count * (r + 1) / rangesCount; i++) {
+      const float *p = points + i * stride;
+      cellOf(p, cell);
+      Entry& entry = partitioned[i];
+      entry.key = _key(cell[0], cell[1], cell[2]);
+      entry.point = uint32_t(i);
+      entry.position[0] = p[0];
+      entry.position[1] = p[1];
+      entry.position[2] = p[2];
+      ++cursor[_bucket(entry.key) >> shift];
+    }
+  }, 1);
+
+  size_t offset = 0;
+  for (size_t part = 0; part < partitionsCount; part++) {
+    partitionStart[part] = offset;
+    for (size_t r = 0; r < rangesCount; r++) {
+      const size_t c = cursors[r * partitionsCount + part];
+      cursors[r * partitionsCount + part] = offset;
+      offset += c;
+    }
+  }
+  partitionStart[partitionsCount] = offset;
+
+  _entries.resize(count);
+  pool.parallelFor(0, rangesCount, [&](size_t r, size_t) {
+    size_t *cursor = &cursors[r * partitionsCount];
+    for (size_t i = count * r / rangesCount; i < count * (r + 1) / rangesCount; i++) {
+      _entries[cursor[_bucket(partitioned[i].key) >> shift]++] = partitioned[i];
+    }
+  }, 1);
+
+  // then inside each partition: buckets, cells within buckets, and points
+  // within cells so the result does not depend on the scatter order
+  _offsets.assign(_bucketsCount + 1, 0);
+  _offsets[_bucketsCount] = uint32_t(count);
+  std::atomic<size_t> cellsCount(0);
+  pool.parallelFor(0, partitionsCount, [&](size_t begin, size_t end) {
+    const size_t bucketsPerPartition = size_t(1) << shift;
+    std::vector<uint32_t> bucketCursor(bucketsPerPartition);
+    size_t cells = 0;
+    for (size_t part = begin; part < end; part++) {
+      const size_t first = partitionStart[part], last = partitionStart[part + 1];
+      const size_t firstBucket = part << shift;
+      std::fill(bucketCursor.begin(), bucketCursor.end(), 0);
+      for (size_t e = first; e < last; e++) {
+        ++bucketCursor[_bucket(_entries[e].key) - firstBucket];
+      }
+      uint32_t bucketOffset = uint32_t(first);
+      for (size_t b = 0; b < bucketsPerPartition; b++) {
+        _offsets[firstBucket + b] = bucketOffset;
+        const uint32_t c = bucketCursor[b];
+        bucketCursor[b] = bucketOffset;
+        bucketOffset += c;
+      }
+      for (size_t e = first; e < last; e++) {
+        partitioned[bucketCursor[_bucket(_entries[e].key) - firstBucket]++] = _entries[e];
+      }
+
+      for (size_t b = firstBucket; b < firstBucket + bucketsPerPartition; b++) {
+        Entry *bucketBegin = partitioned.data() + _offsets[b];
+        Entry *bucketEnd = partitioned.data() + (b + 1 < firstBucket + bucketsPerPartition ? _offsets[b + 1] : last);
+        std::sort(bucketBegin, bucketEnd, [](const Entry& a, const Entry& c) {
+          return a.key < c.key || (a.key == c.key && a.point < c.point);
+        });
+        for (Entry *e = bucketBegin; e < bucketEnd; e++) {
+          cells += e == bucketBegin || e->key != e[-1].key;
+        }
+      }
+    }
+    cellsCount += cells;
+  }, 1);
+  _entries.swap(partitioned);
+  _cellsCount = cellsCount;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "taskpool.h"
+
+// Points binned into cubic cells through a hash of their cell, for
+// neighbourhood queries on clouds too large and sparse for a dense grid.
+//
+// Cells are addressed by integer coordinates floor((p - origin) / cellSize),
+// up to 2^21 along each axis. Cells are hashed into buckets stored one after
+// the other; inside a bucket points are sorted by cell, so the points of a
+// cell are contiguous. Each entry keeps a copy of its point's position, so
+// queries walk memory in order instead of gathering from the cloud. Building
+// is a parallel counting sort on the bucket.
+class SpatialHash
+{
+public:
+  static const int MAX_CELLS = 1 << 21; // per axis
+
+  SpatialHash();
+
+  // bin 'count' points, x, y, z first and 'stride' floats apart
+  void build(const float* points, size_t count, size_t stride,
+             const float* origin, float cellSize);
+
+  float  cellSize() const { return _cellSize; }
+  size_t cellsCount() const { return _cellsCount; } // occupied ones
+
+  void cellOf(const float* p, int* cell) const;
+
+  struct Entry
+  {
+    uint64_t key;
+    uint32_t point;
+    float    position[3];
+  };
+
+  // entries of cell (x, y, z) as [first, last), empty for cells out of range
+  void cellEntries(int x, int y, int z, const Entry*& first, const Entry*& last) const
+  {
+    first = last = nullptr;
+    if (x < 0 || y < 0 || z < 0 || x >= MAX_CELLS || y >= MAX_CELLS || z >= MAX_CELLS)
+      return;
+    const uint64_t key = _key(x, y, z);
+    const size_t bucket = _bucket(key);
+    const Entry *e = _entries.data() + _offsets[bucket];
+    const Entry *bucketEnd = _entries.data() + _offsets[bucket + 1];
+    while (e < bucketEnd && e->key < key)
+      e++;
+    first = e;
+    while (e < bucketEnd && e->key == key)
+      e++;
+    last = e;
+  }
+
+  // f(entry) for every point in cell (x, y, z)
+  template <typename F>
+  void forEachInCell(int x, int y, int z, F f) const
+  {
+    const Entry *first, *last;
+    cellEntries(x, y, z, first, last);
+    for (const Entry *e = first; e < last; e++) {
+      f(*e);
+    }
+  }
+
+  // f(first, last) for every occupied cell, the range of its entries;
+  // cells are visited in parallel
+  template <typename F>
+  void forEachCell(F f) const
+  {
+    TaskPool::instance().parallelFor(0, _bucketsCount, [&](size_t begin, size_t end) {
+      forEachCellInBuckets(begin, end, f);
+    });
+  }
+
+  // same for the cells of buckets [begin, end) only, on the calling thread
+  template <typename F>
+  void forEachCellInBuckets(size_t begin, size_t end, F f) const
+  {
+    for (size_t b = begin; b < end; b++) {
+      const Entry *first = _entries.data() + _offsets[b];
+      const Entry *bucketEnd = _entries.data() + _offsets[b + 1];
+      while (first < bucketEnd) {
+        const Entry *last = first + 1;
+        while (last < bucketEnd && last->key == first->key)
+          last++;
+        f(first, last);
+        first = last;
+      }
+    }
+  }
+
+  size_t bucketsCount() const { return _bucketsCount; }
+
+private:
+  static uint64_t _key(int x, int y, int z)
+  {
+    return (uint64_t(x) << 42) | (uint64_t(y) << 21) | uint64_t(z);
+  }
+  size_t _bucket(uint64_t key) const
+  {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key & (_bucketsCount - 1);
+  }
+
+  float  _origin[3];
+  float  _cellSize;
+  float  _invCellSize;
+  size_t _bucketsCount;
+  size_t _cellsCount;
+  std::vector<Entry>    _entries; // points, bucket by bucket
+  std::vector<uint32_t> _offsets; // bucketsCount + 1 indices into _entries
+};
@@ -0,0 +1,241 @@
+#include "taskpool.h"
+
+#include <algorithm>
+
+// pool the calling thread works for and its index there, -1 outside any pool
+static thread_local const TaskPool* t_pool = nullptr;
+static thread_local int t_worker = -1;
+
+static int s_configuredThreads = 0;
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TaskPool::configure(int threadsCount)
+{
+  s_configuredThreads = threadsCount;
+}
+
+TaskPool& TaskPool::instance()
+{
+  static TaskPool pool(s_configuredThreads);
+  return pool;
+}
+
+TaskPool::TaskPool(int threadsCount)
+  : _queued(0),
+    _stopping(false)
+{
+  if (threadsCount <= 0) {
+    threadsCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const int workersCount = threadsCount - 1;
+  for (int w = 0; w <= workersCount; w++) {
+    _queues.emplace_back(new Queue);
+  }
+  for (int w = 0; w < workersCount; w++) {
+    _workers.emplace_back(&TaskPool::_workerLoop, this, w);
+  }
+}
+
+TaskPool::~TaskPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(_sleepMutex);
+    _stopping = true;
+  }
+  _wake.notify_all();
+  for (auto& worker : _workers) {
+    worker.join();
+  }
+}
+
+int TaskPool::slot() const
+{
+  return t_pool == this ? t_worker : int(_workers.size());
+}
+
+void TaskPool::reportTiming(const char* name, double milliseconds) const
+{
+  if (name && _timingHook) {
+    _timingHook(name, milliseconds);
+  }
+}
+
+void TaskPool::_push(Task task)
+{
+  {
+    // counted first so the count never drops below the queued tasks, and
+    // under the lock so that a worker going to sleep cannot miss it
+    std::lock_guard<std::mutex> lock(_sleepMutex);
+    ++_queued;
+  }
+  Queue& queue = *_queues[slot()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  _wake.notify_one();
+}
+
+bool TaskPool::_runOne()
+{
+  const int own = slot();
+  const int queuesCount = int(_queues.size());
+  Task task;
+
+  // own tasks newest first, they are the most likely to be in cache, then
+  // the others' oldest first, they are the most likely to split further
+  for (int q = 0; q < queuesCount && !task; q++) {
+    Queue& queue = *_queues[(own + q) % queuesCount];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+      continue;
+    if (q == 0 && own < int(_workers.size())) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+  }
+  if (!task)
+    return false;
+
+  --_queued;
+  task();
+  return true;
+}
+
+void TaskPool::_workerLoop(int index)
+{
+  t_pool = this;
+  t_worker = index;
+
+  while (true) {
+    if (_runOne())
+      continue;
+
+    std::unique_lock<std::mutex> lock(_sleepMutex);
+    _wake.wait(lock, [this]() { return _stopping || _queued.load() > 0; });
+    if (_stopping && _queued.load() == 0)
+      return;
+  }
+}
+
+void TaskPool::parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body,
+                           size_t grain, const CancellationToken& token, const char* name)
+{
+  if (begin >= end)
+    return;
+
+  const auto start = std::chrono::steady_clock::now();
+  const size_t count = end - begin;
+  const size_t threads = threadsCount();
+  if (grain == 0) {
+    // a few chunks per thread leave room for stealing when chunks are uneven
+    grain = std::max<size_t>(1, count / (threads * 4));
+  }
+  const size_t chunksCount = (count + grain - 1) / grain;
+
+  // helpers claim chunks until none is left, whoever runs first takes most
+  std::atomic<size_t> next(0);
+  auto claim = [&]() {
+    size_t chunk;
+    while ((chunk = next++) < chunksCount && !token.isCancelled()) {
+      const size_t chunkBegin = begin + chunk * grain;
+      body(chunkBegin, std::min(end, chunkBegin + grain));
+    }
+  };
+
+  if (chunksCount > 1 && threads > 1) {
+    TaskGroup helpers(nullptr, *this);
+    const size_t helpersCount = std::min(chunksCount, threads) - 1;
+    for (size_t h = 0; h < helpersCount; h++) {
+      helpers.run([&]() {
+        try {
+          claim();
+        } catch (...) {
+          next = chunksCount;
+          throw;
+        }
+      });
+    }
+    std::exception_ptr error;
+    try {
+      claim();
+    } catch (...) {
+      // let the helpers run out of chunks before leaving their stack
+      error = std::current_exception();
+      next = chunksCount;
+    }
+    helpers.wait();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  } else {
+    claim();
+  }
+
+  reportTiming(name, millisecondsSince(start));
+}
+
+
+TaskGroup::TaskGroup(const char* name, TaskPool& pool)
+  : _pool(pool),
+    _name(name),
+    _pending(0),
+    _start(std::chrono::steady_clock::now())
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+  // a destructor must not throw, errors are only reported by wait()
+  while (_pending.load() > 0) {
+    if (!_pool._runOne()) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void TaskGroup::run(const TaskPool::Task& task)
+{
+  ++_pending;
+  _pool._push([this, task]() {
+    if (!_token.isCancelled()) {
+      try {
+        task();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(_errorMutex);
+        if (!_error) {
+          _error = std::current_exception();
+        }
+        _token.cancel();
+      }
+    }
+    --_pending;
+  });
+}
+
+void TaskGroup::wait()
+{
+  while (_pending.load() > 0) {
+    if (!_pool._runOne()) {
+      std::this_thread::yield();
+    }
+  }
+  _pool.reportTiming(_name, millisecondsSince(_start));
+  _name = nullptr;
+
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(_errorMutex);
+    std::swap(error, _error);
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Shared flag telling the tasks of one operation to stop early.
+// Copies share the same flag.
+class CancellationToken
+{
+public:
+  CancellationToken() : _cancelled(std::make_shared<std::atomic<bool> >(false)) {}
+
+  void cancel() const { _cancelled->store(true); }
+  bool isCancelled() const { return _cancelled->load(std::memory_order_relaxed); }
+
+private:
+  std::shared_ptr<std::atomic<bool> > _cancelled;
+};
+
+// Work-stealing thread pool shared by loading, voxelization, carving,
+// meshing and export.
+//
+// Every worker owns a deque: it pushes and pops its own tasks at the back
+// and steals from the front of the others' when it runs dry. Threads outside
+// the pool push into an extra shared deque. A thread waiting for tasks runs
+// pending ones meanwhile, so tasks may themselves fork and wait (nested
+// parallelism) without tying up threads.
+class TaskPool
+{
+public:
+  typedef std::function<void()> Task;
+  typedef std::function<void(const char* name, double milliseconds)> TimingHook;
+
+  // threads used by instance(), counting the calling thread; 0 picks the
+  // hardware concurrency. Only effective before the first instance() call.
+  static void configure(int threadsCount);
+  static TaskPool& instance();
+
+  explicit TaskPool(int threadsCount);
+  ~TaskPool();
+
+  // workers plus the thread that waits on them
+  int threadsCount() const { return int(_workers.size()) + 1; }
+
+  // index of the calling thread in [0, threadsCount()): workers get their
+  // own, every thread outside the pool shares the last one
+  int slot() const;
+
+  // run body(chunkBegin, chunkEnd) over [begin, end) cut into chunks of
+  // 'grain' items (0 picks one), the calling thread takes part; chunks not
+  // started yet are skipped once 'token' is cancelled
+  void parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body,
+                   size_t grain = 0, const CancellationToken& token = CancellationToken(),
+                   const char* name = nullptr);
+
+  // called with the duration of every named parallelFor and TaskGroup
+  void setTimingHook(const TimingHook& hook) { _timingHook = hook; }
+  void reportTiming(const char* name, double milliseconds) const;
+
+private:
+  friend class TaskGroup;
+
+  struct Queue
+  {
+    std::mutex       mutex;
+    std::deque<Task> tasks;
+  };
+
+  void _push(Task task);
+  bool _runOne();
+  void _workerLoop(int index);
+
+  std::vector<std::unique_ptr<Queue> > _queues; // one per worker, then the shared one
+  std::vector<std::thread> _workers;
+  std::mutex               _sleepMutex;
+  std::condition_variable  _wake;
+  std::atomic<size_t>      _queued;
+  bool                     _stopping;
+  TimingHook               _timingHook;
+};
+
+// Tasks submitted together and waited on together. Waiting runs pending
+// tasks of the pool; the first exception thrown by a task is rethrown by
+// wait(). The destructor waits.
+class TaskGroup
+{
+public:
+  explicit TaskGroup(const char* name = nullptr, TaskPool& pool = TaskPool::instance());
+  ~TaskGroup();
+
+  // tasks not started yet are skipped once the group is cancelled
+  void run(const TaskPool::Task& task);
+  void wait();
+  bool isDone() const { return _pending.load() == 0; }
+
+  void cancel() { _token.cancel(); }
+  const CancellationToken& token() const { return _token; }
+
+private:
+  TaskPool&           _pool;
+  const char*         _name;
+  std::atomic<size_t> _pending;
+  CancellationToken   _token;
+  std::mutex          _errorMutex;
+  std::exception_ptr  _error;
+  std::chrono::steady_clock::time_point _start;
+};
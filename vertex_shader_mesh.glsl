@@ -0,0 +1,16 @@
+#version 120
+
+uniform mat4 mvpMatrix;
+uniform vec3 lightPos;
+
+attribute vec3 vertex;
+attribute vec3 normal;
+
+varying float shade;
+
+void main() {
+  gl_Position = mvpMatrix * vec4(vertex, 1.);
+
+  // two sided diffuse from a light at the eye
+  shade = .25 + .75 * abs(dot(normalize(normal), normalize(lightPos - vertex)));
+}
@@ -1,22 +1,69 @@
 #version 120
 
 uniform float pointSize;
-uniform mat4 mvpMatrix;
+uniform mat4 modelViewMatrix;
+uniform mat4 projectionMatrix;
+uniform float depthOffset; // pushes points away from the eye in the visibility pass
+
+uniform int classification;  // Scene::PointClassification, 0 leaves the colours alone
+uniform sampler3D occupancy; // a byte per voxel, z along the width as in the grid's storage
+uniform vec3 gridOrigin;
+uniform float gridSize;      // side of the voxel cube
+
+uniform bool lit;            // shade by the normal, the attribute is not fetched otherwise
+
+uniform bool showDistances;  // colour by the distance to the reference cloud
+uniform float referenceRange; // distance shown in red, zero in blue
 
 attribute vec4 vertex;
 attribute float pointRowIndex;
 attribute vec3 color;
+attribute vec2 normal;       // octahedral, as packed by encodeOctahedral()
+attribute float referenceDistance; // negative for points compared to none
 
 varying float pointIdx;
 varying vec3 vcolor;
 varying vec3 vert;
 
 void main() {
-  gl_Position = mvpMatrix * vertex;
+  vec4 eye = modelViewMatrix * vertex;
+  eye.z -= depthOffset;
+  gl_Position = projectionMatrix * eye;
   gl_PointSize  = pointSize;
 
   // for use in fragment shader
   pointIdx = pointRowIndex;
   vcolor = color;
   vert = vertex.xyz;
+
+  // blue, cyan, green, yellow, red
+  if (showDistances && referenceDistance >= 0.) {
+    float t = 4. * clamp(referenceDistance / referenceRange, 0., 1.);
+    vcolor = clamp(vec3(t - 2., 2. - abs(t - 2.), 2. - t), 0., 1.);
+  }
+
+  // a headlight, both sides alike since estimated normals have no sign
+  if (lit) {
+    vec3 n = vec3(normal, 1. - abs(normal.x) - abs(normal.y));
+    if (n.z < 0.) {
+      n.xy = (1. - abs(n.yx)) * vec2(n.x >= 0. ? 1. : -1., n.y >= 0. ? 1. : -1.);
+    }
+    vec3 eyeNormal = normalize(mat3(modelViewMatrix) * n);
+    vcolor *= .3 + .7 * abs(dot(eyeNormal, normalize(-eye.xyz)));
+  }
+
+  // look the point's voxel up, points on the max bound clamp to the last one;
+  // those outside the grid are outside, whatever the border voxel holds
+  if (classification != 0) {
+    vec3 cell = (vertex.xyz - gridOrigin) / gridSize;
+    bool inside = all(greaterThanEqual(cell, vec3(0.))) && all(lessThanEqual(cell, vec3(1.)))
+                  && texture3D(occupancy, cell.zyx).r > 0.;
+    if (classification == 1) {
+      vcolor = mix(vcolor, inside ? vec3(0., 1., 0.) : vec3(1., 0., 0.), .5);
+    } else if (classification == 2 && !inside) {
+      gl_Position = vec4(2., 2., 2., 1.); // outside the clip volume
+    } else if (classification == 3 && !inside) {
+      vcolor *= .2;
+    }
+  }
 }
@@ -0,0 +1,10 @@
+#version 130
+
+in vec2 vertex;
+
+out vec2 ndc;
+
+void main() {
+  gl_Position = vec4(vertex, 0., 1.);
+  ndc = vertex;
+}
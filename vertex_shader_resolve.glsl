@@ -0,0 +1,10 @@
+#version 120
+
+attribute vec2 vertex;
+
+varying vec2 texCoord;
+
+void main() {
+  gl_Position = vec4(vertex, 0., 1.);
+  texCoord = vertex * .5 + .5;
+}
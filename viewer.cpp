@@ -10,30 +10,32 @@
 #include <QGroupBox>
 #include <QCheckBox>
 #include <QSlider>
-
+#include <QSpinBox>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QListWidget>
+#include <QStandardItemModel>
+#include <algorithm>
+
+#include "memorybudget.h"
+#include "plyreader.h"
 #include "scene.h"
 #include "viewer.h"
 
+const int MEMORY_POLL_MILLISECONDS = 500; // refreshes the memory label
+const int MAX_VOXELS = 1024; // per side, raymarched
+
 
 Viewer::Viewer(const QString& configPath)
 {
   // accept keyboard input
   setFocusPolicy(Qt::StrongFocus);
   setFocus();
-  QFile config;
-  config.setFileName(configPath);
-  config.open(QIODevice::ReadOnly);
-  QString buff = config.readAll();
-  QStringList list = buff.split('\n');
-  QString plyPath = list[0];
-  QString bundlePath = list[1];
-  QString maskPath = list[2];
-  int hImg = list[3].toInt();
 
   //
   // make and connect scene widget
   //
-  _scene = new Scene(plyPath, bundlePath, maskPath, hImg);
+  _scene = new Scene(SceneConfig::load(configPath));
 
   //
   // make 'point size' contoller
@@ -55,9 +57,51 @@ Viewer::Viewer(const QString& configPath)
   pointSizePanel->addWidget(lblPointSize);
   pointSizePanel->addWidget(pointSizeSlider);
 
+  //
+  // make point rendering controls, prepasses keep large points from overdrawing
+  //
+  auto cbPointRendering = new QComboBox();
+  cbPointRendering->addItem(tr("Draw every point"), Scene::PointsDirect);
+  cbPointRendering->addItem(tr("Depth prepass"), Scene::PointsDepthPrepass);
+  cbPointRendering->addItem(tr("Blend nearest splats"), Scene::PointsBlended);
+  connect(cbPointRendering, static_cast<void(QComboBox::*)(int) >(&QComboBox::currentIndexChanged), [=](const int newValue) {
+      _scene->setPointRendering(cbPointRendering->itemData(newValue).toInt());
+  });
+  pointSizePanel->addWidget(cbPointRendering);
+
+  // points against the occupancy grid, updated with every intersect and carve
+  auto cbPointClassification = new QComboBox();
+  cbPointClassification->addItem(tr("Points in their colours"), Scene::ClassifyNone);
+  cbPointClassification->addItem(tr("Tint points by occupancy"), Scene::ClassifyTint);
+  cbPointClassification->addItem(tr("Points in occupied voxels only"), Scene::ClassifyInsideOnly);
+  cbPointClassification->addItem(tr("Dim points outside voxels"), Scene::ClassifyHighlight);
+  connect(cbPointClassification, static_cast<void(QComboBox::*)(int) >(&QComboBox::currentIndexChanged), [=](const int newValue) {
+      _scene->setPointClassification(cbPointClassification->itemData(newValue).toInt());
+  });
+  pointSizePanel->addWidget(cbPointClassification);
+
+  auto cbRoundPoints = new QCheckBox(tr("Round points"));
+  connect(cbRoundPoints, &QCheckBox::stateChanged, [=](const int state) {
+      _scene->setRoundPoints(state);
+  });
+  pointSizePanel->addWidget(cbRoundPoints);
+
+  // unlit points skip the normals, a third less to fetch per point
+  auto cbLightPoints = new QCheckBox(tr("Light points"));
+  cbLightPoints->setChecked(true);
+  connect(cbLightPoints, &QCheckBox::stateChanged, [=](const int state) {
+      _scene->setPointLighting(state);
+  });
+  pointSizePanel->addWidget(cbLightPoints);
+
   auto voxelSizeSlider = new QSlider(Qt::Horizontal);
-  voxelSizeSlider->setRange(1, 128);
+  // raymarched voxels draw up to 1024^3, cubes up to CUBES_MAX_VOXELS, see
+  // the voxel rendering; each value allocates a new grid so it is set once
+  // the slider is released
+  voxelSizeSlider->setRange(1, Scene::CUBES_MAX_VOXELS);
   voxelSizeSlider->setSingleStep(1);
+  voxelSizeSlider->setPageStep(32);
+  voxelSizeSlider->setTracking(false);
   voxelSizeSlider->setValue(32);
   connect(voxelSizeSlider, &QSlider::valueChanged, this, &Viewer::_updateVoxelSize);
 
@@ -71,6 +115,29 @@ Viewer::Viewer(const QString& configPath)
   voxelSizePanel->addWidget(lblVoxelSize);
   voxelSizePanel->addWidget(voxelSizeSlider);
 
+  // the slider follows the grid the memory budget allowed
+  connect(_scene, &Scene::voxelSizeLimited, [=](int requested, int nbVox) {
+      const QSignalBlocker blocker(voxelSizeSlider);
+      voxelSizeSlider->setValue(nbVox);
+      lblVoxelSize->setText(QString("Voxels size (%1 over the memory budget, %2 used)").arg(requested).arg(nbVox));
+  });
+  connect(voxelSizeSlider, &QSlider::valueChanged, [=]() {
+      lblVoxelSize->setText("Voxels size");
+  });
+
+  //
+  // make 'min points per voxel' controller, rejects sparse noise on intersect
+  //
+  auto minPointsSpin = new QSpinBox();
+  minPointsSpin->setRange(1, 1000000);
+  minPointsSpin->setValue(1);
+  connect(minPointsSpin, static_cast<void(QSpinBox::*)(int) >(&QSpinBox::valueChanged), this, &Viewer::_updateMinPointsPerVoxel);
+
+  QLabel *lblMinPoints = new QLabel();
+  lblMinPoints->setText("Min points per voxel");
+  voxelSizePanel->addWidget(lblMinPoints);
+  voxelSizePanel->addWidget(minPointsSpin);
+
   auto cbCamera = new QComboBox();
   for (int i = 0; i < _scene->_listView.length(); i++) {
       cbCamera->addItem(QString("Camera " + QString::number(i)));
@@ -90,20 +157,291 @@ Viewer::Viewer(const QString& configPath)
       _scene->intersect();
   });
 
+  auto cbCarveEngine = new QComboBox();
+  cbCarveEngine->addItem(tr("Carve voxels"), Scene::CarveVoxels);
+  cbCarveEngine->addItem(tr("Carve silhouette intervals"), Scene::CarveIntervals);
+  cbCarveEngine->setCurrentIndex(1);
+  cbCarveEngine->setMaximumWidth(200);
+  connect(cbCarveEngine, static_cast<void(QComboBox::*)(int) >(&QComboBox::currentIndexChanged), [=](const int newValue) {
+      _scene->setCarveEngine(cbCarveEngine->itemData(newValue).toInt());
+  });
+
   auto btnCarve = new QPushButton(tr("Carve"));
   btnCarve->setMaximumWidth(100);
   connect(btnCarve, &QPushButton::pressed, [=]() {
       _scene->carve();
   });
 
+  auto lblCarve = new QLabel();
+  connect(_scene, &Scene::carved, [=](qulonglong skippedPairs, qulonglong viewTilePairs) {
+      lblCarve->setText(QString("%1 of %2 camera-tile pairs skipped").arg(skippedPairs).arg(viewTilePairs));
+  });
+
+  auto cbFreeSpace = new QCheckBox(tr("Carve free space"));
+  cbFreeSpace->setMaximumWidth(200);
+  connect(cbFreeSpace, &QCheckBox::stateChanged, [=](const int state) {
+      _scene->setFreeSpaceCarving(state);
+  });
+
+  auto lblFreeSpace = new QLabel();
+  connect(_scene, &Scene::freeSpaceCarved, [=](qulonglong rays, qulonglong freedVoxels, double milliseconds) {
+      lblFreeSpace->setText(QString("%1 voxels freed by %2 rays, %3 M rays/s")
+                            .arg(freedVoxels).arg(rays).arg(rays / milliseconds * 1e-3, 0, 'f', 1));
+  });
+
+  //
+  // make hull validation controls: the views whose masks disagree most with
+  // the voxels, each of which can be left out of the next carve
+  //
+  auto btnValidate = new QPushButton(tr("Validate against masks"));
+  btnValidate->setMaximumWidth(200);
+  connect(btnValidate, &QPushButton::pressed, [=]() {
+      _scene->validateHull();
+  });
+
+  const int WORST_VIEWS = 20;
+  auto lblValidation = new QLabel();
+  auto lwWorstViews = new QListWidget();
+  lwWorstViews->setMaximumWidth(280);
+  lwWorstViews->setMaximumHeight(150);
+  lwWorstViews->hide();
+  connect(_scene, &Scene::hullValidated, [=](double milliseconds) {
+      std::vector<CameraConsistency> scores = _scene->cameraConsistency();
+      if (scores.empty())
+        return;
+      double sum = 0.;
+      for (const CameraConsistency& score : scores) {
+        sum += score.iou;
+      }
+      std::sort(scores.begin(), scores.end(), [](const CameraConsistency& a, const CameraConsistency& b) {
+          return a.iou < b.iou;
+      });
+      lblValidation->setText(QString("Mask IoU: mean %1, worst %2 (camera %3)\nin %4 ms")
+                             .arg(sum / scores.size(), 0, 'f', 3).arg(scores[0].iou, 0, 'f', 3)
+                             .arg(scores[0].camera).arg(milliseconds, 0, 'f', 0));
+
+      const QSignalBlocker blocker(lwWorstViews);
+      lwWorstViews->clear();
+      for (size_t i = 0; i < scores.size() && int(i) < WORST_VIEWS; i++) {
+        const CameraConsistency& score = scores[i];
+        auto item = new QListWidgetItem(QString("Camera %1: %2").arg(score.camera).arg(score.iou, 0, 'f', 3), lwWorstViews);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(_scene->isCameraEnabled(score.camera) ? Qt::Checked : Qt::Unchecked);
+        item->setData(Qt::UserRole, score.camera);
+        item->setToolTip(QString("%1 hull pixels, %2 mask pixels, %3 in both")
+                         .arg(score.hullPixels).arg(score.maskPixels).arg(score.intersection));
+      }
+      lwWorstViews->show();
+  });
+  // unchecked views are not carved with; clicking one looks through it
+  connect(lwWorstViews, &QListWidget::itemChanged, [=](QListWidgetItem* item) {
+      _scene->setCameraEnabled(item->data(Qt::UserRole).toInt(), item->checkState() == Qt::Checked);
+  });
+  connect(lwWorstViews, &QListWidget::itemClicked, [=](QListWidgetItem* item) {
+      cbCamera->setCurrentIndex(item->data(Qt::UserRole).toInt());
+  });
+
+  //
+  // make surface extraction controls
+  //
+  auto btnSurface = new QPushButton(tr("Extract surface"));
+  btnSurface->setMaximumWidth(200);
+  connect(btnSurface, &QPushButton::pressed, [=]() {
+      _scene->extractSurface();
+  });
+
+  auto cbSmoothSurface = new QCheckBox(tr("Smooth with masks"));
+  cbSmoothSurface->setMaximumWidth(200);
+  connect(cbSmoothSurface, &QCheckBox::stateChanged, [=](const int state) {
+      _scene->_smoothSurface = state;
+  });
+
+  auto lblSurface = new QLabel();
+  connect(_scene, &Scene::surfaceExtracted, [=](int verticesCount, int trianglesCount) {
+      lblSurface->setText(QString("%1 vertices, %2 triangles").arg(verticesCount).arg(trianglesCount));
+  });
+
+  //
+  // make export controls
+  //
+  auto cbExport = new QComboBox();
+  cbExport->addItem(tr("Points"));
+  cbExport->addItem(tr("Points inside voxels"));
+  cbExport->addItem(tr("Voxel centres"));
+  cbExport->addItem(tr("Surface"));
+  cbExport->setMaximumWidth(200);
+
+  auto btnExport = new QPushButton(tr("Export..."));
+  btnExport->setMaximumWidth(100);
+  connect(btnExport, &QPushButton::pressed, [=]() {
+      const QString path = QFileDialog::getSaveFileName(this, tr("Export PLY file"), "", tr("PLY Files (*.ply)"));
+      if (path.isEmpty())
+        return;
+      try {
+        switch (cbExport->currentIndex()) {
+          case 0: _scene->exportPoints(path, false); break;
+          case 1: _scene->exportPoints(path, true); break;
+          case 2: _scene->exportVoxels(path); break;
+          default: _scene->exportMesh(path); break;
+        }
+      } catch (const std::exception& e) {
+        QMessageBox::warning(this, tr("Cannot export"), e.what());
+      }
+  });
+
   auto cbDrawPoints = new QCheckBox(tr("Draw point cloud"));
   cbDrawPoints->setMaximumWidth(200);
-  cbDrawPoints->setCheckState(Qt::CheckState::Checked);
+  cbDrawPoints->setCheckState(_scene->_drawPoints ? Qt::CheckState::Checked : Qt::CheckState::Unchecked);
   connect(cbDrawPoints, &QCheckBox::stateChanged, [=](const int state) {
       _scene->_drawPoints = state;
       _scene->update();
   });
 
+  // how much of the file survived the load filters, or of a live stream
+  // still fits the ring
+  auto lblPoints = new QLabel();
+  auto showPointsCount = [=]() {
+    if (_scene->pointsCount() == _scene->sourcePointsCount()) {
+      lblPoints->setText(QString("%1 points").arg(_scene->pointsCount()));
+    } else {
+      lblPoints->setText(QString("%1 of %2 points").arg(_scene->pointsCount()).arg(_scene->sourcePointsCount()));
+    }
+  };
+  showPointsCount();
+  connect(_scene, &Scene::pointsChanged, showPointsCount);
+
+  //
+  // make distance colouring, when the config has a reference cloud
+  //
+  QWidget *distancesWidget = nullptr;
+  if (_scene->hasDistances()) {
+    const DistanceHistogram& histogram = _scene->distanceHistogram();
+    auto cbDistances = new QCheckBox(tr("Colour by distance to reference"));
+    connect(cbDistances, &QCheckBox::stateChanged, [=](const int state) {
+        _scene->setDistanceColouring(state);
+    });
+
+    // red from a share of the largest distance, the 95th percentile at first
+    auto distanceRangeSlider = new QSlider(Qt::Horizontal);
+    distanceRangeSlider->setRange(1, 1000);
+    distanceRangeSlider->setValue(qMax(1, int(histogram.percentile95 / qMax(histogram.max, 1e-30f) * 1000)));
+    auto lblDistanceRange = new QLabel(QString("Red from %1").arg(histogram.percentile95));
+    connect(distanceRangeSlider, &QSlider::valueChanged, [=](const int value) {
+        const double range = histogram.max * value / 1000.;
+        lblDistanceRange->setText(QString("Red from %1").arg(range));
+        _scene->setDistanceRange(range);
+    });
+
+    auto lblDistances = new QLabel(QString("Distance: mean %1, median %2,\n95% under %3, max %4")
+                                   .arg(histogram.mean).arg(histogram.median)
+                                   .arg(histogram.percentile95).arg(histogram.max));
+    QStringList bins;
+    for (int b = 0; b < DistanceHistogram::BINS; b++) {
+      bins << QString("%1 - %2: %3%").arg(b * histogram.binWidth).arg((b + 1) * histogram.binWidth)
+                                      .arg(100. * histogram.bins[b] / histogram.count, 0, 'f', 2);
+    }
+    bins << QString("%1 and over: %2%").arg(histogram.percentile99)
+                                       .arg(100. * histogram.beyond / histogram.count, 0, 'f', 2);
+    lblDistances->setToolTip(bins.join("\n"));
+
+    QVBoxLayout *distancesLayout = new QVBoxLayout();
+    distancesLayout->setContentsMargins(0, 0, 0, 0);
+    distancesLayout->addWidget(cbDistances);
+    distancesLayout->addWidget(distanceRangeSlider);
+    distancesLayout->addWidget(lblDistanceRange);
+    distancesLayout->addWidget(lblDistances);
+    distancesWidget = new QWidget();
+    distancesWidget->setLayout(distancesLayout);
+  }
+
+  //
+  // make scans list, when the config adds scans to the points
+  //
+  QWidget *scansWidget = nullptr;
+  const Workspace *workspace = _scene->workspace();
+  if (workspace && workspace->scansCount() > 1) {
+    auto lwScans = new QListWidget();
+    lwScans->setMaximumWidth(280);
+    lwScans->setMaximumHeight(150);
+    auto lblBuffer = new QLabel();
+    auto showScans = [=]() {
+      const char *states[] = { "unloaded", "deferred", "loading", "uploading", "", "over budget", "failed" };
+      const QSignalBlocker blocker(lwScans);
+      for (size_t i = 0; i < workspace->scansCount(); i++) {
+        const Workspace::Scan& scan = workspace->scan(i);
+        if (int(i) >= lwScans->count()) {
+          auto item = new QListWidgetItem(lwScans);
+          item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        }
+        QListWidgetItem *item = lwScans->item(int(i));
+        QString text = QFileInfo(QString::fromStdString(scan.name)).fileName();
+        if (scan.state != Workspace::Resident)
+          text += QString(" (%1)").arg(tr(states[scan.state]));
+        item->setText(text);
+        item->setToolTip(QString::fromStdString(scan.error.empty() ? scan.name : scan.error));
+        item->setCheckState(scan.visible ? Qt::Checked : Qt::Unchecked);
+      }
+      const double pointMegabytes = POINT_STRIDE * sizeof(float) / double(1 << 20);
+      lblBuffer->setText(QString("%1 of %2 MB of point buffer used")
+                         .arg(workspace->arena().used() * pointMegabytes, 0, 'f', 0)
+                         .arg(workspace->arena().capacity() * pointMegabytes, 0, 'f', 0));
+    };
+    showScans();
+    connect(_scene, &Scene::scansChanged, showScans);
+    connect(lwScans, &QListWidget::itemChanged, [=](QListWidgetItem* item) {
+      _scene->setScanVisible(lwScans->row(item), item->checkState() == Qt::Checked);
+    });
+
+    auto btnLoadScan = new QPushButton(tr("Load"));
+    connect(btnLoadScan, &QPushButton::pressed, [=]() {
+      if (lwScans->currentRow() >= 0)
+        _scene->loadScan(lwScans->currentRow());
+    });
+    auto btnUnloadScan = new QPushButton(tr("Unload"));
+    connect(btnUnloadScan, &QPushButton::pressed, [=]() {
+      if (lwScans->currentRow() >= 0)
+        _scene->unloadScan(lwScans->currentRow());
+    });
+
+    QHBoxLayout *scanButtons = new QHBoxLayout();
+    scanButtons->addWidget(btnLoadScan);
+    scanButtons->addWidget(btnUnloadScan);
+    QVBoxLayout *scansLayout = new QVBoxLayout();
+    scansLayout->setContentsMargins(0, 0, 0, 0);
+    scansLayout->addWidget(lwScans);
+    scansLayout->addLayout(scanButtons);
+    scansLayout->addWidget(lblBuffer);
+    scansWidget = new QWidget();
+    scansWidget->setLayout(scansLayout);
+  }
+
+  //
+  // make memory label, host bytes against the budget and GPU buffers
+  //
+  auto lblMemory = new QLabel();
+  auto showMemory = [=]() {
+    const MemoryBudget& budget = MemoryBudget::instance();
+    const double megabyte = 1 << 20;
+    QString text = QString("Memory %1 MB, peak %2 MB").arg(budget.hostLive() / megabyte, 0, 'f', 0)
+                                                      .arg(budget.hostPeak() / megabyte, 0, 'f', 0);
+    if (budget.limit() > 0)
+      text += QString(" of %1 MB").arg(budget.limit() / megabyte, 0, 'f', 0);
+    lblMemory->setText(text + QString(", GPU %1 MB").arg(budget.live(MemoryBudget::GpuBuffers) / megabyte, 0, 'f', 0));
+
+    QStringList categories;
+    for (int c = 0; c < MemoryBudget::CategoriesCount; c++) {
+      const MemoryBudget::Category category = MemoryBudget::Category(c);
+      categories << QString("%1: %2 MB, peak %3 MB").arg(MemoryBudget::name(category))
+                                                  .arg(budget.live(category) / megabyte, 0, 'f', 1)
+                                                  .arg(budget.peak(category) / megabyte, 0, 'f', 1);
+    }
+    lblMemory->setToolTip(categories.join("\n"));
+  };
+  showMemory();
+  auto memoryTimer = new QTimer(this);
+  connect(memoryTimer, &QTimer::timeout, showMemory);
+  memoryTimer->start(MEMORY_POLL_MILLISECONDS);
+
   auto cbDrawSpace = new QCheckBox(tr("Draw voxels space"));
   cbDrawSpace->setMaximumWidth(200);
   connect(cbDrawSpace, &QCheckBox::stateChanged, [=](const int state) {
@@ -111,13 +449,49 @@ Viewer::Viewer(const QString& configPath)
       _scene->update();
   });
 
+  auto cbDrawSurface = new QCheckBox(tr("Draw surface"));
+  cbDrawSurface->setMaximumWidth(200);
+  connect(cbDrawSurface, &QCheckBox::stateChanged, [=](const int state) {
+      _scene->_drawSurface = state;
+      _scene->update();
+  });
+
   auto cbDrawVoxels = new QCheckBox(tr("Draw voxels"));
   cbDrawVoxels->setMaximumWidth(200);
+  cbDrawVoxels->setCheckState(_scene->_drawVoxels ? Qt::CheckState::Checked : Qt::CheckState::Unchecked);
   connect(cbDrawVoxels, &QCheckBox::stateChanged, [=](const int state) {
       _scene->_drawVoxels = state;
       _scene->update();
   });
 
+  // cubes cost a draw per occupied voxel, rays a pass over the view
+  auto cbVoxelRendering = new QComboBox();
+  cbVoxelRendering->setMaximumWidth(200);
+  cbVoxelRendering->addItem(tr("Voxels as cubes"), Scene::VoxelsCubes);
+  cbVoxelRendering->addItem(tr("Raymarched voxels"), Scene::VoxelsRaymarched);
+  cbVoxelRendering->addItem(tr("Raymarched, skip empty space"), Scene::VoxelsRaymarchedSkipping);
+  cbVoxelRendering->setCurrentIndex(cbVoxelRendering->findData(Scene::VoxelsRaymarchedSkipping));
+  auto limitVoxelSize = [=]() {
+      const bool cubes = !_scene->hasRaymarching() || cbVoxelRendering->currentData().toInt() == Scene::VoxelsCubes;
+      voxelSizeSlider->setMaximum(cubes ? int(Scene::CUBES_MAX_VOXELS) : MAX_VOXELS);
+  };
+  connect(cbVoxelRendering, static_cast<void(QComboBox::*)(int) >(&QComboBox::currentIndexChanged), [=](const int newValue) {
+      _scene->setVoxelRendering(cbVoxelRendering->itemData(newValue).toInt());
+      limitVoxelSize();
+  });
+  // known once the view has a GL context; queued, the grid may be resized
+  // and must not be while the scene paints
+  connect(_scene, &Scene::raymarchingChecked, this, [=](bool available) {
+      const QStandardItemModel *model = qobject_cast<QStandardItemModel*>(cbVoxelRendering->model());
+      for (int i = 0; i < cbVoxelRendering->count(); i++) {
+        if (cbVoxelRendering->itemData(i).toInt() != Scene::VoxelsCubes)
+          model->item(i)->setEnabled(available);
+      }
+      if (!available)
+        cbVoxelRendering->setCurrentIndex(cbVoxelRendering->findData(Scene::VoxelsCubes));
+      limitVoxelSize();
+  }, Qt::QueuedConnection);
+
 
   //
   // compose control panel
@@ -131,16 +505,41 @@ Viewer::Viewer(const QString& configPath)
   controlPanel->addWidget(cbCamera);
   controlPanel->addSpacing(30);
   controlPanel->addWidget(cbDrawPoints);
+  controlPanel->addWidget(lblPoints);
+  if (scansWidget)
+    controlPanel->addWidget(scansWidget);
+  if (distancesWidget)
+    controlPanel->addWidget(distancesWidget);
   controlPanel->addSpacing(10);
   controlPanel->addWidget(cbDrawSpace);
   controlPanel->addSpacing(10);
   controlPanel->addWidget(cbDrawVoxels);
+  controlPanel->addWidget(cbVoxelRendering);
+  controlPanel->addSpacing(10);
+  controlPanel->addWidget(cbDrawSurface);
   controlPanel->addSpacing(30);
   controlPanel->addWidget(vspWidget);
   controlPanel->addSpacing(30);
   controlPanel->addWidget(btnIntersect);
   controlPanel->addSpacing(10);
+  controlPanel->addWidget(cbCarveEngine);
+  controlPanel->addWidget(cbFreeSpace);
   controlPanel->addWidget(btnCarve);
+  controlPanel->addWidget(lblCarve);
+  controlPanel->addWidget(lblFreeSpace);
+  controlPanel->addSpacing(10);
+  controlPanel->addWidget(btnValidate);
+  controlPanel->addWidget(lblValidation);
+  controlPanel->addWidget(lwWorstViews);
+  controlPanel->addSpacing(10);
+  controlPanel->addWidget(cbSmoothSurface);
+  controlPanel->addWidget(btnSurface);
+  controlPanel->addWidget(lblSurface);
+  controlPanel->addSpacing(30);
+  controlPanel->addWidget(cbExport);
+  controlPanel->addWidget(btnExport);
+  controlPanel->addSpacing(10);
+  controlPanel->addWidget(lblMemory);
   controlPanel->addStretch(2);
 
   //
@@ -215,3 +614,7 @@ void Viewer::_updatePointSize(int value) {
 void Viewer::_updateVoxelSize(int value) {
   _scene->setVoxelSize(value);
 }
+
+void Viewer::_updateMinPointsPerVoxel(int value) {
+  _scene->setMinPointsPerVoxel(value);
+}
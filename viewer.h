@@ -23,6 +23,7 @@ protected:
 private slots:
   void _updatePointSize(int);
   void _updateVoxelSize(int);
+  void _updateMinPointsPerVoxel(int);
 
 
 private:
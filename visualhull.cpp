@@ -0,0 +1,504 @@
+#include "visualhull.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "taskpool.h"
+
+// margin kept between a column and the plane where a view's projection
+// degenerates, in voxels
+const float PLANE_MARGIN = 1e-4f;
+
+// voxels per tile side when culling views
+const int TILE_SIZE = 8;
+
+VisualHull::VisualHull(float originX, float originY, float originZ, float voxSize, int nbVox)
+  : _voxSize(voxSize),
+    _nbVox(nbVox),
+    _cameras(nullptr),
+    _masks(nullptr),
+    _unseen(CarveUnseen),
+    _viewTilePairs(0),
+    _skippedPairs(0)
+{
+  _origin[0] = originX;
+  _origin[1] = originY;
+  _origin[2] = originZ;
+}
+
+void VisualHull::setCameras(const CameraStore* cameras, const Silhouette* const* masks)
+{
+  _cameras = cameras;
+  _masks = masks;
+
+  // bound each frustum inside the box of voxel centres once, in tiles
+  const size_t count = cameras->size();
+  const int n = _nbVox;
+  float boxMin[3], boxMax[3];
+  for (int axis = 0; axis < 3; axis++) {
+    _tileFirst[axis].assign(count, 1);
+    _tileLast[axis].assign(count, 0);
+    boxMin[axis] = _origin[axis] + _voxSize * .5f;
+    boxMax[axis] = _origin[axis] + _voxSize * (n - .5f);
+  }
+  TaskPool::instance().parallelFor(0, count, [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; c++) {
+      float min[3], max[3];
+      if (!_cameras->frustumBounds(c, boxMin, boxMax, min, max))
+        continue;
+      for (int axis = 0; axis < 3; axis++) {
+        // a voxel of margin against rounding
+        const int first = int(std::floor((min[axis] - _origin[axis]) / _voxSize - .5f)) - 1;
+        const int last = int(std::ceil((max[axis] - _origin[axis]) / _voxSize - .5f)) + 1;
+        _tileFirst[axis][c] = std::max(first, 0) / TILE_SIZE;
+        _tileLast[axis][c] = std::min(last, n - 1) / TILE_SIZE;
+      }
+    }
+  }, 16);
+}
+
+VisualHull::Look VisualHull::_look(const float* m, const Silhouette& mask, const float* X) const
+{
+  const float x = m[0] * X[0] + m[4] * X[1] + m[8]  * X[2] + m[12];
+  const float y = m[1] * X[0] + m[5] * X[1] + m[9]  * X[2] + m[13];
+  const float z = m[2] * X[0] + m[6] * X[1] + m[10] * X[2] + m[14];
+  if (!(z > 0.f))
+    return Unseen;
+
+  const float u = x / z;
+  const float v = -y / z;
+  if (std::fabs(u) >= 1.f || std::fabs(v) >= 1.f)
+    return Unseen;
+
+  const int w = mask.width(), h = mask.height();
+  const int px = std::min(int((u + 1.f) * .5f * w), w - 1);
+  const int py = std::min(int((v + 1.f) * .5f * h), h - 1);
+  return mask.contains(px, py) ? Inside : Outside;
+}
+
+bool VisualHull::_keeps(const std::vector<uint32_t>& views, const float* matrices, const float* X) const
+{
+  bool seen = false;
+  for (size_t i = 0; i < views.size(); i++) {
+    const Look look = _look(matrices + 16 * i, *_masks[views[i]], X);
+    if (look == Outside || (look == Unseen && _unseen == CarveUnseen))
+      return false;
+    seen = seen || look == Inside;
+  }
+  return seen || _unseen == CarveUnseen;
+}
+
+void VisualHull::_tileViews(const int* first, const int* last, std::vector<uint32_t>& views,
+                           std::vector<float>& matrices) const
+{
+  views.clear();
+  matrices.clear();
+  int tileFirst[3], tileLast[3];
+  float boxMin[3], boxMax[3];
+  for (int axis = 0; axis < 3; axis++) {
+    tileFirst[axis] = first[axis] / TILE_SIZE;
+    tileLast[axis] = last[axis] / TILE_SIZE;
+    boxMin[axis] = _origin[axis] + _voxSize * (first[axis] + .5f);
+    boxMax[axis] = _origin[axis] + _voxSize * (last[axis] + .5f);
+  }
+
+  for (size_t c = 0; c < _cameras->size(); c++) {
+    bool overlaps = true;
+    for (int axis = 0; axis < 3 && overlaps; axis++) {
+      overlaps = _tileFirst[axis][c] <= tileLast[axis] && tileFirst[axis] <= _tileLast[axis][c];
+    }
+    if (overlaps && _cameras->mayOverlap(c, boxMin, boxMax)) {
+      views.push_back(uint32_t(c));
+      for (int e = 0; e < 16; e++)
+        matrices.push_back(_cameras->matrix(e)[c]);
+    }
+  }
+}
+
+bool VisualHull::_tileMayKeep(const std::vector<uint32_t>& views) const
+{
+  // a view that misses the tile carves all of it, unless unseen voxels are kept
+  return _unseen == CarveUnseen ? views.size() == _cameras->size() : !views.empty();
+}
+
+void VisualHull::carveVoxels(unsigned char* occupancy)
+{
+  const int n = _nbVox;
+  const int tiles = (n + TILE_SIZE - 1) / TILE_SIZE;
+  const float half = _voxSize * .5f;
+  std::atomic<size_t> visited(0);
+
+  TaskPool::instance().parallelFor(0, size_t(tiles) * tiles * tiles, [&](size_t begin, size_t end) {
+    std::vector<uint32_t> views;
+    std::vector<float> matrices;
+    for (size_t tile = begin; tile < end; tile++) {
+      int first[3], last[3];
+      first[0] = int(tile / (size_t(tiles) * tiles)) * TILE_SIZE;
+      first[1] = int(tile / tiles % tiles) * TILE_SIZE;
+      first[2] = int(tile % tiles) * TILE_SIZE;
+      for (int axis = 0; axis < 3; axis++) {
+        last[axis] = std::min(first[axis] + TILE_SIZE, n) - 1;
+      }
+      _tileViews(first, last, views, matrices);
+      const bool mayKeep = _tileMayKeep(views);
+      if (mayKeep)
+        visited += views.size();
+
+      for (int i = first[0]; i <= last[0]; i++) {
+        for (int j = first[1]; j <= last[1]; j++) {
+          float X[3];
+          X[0] = _origin[0] + i * _voxSize + half;
+          X[1] = _origin[1] + j * _voxSize + half;
+          for (int k = first[2]; k <= last[2]; k++) {
+            X[2] = _origin[2] + k * _voxSize + half;
+            occupancy[(size_t(i) * n + j) * n + k] = mayKeep && _keeps(views, matrices.data(), X);
+          }
+        }
+      }
+    }
+  }, 1);
+
+  _viewTilePairs = size_t(tiles) * tiles * tiles * _cameras->size();
+  _skippedPairs = _viewTilePairs - visited;
+}
+
+void VisualHull::distanceField(float* distance) const
+{
+  const int n = _nbVox;
+  const int tiles = (n + TILE_SIZE - 1) / TILE_SIZE;
+  const float half = _voxSize * .5f;
+
+  TaskPool::instance().parallelFor(0, size_t(tiles) * tiles * tiles, [&](size_t begin, size_t end) {
+    std::vector<uint32_t> views;
+    std::vector<float> matrices;
+    for (size_t tile = begin; tile < end; tile++) {
+      int first[3], last[3];
+      first[0] = int(tile / (size_t(tiles) * tiles)) * TILE_SIZE;
+      first[1] = int(tile / tiles % tiles) * TILE_SIZE;
+      first[2] = int(tile % tiles) * TILE_SIZE;
+      for (int axis = 0; axis < 3; axis++) {
+        last[axis] = std::min(first[axis] + TILE_SIZE, n) - 1;
+      }
+      _tileViews(first, last, views, matrices);
+      // views missing the tile carve it
+      const bool missed = _unseen == CarveUnseen && views.size() < _cameras->size();
+
+      for (int i = first[0]; i <= last[0]; i++) {
+        for (int j = first[1]; j <= last[1]; j++) {
+          float X[3];
+          X[0] = _origin[0] + i * _voxSize + half;
+          X[1] = _origin[1] + j * _voxSize + half;
+          for (int k = first[2]; k <= last[2]; k++) {
+            X[2] = _origin[2] + k * _voxSize + half;
+            float d = missed ? 1.f : -std::numeric_limits<float>::max();
+            bool seen = false;
+            for (size_t c = 0; c < views.size(); c++) {
+              const float *m = &matrices[16 * c];
+              const Silhouette& mask = *_masks[views[c]];
+              const float x = m[0] * X[0] + m[4] * X[1] + m[8]  * X[2] + m[12];
+              const float y = m[1] * X[0] + m[5] * X[1] + m[9]  * X[2] + m[13];
+              const float z = m[2] * X[0] + m[6] * X[1] + m[10] * X[2] + m[14];
+              const float u = x / z, vv = -y / z;
+              if (!(z > 0.f) || std::fabs(u) >= 1.f || std::fabs(vv) >= 1.f) {
+                // unseen voxels are carved, keep them at least a voxel out
+                if (_unseen == CarveUnseen)
+                  d = std::max(d, 1.f);
+                continue;
+              }
+              seen = true;
+
+              const int w = mask.width(), h = mask.height();
+              const int px = std::min(int((u + 1.f) * .5f * w), w - 1);
+              const int py = std::min(int((vv + 1.f) * .5f * h), h - 1);
+              // pixels covered by a voxel at this depth
+              const float footprint = .25f * _voxSize / z *
+                  (w * std::sqrt(m[0] * m[0] + m[4] * m[4] + m[8] * m[8]) +
+                   h * std::sqrt(m[1] * m[1] + m[5] * m[5] + m[9] * m[9]));
+              d = std::max(d, mask.distance(px, py) / std::max(footprint, 1e-6f));
+            }
+            // nothing sees it: carved when unseen voxels are kept, kept with no view at all
+            if (!seen && _unseen == KeepUnseen)
+              d = 1.f;
+            distance[(size_t(i) * n + j) * n + k] = _cameras->size() == 0 ? -1.f : d;
+          }
+        }
+      }
+    }
+  }, 1);
+}
+
+bool VisualHull::_seenRange(size_t view, const float* start, float& tBegin, float& tEnd) const
+{
+  // plane(start + t * (0, 0, voxSize)) = a + t * b, seen where all are > 0
+  for (int p = 0; p < CameraStore::FRUSTUM_PLANES; p++) {
+    const float *k[4] = { _cameras->plane(p, 0), _cameras->plane(p, 1), _cameras->plane(p, 2), _cameras->plane(p, 3) };
+    const float a = k[0][view] * start[0] + k[1][view] * start[1] + k[2][view] * start[2] + k[3][view];
+    const float b = k[2][view] * _voxSize;
+    if (b > 0.f) {
+      tBegin = std::max(tBegin, -a / b);
+    } else if (b < 0.f) {
+      tEnd = std::min(tEnd, -a / b);
+    } else if (!(a > 0.f)) {
+      return false;
+    }
+  }
+  return tBegin <= tEnd;
+}
+
+void VisualHull::carveIntervals(unsigned char* occupancy)
+{
+  const int n = _nbVox;
+  const int tiles = (n + TILE_SIZE - 1) / TILE_SIZE;
+  const float half = _voxSize * .5f;
+  std::atomic<size_t> visited(0);
+
+  // tiles of whole columns
+  TaskPool::instance().parallelFor(0, size_t(tiles) * tiles, [&](size_t begin, size_t end) {
+    std::vector<uint32_t> views;
+    std::vector<float> matrices;
+    std::vector<Interval> column, viewIntervals, kept, seen;
+
+    // intersect the column with a sorted list of disjoint intervals
+    auto intersect = [&](const std::vector<Interval>& other) {
+      kept.clear();
+      size_t a = 0, b = 0;
+      while (a < column.size() && b < other.size()) {
+        Interval both;
+        both.begin = std::max(column[a].begin, other[b].begin);
+        both.end = std::min(column[a].end, other[b].end);
+        if (both.begin <= both.end) {
+          kept.push_back(both);
+        }
+        if (column[a].end < other[b].end) {
+          a++;
+        } else {
+          b++;
+        }
+      }
+      column.swap(kept);
+    };
+
+    for (size_t tile = begin; tile < end; tile++) {
+      int first[3], last[3];
+      first[0] = int(tile / tiles) * TILE_SIZE;
+      first[1] = int(tile % tiles) * TILE_SIZE;
+      first[2] = 0;
+      last[0] = std::min(first[0] + TILE_SIZE, n) - 1;
+      last[1] = std::min(first[1] + TILE_SIZE, n) - 1;
+      last[2] = n - 1;
+      _tileViews(first, last, views, matrices);
+      const bool mayKeep = _tileMayKeep(views);
+      if (mayKeep)
+        visited += views.size();
+
+      for (int i = first[0]; i <= last[0]; i++) {
+        for (int j = first[1]; j <= last[1]; j++) {
+          unsigned char *out = occupancy + (size_t(i) * n + j) * n;
+          std::memset(out, 0, n);
+          if (!mayKeep)
+            continue;
+
+          // t walks the column in voxels, t = k is the centre of voxel k
+          float start[3];
+          start[0] = _origin[0] + i * _voxSize + half;
+          start[1] = _origin[1] + j * _voxSize + half;
+          start[2] = _origin[2] + half;
+
+          column.assign(1, Interval());
+          column[0].begin = 0.f;
+          column[0].end = n - 1;
+          seen.clear();
+
+          for (size_t c = 0; c < views.size() && !column.empty(); c++) {
+            const float tBegin = column.front().begin, tEnd = column.back().end;
+            if (_unseen == CarveUnseen) {
+              _viewIntervals(views[c], start, tBegin, tEnd, viewIntervals);
+            } else {
+              // the view leaves alone what it does not see
+              Interval range = { tBegin, tEnd };
+              if (!_seenRange(views[c], start, range.begin, range.end))
+                continue;
+              seen.push_back(range);
+              _viewIntervals(views[c], start, range.begin, range.end, viewIntervals);
+              if (range.begin > tBegin) {
+                const Interval before = { tBegin, range.begin };
+                viewIntervals.insert(viewIntervals.begin(), before);
+              }
+              if (range.end < tEnd) {
+                const Interval after = { range.end, tEnd };
+                viewIntervals.push_back(after);
+              }
+            }
+
+            intersect(viewIntervals);
+          }
+
+          // and some view must see what is kept
+          if (_unseen == KeepUnseen && !column.empty()) {
+            std::sort(seen.begin(), seen.end(), [](const Interval& l, const Interval& r) {
+              return l.begin < r.begin;
+            });
+            size_t merged = 0;
+            for (size_t c = 1; c < seen.size(); c++) {
+              if (seen[c].begin <= seen[merged].end) {
+                seen[merged].end = std::max(seen[merged].end, seen[c].end);
+              } else {
+                seen[++merged] = seen[c];
+              }
+            }
+            seen.resize(std::min(seen.size(), merged + 1));
+            intersect(seen);
+          }
+
+          for (size_t c = 0; c < column.size(); c++) {
+            const int kBegin = std::max(0, int(std::ceil(column[c].begin)));
+            const int kEnd = std::min(n - 1, int(std::floor(column[c].end)));
+            for (int k = kBegin; k <= kEnd; k++) {
+              out[k] = 1;
+            }
+          }
+        }
+      }
+    }
+  }, 1);
+
+  _viewTilePairs = size_t(tiles) * tiles * _cameras->size();
+  _skippedPairs = _viewTilePairs - visited;
+}
+
+void VisualHull::_viewIntervals(size_t view, const float* start, float tBegin, float tEnd,
+                                std::vector<Interval>& out) const
+{
+  out.clear();
+
+  // the column X(t) = start + t * (0, 0, voxSize) projects to M*X(t) = a + t*d
+  float m[16];
+  for (int e = 0; e < 16; e++)
+    m[e] = _cameras->matrix(e)[view];
+  const float ax = m[0] * start[0] + m[4] * start[1] + m[8]  * start[2] + m[12];
+  const float ay = m[1] * start[0] + m[5] * start[1] + m[9]  * start[2] + m[13];
+  const float az = m[2] * start[0] + m[6] * start[1] + m[10] * start[2] + m[14];
+  const float dx = m[8]  * _voxSize;
+  const float dy = m[9]  * _voxSize;
+  const float dz = m[10] * _voxSize;
+
+  // keep the part of the column in front of the view (z > 0)
+  if (dz > 0.f) {
+    tBegin = std::max(tBegin, -az / dz + PLANE_MARGIN);
+  } else if (dz < 0.f) {
+    tEnd = std::min(tEnd, -az / dz - PLANE_MARGIN);
+  } else if (!(az > 0.f)) {
+    return;
+  }
+  if (tBegin > tEnd)
+    return;
+
+  // homogeneous pixel coordinates: pixel(t) = (nx0 + t*nx1, ny0 + t*ny1) / (az + t*dz)
+  const Silhouette& mask = *_masks[view];
+  const int w = mask.width(), h = mask.height();
+  const float nx0 = (ax + az) * .5f * w, nx1 = (dx + dz) * .5f * w;
+  const float ny0 = (az - ay) * .5f * h, ny1 = (dz - dy) * .5f * h;
+
+  const float zBegin = az + tBegin * dz, zEnd = az + tEnd * dz;
+  const float xBegin = (nx0 + tBegin * nx1) / zBegin, yBegin = (ny0 + tBegin * ny1) / zBegin;
+  const float xEnd = (nx0 + tEnd * nx1) / zEnd, yEnd = (ny0 + tEnd * ny1) / zEnd;
+  const float ex = xEnd - xBegin, ey = yEnd - yBegin;
+
+  // the column runs through the view's centre and projects onto one pixel
+  if (std::fabs(ex) < 1e-3f && std::fabs(ey) < 1e-3f) {
+    const int px = int(std::floor(xBegin)), py = int(std::floor(yBegin));
+    if (px >= 0 && px < w && py >= 0 && py < h && mask.contains(px, py)) {
+      Interval all;
+      all.begin = tBegin;
+      all.end = tEnd;
+      out.push_back(all);
+    }
+    return;
+  }
+
+  // clip the image segment pixel(s) = begin + s * e to [0, w] x [0, h]
+  float sBegin = 0.f, sEnd = 1.f;
+  const float p[4] = { -ex, ex, -ey, ey };
+  const float q[4] = { xBegin, w - xBegin, yBegin, h - yBegin };
+  for (int e = 0; e < 4; e++) {
+    if (p[e] == 0.f) {
+      if (q[e] < 0.f)
+        return;
+    } else {
+      const float r = q[e] / p[e];
+      if (p[e] < 0.f) {
+        sBegin = std::max(sBegin, r);
+      } else {
+        sEnd = std::min(sEnd, r);
+      }
+    }
+  }
+  if (sBegin >= sEnd)
+    return;
+
+  // walk the lines of the minor axis the segment crosses, cutting each
+  // crossing with the runs of the major axis
+  const bool xMajor = std::fabs(ex) >= std::fabs(ey);
+  const float majorBegin = xMajor ? xBegin : yBegin, majorStep = xMajor ? ex : ey;
+  const float minorBegin = xMajor ? yBegin : xBegin, minorStep = xMajor ? ey : ex;
+  const float n0 = xMajor ? nx0 : ny0, n1 = xMajor ? nx1 : ny1;
+  const int minorSize = xMajor ? h : w;
+
+  const float minorA = minorBegin + sBegin * minorStep, minorB = minorBegin + sEnd * minorStep;
+  const int lineFirst = std::max(0, int(std::floor(std::min(minorA, minorB))));
+  const int lineLast = std::min(minorSize - 1, int(std::floor(std::max(minorA, minorB))));
+
+  for (int line = lineFirst; line <= lineLast; line++) {
+    float s0 = sBegin, s1 = sEnd;
+    if (minorStep != 0.f) {
+      const float sa = (line - minorBegin) / minorStep, sb = (line + 1 - minorBegin) / minorStep;
+      s0 = std::max(s0, std::min(sa, sb));
+      s1 = std::min(s1, std::max(sa, sb));
+    }
+    if (s0 >= s1)
+      continue;
+
+    const float lo = majorBegin + s0 * majorStep, hi = majorBegin + s1 * majorStep;
+    const float majorLo = std::min(lo, hi), majorHi = std::max(lo, hi);
+
+    const Silhouette::Run *run = xMajor ? mask.rowBegin(line) : mask.columnBegin(line);
+    const Silhouette::Run *runEnd = xMajor ? mask.rowEnd(line) : mask.columnEnd(line);
+    run = std::lower_bound(run, runEnd, majorLo, [](const Silhouette::Run& r, float value) {
+      return r.end <= value;
+    });
+    for (; run != runEnd && run->begin < majorHi; run++) {
+      const float c0 = std::max(float(run->begin), majorLo);
+      const float c1 = std::min(float(run->end), majorHi);
+      if (c0 >= c1)
+        continue;
+      // invert the projection along the major axis: c = (n0 + t*n1) / (az + t*dz)
+      const float t0 = (n0 - c0 * az) / (c0 * dz - n1);
+      const float t1 = (n0 - c1 * az) / (c1 * dz - n1);
+      Interval interval;
+      interval.begin = std::max(tBegin, std::min(t0, t1));
+      interval.end = std::min(tEnd, std::max(t0, t1));
+      if (interval.begin <= interval.end) {
+        out.push_back(interval);
+      }
+    }
+  }
+
+  // crossings come per line, sort and merge them into disjoint intervals
+  std::sort(out.begin(), out.end(), [](const Interval& l, const Interval& r) {
+    return l.begin < r.begin;
+  });
+  size_t merged = 0;
+  for (size_t c = 1; c < out.size(); c++) {
+    if (out[c].begin <= out[merged].end + PLANE_MARGIN) {
+      out[merged].end = std::max(out[merged].end, out[c].end);
+    } else {
+      out[++merged] = out[c];
+    }
+  }
+  if (!out.empty()) {
+    out.resize(merged + 1);
+  }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "camerastore.h"
+#include "silhouette.h"
+
+// Builds the visual hull of the bundle silhouettes into an nbVox^3 occupancy
+// grid laid out as Scene's _voxStorage (x*nbVox*nbVox + y*nbVox + z).
+//
+// A voxel centre X is seen by a view when the combined projection * view
+// matrix M gives M*X = (x, y, z, w) with z > 0, |x/z| < 1 and |y/z| < 1; it
+// then lands on pixel ((x/z + 1)/2 * width, (-y/z + 1)/2 * height) of that
+// view's mask. A voxel is kept when every view sees it inside its mask or,
+// with KeepUnseen, when a view sees it and every view that does sees it
+// inside its mask.
+//
+// Two engines produce the same grid:
+//  - carveVoxels() projects every voxel centre into every view, its cost
+//    grows with nbVox^3 * views;
+//  - carveIntervals() walks the grid column by column: a column of voxel
+//    centres projects onto a segment of each view's image, the segment is
+//    cut by the mask runs it crosses into intervals along the column, and the
+//    intervals of all views are intersected. Its cost grows with
+//    nbVox^2 * views * (pixels crossed across the segment + runs), and a
+//    column stops visiting views as soon as it is empty.
+//
+// Both walk the grid in tiles (blocks of voxels, or of columns) and a tile
+// only visits the views whose frustum may reach it: the part of each frustum
+// inside the grid is bounded once per hull, then refined per tile against
+// the frustum planes. With CarveUnseen a tile some view cannot see is empty
+// without visiting any view.
+class VisualHull
+{
+public:
+  enum UnseenVoxels
+  {
+    CarveUnseen, // a view carves what it does not see
+    KeepUnseen   // a view only judges what it sees, e.g. for aerial surveys
+  };
+
+  // grid spanning [origin, origin + nbVox * voxSize] on each axis
+  VisualHull(float originX, float originY, float originZ, float voxSize, int nbVox);
+
+  // masks[c] is camera c's silhouette; all must outlive the hull
+  void setCameras(const CameraStore* cameras, const Silhouette* const* masks);
+  void setUnseenVoxels(UnseenVoxels unseen) { _unseen = unseen; }
+
+  void carveVoxels(unsigned char* occupancy);
+  void carveIntervals(unsigned char* occupancy);
+
+  // view-tile pairs of the last carve, and how many of them were skipped
+  size_t viewTilePairs() const { return _viewTilePairs; }
+  size_t skippedPairs() const { return _skippedPairs; }
+
+  // signed distance from each voxel centre to the hull, in voxels and
+  // negative inside: the largest of the views' mask distances, scaled by the
+  // voxel's footprint in each image. Masks must have computeDistance() done.
+  void distanceField(float* distance) const;
+
+private:
+  enum Look { Unseen, Outside, Inside };
+
+  struct Interval
+  {
+    float begin;
+    float end;
+  };
+
+  Look _look(const float* m, const Silhouette& mask, const float* X) const;
+  bool _keeps(const std::vector<uint32_t>& views, const float* matrices, const float* X) const;
+  // views that may see voxel centres first..last (inclusive, per axis), and
+  // their matrices side by side
+  void _tileViews(const int* first, const int* last, std::vector<uint32_t>& views,
+                  std::vector<float>& matrices) const;
+  bool _tileMayKeep(const std::vector<uint32_t>& views) const;
+  // clip [tBegin, tEnd] along a column to what the view sees
+  bool _seenRange(size_t view, const float* start, float& tBegin, float& tEnd) const;
+  void _viewIntervals(size_t view, const float* start, float tBegin, float tEnd,
+                      std::vector<Interval>& out) const;
+
+  float _origin[3];
+  float _voxSize;
+  int   _nbVox;
+  const CameraStore* _cameras;
+  const Silhouette* const* _masks;
+  UnseenVoxels       _unseen;
+
+  // per view, the range of tiles its frustum meets on each axis, empty when
+  // it sees none of the grid
+  std::vector<int> _tileFirst[3];
+  std::vector<int> _tileLast[3];
+
+  size_t _viewTilePairs;
+  size_t _skippedPairs;
+};
@@ -0,0 +1,206 @@
+#include "voxelizer.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "taskpool.h"
+
+// points binned per counting sort pass, bounds the scratch memory to 32MB
+const size_t VOXELIZER_BLOCK = size_t(1) << 22;
+
+Voxelizer::Voxelizer()
+  : _nbVox(0),
+    _voxSize(0.f),
+    _finalized(false),
+    _pointsCount(0),
+    _slabSize(0)
+{
+  _origin[0] = _origin[1] = _origin[2] = 0.f;
+}
+
+void Voxelizer::reset(float originX, float originY, float originZ, float spaceSize, int nbVox)
+{
+  assert(nbVox > 0);
+  _nbVox = nbVox;
+  _origin[0] = originX;
+  _origin[1] = originY;
+  _origin[2] = originZ;
+  _voxSize = spaceSize / nbVox;
+  _finalized = false;
+  _pointsCount = 0;
+
+  _slabSize = size_t(nbVox) * nbVox;
+  _slots.assign(_slabSize * nbVox, 0);
+  std::vector<Slab>(nbVox).swap(_slabs);
+}
+
+void Voxelizer::accumulate(const float* points, size_t count, size_t stride)
+{
+  assert(!_finalized && stride >= 7);
+  for (size_t first = 0; first < count; first += VOXELIZER_BLOCK) {
+    _accumulateBlock(points + first * stride, std::min(VOXELIZER_BLOCK, count - first), stride);
+  }
+  _pointsCount += count;
+}
+
+void Voxelizer::_accumulateBlock(const float* points, size_t count, size_t stride)
+{
+  const int n = _nbVox;
+  const size_t slabSize = size_t(n) * n;
+  const float invVoxSize = _voxSize > 0.f ? 1.f / _voxSize : 0.f;
+
+  _keys.resize(count);
+  _order.resize(count);
+  _slabStart.assign(n + 1, 0);
+
+  // points are cut into one range per thread; each range gets its slab
+  // histogram, turned into write cursors by the prefix sum
+  TaskPool& pool = TaskPool::instance();
+  const size_t rangesCount = pool.threadsCount();
+  std::vector<std::vector<size_t> > cursors(rangesCount);
+
+  pool.parallelFor(0, rangesCount, [&](size_t r, size_t) {
+    const size_t begin = count * r / rangesCount;
+    const size_t end = count * (r + 1) / rangesCount;
+    std::vector<size_t>& cursor = cursors[r];
+    cursor.assign(n, 0);
+
+    for (size_t i = begin; i < end; ++i) {
+      const float *p = points + i * stride;
+      const int x = voxelCell(p[0], _origin[0], invVoxSize, n);
+      const int y = voxelCell(p[1], _origin[1], invVoxSize, n);
+      const int z = voxelCell(p[2], _origin[2], invVoxSize, n);
+      _keys[i] = (uint32_t(x) * n + y) * n + z;
+      ++cursor[x];
+    }
+  }, 1);
+
+  // exclusive prefix sum, slab-major then range-major, so every range owns a
+  // disjoint part of every slab
+  size_t offset = 0;
+  for (int x = 0; x < n; ++x) {
+    _slabStart[x] = offset;
+    for (size_t r = 0; r < rangesCount; ++r) {
+      const size_t c = cursors[r][x];
+      cursors[r][x] = offset;
+      offset += c;
+    }
+  }
+  _slabStart[n] = offset;
+
+  pool.parallelFor(0, rangesCount, [&](size_t r, size_t) {
+    const size_t begin = count * r / rangesCount;
+    const size_t end = count * (r + 1) / rangesCount;
+    std::vector<size_t>& cursor = cursors[r];
+    for (size_t i = begin; i < end; ++i) {
+      _order[cursor[_keys[i] / slabSize]++] = uint32_t(i);
+    }
+  }, 1);
+
+  // a slab covers a contiguous run of nbVox^2 voxels, only its task touches
+  // it; voxels hit for the first time get an entry at the end of its tables,
+  // grown to fit exactly
+  pool.parallelFor(0, n, [&](size_t x, size_t) {
+    Slab& slab = _slabs[x];
+    uint32_t entries = uint32_t(slab.counts.size());
+    for (size_t s = _slabStart[x]; s < _slabStart[x + 1]; ++s) {
+      uint32_t& slot = _slots[_keys[_order[s]]];
+      if (!slot)
+        slot = ++entries;
+    }
+    if (entries > slab.counts.size()) {
+      slab.counts.reserve(entries);
+      slab.counts.resize(entries, 0);
+      slab.sums.reserve(size_t(entries) * 6);
+      slab.sums.resize(size_t(entries) * 6, 0.);
+    }
+
+    for (size_t s = _slabStart[x]; s < _slabStart[x + 1]; ++s) {
+      const uint32_t i = _order[s];
+      const uint32_t entry = _slots[_keys[i]] - 1;
+      const float *p = points + i * stride;
+      double *sum = &slab.sums[size_t(entry) * 6];
+      ++slab.counts[entry];
+      sum[0] += p[0];
+      sum[1] += p[1];
+      sum[2] += p[2];
+      sum[3] += p[4];
+      sum[4] += p[5];
+      sum[5] += p[6];
+    }
+  }, 1);
+}
+
+void Voxelizer::finalize()
+{
+  if (_finalized)
+    return;
+
+  // the sums are only needed while points come in
+  TaskPool::instance().parallelFor(0, _slabs.size(), [&](size_t x, size_t) {
+    Slab& slab = _slabs[x];
+    const size_t entries = slab.counts.size();
+    slab.colors.resize(entries * 3);
+    slab.centroids.resize(entries * 3);
+    for (size_t e = 0; e < entries; ++e) {
+      const double *sum = &slab.sums[e * 6];
+      const double inv = 1. / slab.counts[e];
+      slab.centroids[e * 3    ] = sum[0] * inv;
+      slab.centroids[e * 3 + 1] = sum[1] * inv;
+      slab.centroids[e * 3 + 2] = sum[2] * inv;
+      slab.colors[e * 3    ] = sum[3] * inv;
+      slab.colors[e * 3 + 1] = sum[4] * inv;
+      slab.colors[e * 3 + 2] = sum[5] * inv;
+    }
+    std::vector<double>().swap(slab.sums);
+  }, 1);
+
+  std::vector<uint32_t>().swap(_keys);
+  std::vector<uint32_t>().swap(_order);
+  _finalized = true;
+}
+
+size_t Voxelizer::peakMemorySize(int nbVox, size_t pointsCount)
+{
+  // slots, then counts, sums, colours and centroids of the occupied voxels,
+  // plus the scratch of one block
+  const size_t cells = size_t(nbVox) * nbVox * nbVox;
+  return cells * sizeof(uint32_t)
+       + std::min(cells, pointsCount) * (sizeof(uint32_t) + 6 * sizeof(double) + 6 * sizeof(float))
+       + std::min(VOXELIZER_BLOCK, pointsCount) * 2 * sizeof(uint32_t);
+}
+
+size_t Voxelizer::memorySize() const
+{
+  size_t bytes = _slots.capacity() * sizeof(uint32_t) + _slabs.capacity() * sizeof(Slab)
+               + (_keys.capacity() + _order.capacity()) * sizeof(uint32_t)
+               + _slabStart.capacity() * sizeof(size_t);
+  for (const Slab& slab : _slabs) {
+    bytes += slab.counts.capacity() * sizeof(uint32_t) + slab.sums.capacity() * sizeof(double)
+           + (slab.colors.capacity() + slab.centroids.capacity()) * sizeof(float);
+  }
+  return bytes;
+}
+
+size_t Voxelizer::occupiedCount() const
+{
+  size_t occupied = 0;
+  for (const Slab& slab : _slabs) {
+    occupied += slab.counts.size();
+  }
+  return occupied;
+}
+
+void Voxelizer::threshold(unsigned minCount, unsigned char* occupancy) const
+{
+  const uint32_t minPoints = std::max(minCount, 1u);
+
+  TaskPool::instance().parallelFor(0, _slabs.size(), [&](size_t x, size_t) {
+    const Slab& slab = _slabs[x];
+    const uint32_t *slots = _slots.data() + x * _slabSize;
+    unsigned char *cells = occupancy + x * _slabSize;
+    for (size_t v = 0; v < _slabSize; ++v) {
+      cells[v] = slots[v] && slab.counts[slots[v] - 1] >= minPoints ? 1 : 0;
+    }
+  }, 1);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// index of the voxel holding v along one axis; points on the max bound go
+// into the last voxel instead of one past the grid
+inline int voxelCell(float v, float origin, float invVoxSize, int nbVox)
+{
+  const float c = (v - origin) * invVoxSize;
+  if (!(c > 0.f)) // also catches NaN
+    return 0;
+  return c >= nbVox ? nbVox - 1 : int(c);
+}
+
+// Bins points into a cubic grid of nbVox^3 voxels and keeps per-voxel
+// point counts, mean colours and centroids.
+//
+// Voxel (x, y, z) is stored at x*nbVox*nbVox + y*nbVox + z, the layout Scene
+// uses for _voxStorage. Points are binned with a parallel counting sort on
+// the x slab of their voxel key: every task histograms and scatters its own
+// contiguous range of points, then every slab is reduced by a single task,
+// so no voxel is ever written by two threads and no atomics are needed.
+//
+// Only the slot index is dense, 4 bytes a voxel; counts, sums, colours and
+// centroids are kept per slab for the voxels points fell in, 76 bytes each
+// at the peak. A 1024^3 grid thus takes 4GB before any point comes in.
+class Voxelizer
+{
+public:
+  Voxelizer();
+
+  // start a new grid of nbVox^3 voxels spanning [origin, origin + spaceSize]
+  void reset(float originX, float originY, float originZ, float spaceSize, int nbVox);
+
+  // bin 'count' points of 'stride' floats each (x, y, z, index, r, g, b);
+  // may be called several times, e.g. once per parsed batch
+  void accumulate(const float* points, size_t count, size_t stride);
+
+  // derive mean colours and centroids; no more points may be accumulated after it
+  void finalize();
+
+  // write 1 into 'occupancy' for voxels holding at least minCount points, 0 elsewhere
+  void threshold(unsigned minCount, unsigned char* occupancy) const;
+
+  // bytes a grid of nbVox^3 voxels holds at most while finalizing, with
+  // 'pointsCount' points each in a voxel of its own at worst
+  static size_t peakMemorySize(int nbVox, size_t pointsCount);
+  // bytes held by the tables and the sort scratch
+  size_t memorySize() const;
+
+  int nbVox() const { return _nbVox; }
+  bool finalized() const { return _finalized; }
+  size_t pointsCount() const { return _pointsCount; }
+
+  // voxels at least a point fell in
+  size_t occupiedCount() const;
+
+  // of voxel v, indexed as the grid; colour and centroid once finalized,
+  // nullptr where no point fell
+  uint32_t count(size_t v) const
+  {
+    const uint32_t slot = _slots[v];
+    return slot ? _slabs[v / _slabSize].counts[slot - 1] : 0;
+  }
+  const float* color(size_t v) const
+  {
+    const uint32_t slot = _slots[v];
+    return slot ? &_slabs[v / _slabSize].colors[(slot - 1) * 3] : nullptr;
+  }
+  const float* centroid(size_t v) const
+  {
+    const uint32_t slot = _slots[v];
+    return slot ? &_slabs[v / _slabSize].centroids[(slot - 1) * 3] : nullptr;
+  }
+
+private:
+  void _accumulateBlock(const float* points, size_t count, size_t stride);
+
+  int   _nbVox;
+  float _origin[3];
+  float _voxSize;
+  bool  _finalized;
+  size_t _pointsCount;
+
+  // the tables of the voxels of an x slab that points fell in, in the order
+  // they were first hit
+  struct Slab
+  {
+    std::vector<uint32_t> counts;
+    std::vector<double>   sums; // x, y, z, r, g, b, released by finalize()
+    std::vector<float>    colors;
+    std::vector<float>    centroids;
+  };
+
+  size_t                _slabSize;
+  std::vector<uint32_t> _slots; // per voxel, 1 + its entry in its slab, 0 where no point fell
+  std::vector<Slab>     _slabs;
+
+  // counting sort scratch, reused between blocks
+  std::vector<uint32_t> _keys;
+  std::vector<uint32_t> _order;
+  std::vector<size_t>   _slabStart;
+};
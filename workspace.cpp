@@ -0,0 +1,283 @@
+#include "workspace.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "normals.h"
+#include "plyreader.h"
+
+const size_t SCAN_READ_BATCH = 1 << 20; // points decoded per read, between cancellation checks
+const size_t STORE_SLICE = 1 << 16;     // points of a store decoded per copy
+
+Workspace::Workspace(size_t capacity, bool normals)
+  : _arena(capacity),
+    _revision(0),
+    _normals(normals)
+{
+}
+
+Workspace::~Workspace()
+{
+  for (size_t i = 0; i < _scans.size(); i++) {
+    if (_scans[i]->loading)
+      _scans[i]->loading->cancel();
+  }
+  // the groups wait for their reads as they go
+  _scans.clear();
+}
+
+size_t Workspace::addPoints(const std::string& name, const float* points, size_t count,
+                            const uint32_t* normals)
+{
+  std::unique_ptr<Entry> entry(new Entry());
+  entry->scan.name = name;
+  entry->scan.state = Unloaded;
+  entry->scan.visible = true;
+  entry->scan.pointsCount = count;
+  entry->scan.first = 0;
+  entry->scan.uploaded = 0;
+  entry->points = points;
+  entry->store = nullptr;
+  entry->normals = normals;
+  _scans.push_back(std::move(entry));
+  _revision++;
+  return _scans.size() - 1;
+}
+
+size_t Workspace::addStore(const std::string& name, const PointStore* store, const uint32_t* normals)
+{
+  const size_t scan = addPoints(name, nullptr, store->size(), normals);
+  _scans[scan]->store = store;
+  return scan;
+}
+
+size_t Workspace::addScan(const std::string& path)
+{
+  // the count is read from the header on load
+  return addPoints(path, nullptr, 0);
+}
+
+void Workspace::load(size_t scan)
+{
+  Entry& entry = *_scans[scan];
+  if (entry.scan.state != Unloaded && entry.scan.state != Failed && entry.scan.state != Refused)
+    return;
+  entry.scan.error.clear();
+
+  if (!_inMemory(entry)) {
+    try {
+      entry.scan.pointsCount = PlyReader(entry.scan.name).pointsCount();
+    } catch (const std::exception& e) {
+      entry.scan.error = e.what();
+      _setState(entry, Failed);
+      return;
+    }
+  }
+
+  if (entry.scan.pointsCount > _arena.capacity()) {
+    _setState(entry, Refused);
+  } else if (!_inMemory(entry) && !MemoryBudget::instance().fits(entry.scan.pointsCount * _pointBytes())) {
+    entry.scan.error = "the memory budget cannot hold it";
+    _setState(entry, Refused);
+  } else if (_reserve(entry)) {
+    _start(entry);
+  } else {
+    _deferred.push_back(scan);
+    _setState(entry, Deferred);
+  }
+}
+
+void Workspace::unload(size_t scan)
+{
+  Entry& entry = *_scans[scan];
+  switch (entry.scan.state) {
+  case Deferred:
+    _deferred.erase(std::find(_deferred.begin(), _deferred.end(), scan));
+    _setState(entry, Unloaded);
+    return;
+  case Loading:
+  case Uploading:
+  case Resident:
+    _release(entry);
+    _setState(entry, Unloaded);
+    _retryDeferred();
+    return;
+  default:
+    return;
+  }
+}
+
+void Workspace::setVisible(size_t scan, bool visible)
+{
+  _scans[scan]->scan.visible = visible;
+  _revision++;
+}
+
+size_t Workspace::upload(size_t maxPoints, const Copy& copy)
+{
+  // reads that finished move on to uploading
+  for (size_t i = 0; i < _scans.size(); i++) {
+    Entry& entry = *_scans[i];
+    if (entry.scan.state != Loading || !entry.loading->isDone())
+      continue;
+    try {
+      entry.loading->wait();
+      entry.loading.reset();
+      _setState(entry, Uploading);
+    } catch (const std::exception& e) {
+      entry.scan.error = e.what();
+      entry.loading.reset();
+      _release(entry);
+      _setState(entry, Failed);
+      _retryDeferred();
+    }
+  }
+
+  size_t copied = 0;
+  for (size_t i = 0; i < _scans.size() && copied < maxPoints; i++) {
+    Entry& entry = *_scans[i];
+    if (entry.scan.state != Uploading)
+      continue;
+    const float *source = entry.points ? entry.points : entry.staging.data();
+    const uint32_t *normals = _inMemory(entry) ? entry.normals : entry.stagingNormals.data();
+    const size_t n = std::min(entry.scan.pointsCount - entry.scan.uploaded, maxPoints - copied);
+    for (size_t done = 0; done < n; ) {
+      // a store decodes into a small slice, copied before the next
+      const size_t first = entry.scan.uploaded + done;
+      const size_t count = entry.store ? std::min(n - done, STORE_SLICE) : n;
+      const float *points;
+      if (entry.store) {
+        _decoded.resize(count * POINT_STRIDE);
+        entry.store->read(first, count, _decoded.data());
+        points = _decoded.data();
+      } else {
+        points = source + first * POINT_STRIDE;
+      }
+      copy(entry.scan.first + first, points, _normals && normals ? normals + first : nullptr, count);
+      done += count;
+    }
+    entry.scan.uploaded += n;
+    copied += n;
+    if (entry.scan.uploaded == entry.scan.pointsCount) {
+      // the buffer holds the points now
+      std::vector<float>().swap(entry.staging);
+      std::vector<uint32_t>().swap(entry.stagingNormals);
+      entry.stagingMemory.set(0);
+      _setState(entry, Resident);
+    }
+  }
+  return copied;
+}
+
+bool Workspace::isBusy() const
+{
+  for (size_t i = 0; i < _scans.size(); i++) {
+    const ScanState state = _scans[i]->scan.state;
+    if (state == Loading || state == Uploading)
+      return true;
+  }
+  return false;
+}
+
+void Workspace::drawRanges(std::vector<int>& firsts, std::vector<int>& counts) const
+{
+  firsts.clear();
+  counts.clear();
+  for (size_t i = 0; i < _scans.size(); i++) {
+    const Scan& scan = _scans[i]->scan;
+    if (scan.state != Resident || !scan.visible || scan.pointsCount == 0)
+      continue;
+    // neighbouring scans draw as one range
+    if (!firsts.empty() && size_t(firsts.back() + counts.back()) == scan.first) {
+      counts.back() += int(scan.pointsCount);
+    } else {
+      firsts.push_back(int(scan.first));
+      counts.push_back(int(scan.pointsCount));
+    }
+  }
+}
+
+size_t Workspace::_pointBytes() const
+{
+  return POINT_STRIDE * sizeof(float) + (_normals ? sizeof(uint32_t) : 0);
+}
+
+void Workspace::_setState(Entry& entry, ScanState state)
+{
+  entry.scan.state = state;
+  _revision++;
+}
+
+bool Workspace::_reserve(Entry& entry)
+{
+  return _arena.allocate(entry.scan.pointsCount, entry.scan.first);
+}
+
+void Workspace::_start(Entry& entry)
+{
+  entry.scan.uploaded = 0;
+  if (!_inMemory(entry)) {
+    // read in the background, the staging copy only lives until uploaded
+    _setState(entry, Loading);
+    entry.loading.reset(new TaskGroup("load scan"));
+    const CancellationToken token = entry.loading->token();
+    Entry *target = &entry;
+    const bool normals = _normals;
+    entry.loading->run([target, token, normals]() {
+      PlyReader reader(target->scan.name);
+      const size_t count = target->scan.pointsCount;
+      const bool readNormals = normals && reader.hasNormals();
+      target->staging.resize(count * POINT_STRIDE);
+      if (normals)
+        target->stagingNormals.resize(count);
+      target->stagingMemory.set(target->staging.capacity() * sizeof(float)
+                                + target->stagingNormals.capacity() * sizeof(uint32_t));
+      for (size_t first = 0; first < count && !token.isCancelled(); ) {
+        const size_t n = reader.read(target->staging.data() + first * POINT_STRIDE,
+                                     std::min(SCAN_READ_BATCH, count - first),
+                                     readNormals ? target->stagingNormals.data() + first : nullptr);
+        if (n == 0)
+          throw std::runtime_error("'" + target->scan.name + "' ends before its last point");
+        first += n;
+      }
+      // files without normals get them from their points
+      if (normals && !readNormals && !token.isCancelled())
+        NormalEstimator().estimate(target->staging.data(), count, target->stagingNormals.data());
+    });
+  } else {
+    _setState(entry, Uploading);
+  }
+}
+
+void Workspace::_release(Entry& entry)
+{
+  if (entry.loading) {
+    // waits for the batch being read
+    entry.loading->cancel();
+    try {
+      entry.loading->wait();
+    } catch (const std::exception&) {
+      // unloaded anyway
+    }
+    entry.loading.reset();
+  }
+  std::vector<float>().swap(entry.staging);
+  std::vector<uint32_t>().swap(entry.stagingNormals);
+  entry.stagingMemory.set(0);
+  _arena.free(entry.scan.first, entry.scan.pointsCount);
+  entry.scan.uploaded = 0;
+}
+
+void Workspace::_retryDeferred()
+{
+  for (size_t i = 0; i < _deferred.size(); ) {
+    Entry& entry = *_scans[_deferred[i]];
+    if (_reserve(entry)) {
+      _deferred.erase(_deferred.begin() + i);
+      _start(entry);
+    } else {
+      i++;
+    }
+  }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bufferarena.h"
+#include "memorybudget.h"
+#include "pointstore.h"
+#include "taskpool.h"
+
+// Scans of one project drawn together from a single vertex buffer of
+// 'capacity' points, the GPU memory budget.
+//
+// Each loaded scan holds a range of the buffer, sub-allocated by a
+// BufferArena, so loading or unloading one never moves the others. Loading
+// reads the header first: a scan larger than the whole buffer is refused,
+// one that does not fit what is free waits, deferred, until an unload makes
+// room. Files are read into memory first, so one the memory budget cannot
+// hold is refused as well. Points are read on the task pool, then upload()
+// hands them to the caller a slice at a time, so the frame copying them to
+// the GPU never stalls on a whole scan. Visible resident scans are drawn by
+// the ranges of drawRanges(), one multi-draw. With normals, each scan also
+// carries a packed normal per point, read from its file or estimated while
+// loading, for a second buffer laid out like the first. Points kept in a
+// PointStore are decoded as they are uploaded.
+class Workspace
+{
+public:
+  enum ScanState
+  {
+    Unloaded,  // never requested, or unloaded
+    Deferred,  // waits for room in the buffer
+    Loading,   // being read on the pool
+    Uploading, // read, handed to upload() a slice at a time
+    Resident,  // in the buffer, drawn while visible
+    Refused,   // larger than the whole buffer, or than the memory budget allows
+    Failed     // unreadable, see error
+  };
+
+  struct Scan
+  {
+    std::string name;        // file path
+    ScanState   state;
+    bool        visible;
+    size_t      pointsCount; // from the header, once requested
+    size_t      first;       // range in the buffer, in points, while it holds one
+    size_t      uploaded;
+    std::string error;
+  };
+
+  // 'normals' is null when the workspace has none
+  typedef std::function<void(size_t first, const float* points, const uint32_t* normals, size_t count)> Copy;
+
+  explicit Workspace(size_t capacity, bool normals = false);
+  ~Workspace();
+
+  // a scan already in memory, e.g. the config's PLY; 'points' (POINT_STRIDE
+  // floats each) and 'normals' must outlive the workspace
+  size_t addPoints(const std::string& name, const float* points, size_t count,
+                   const uint32_t* normals = nullptr);
+  // the same, compressed; 'store' is decoded a slice at a time as uploaded
+  size_t addStore(const std::string& name, const PointStore* store, const uint32_t* normals = nullptr);
+  // a scan read from a PLY file when loaded
+  size_t addScan(const std::string& path);
+
+  void load(size_t scan);
+  void unload(size_t scan);
+  void setVisible(size_t scan, bool visible);
+
+  size_t scansCount() const { return _scans.size(); }
+  const Scan& scan(size_t scan) const { return _scans[scan]->scan; }
+  const BufferArena& arena() const { return _arena; }
+  bool hasNormals() const { return _normals; }
+
+  // collect finished reads and pass up to maxPoints points to 'copy', which
+  // writes them to [first, first + count) of the buffer; returns how many
+  size_t upload(size_t maxPoints, const Copy& copy);
+
+  // loads or uploads still under way
+  bool isBusy() const;
+  // bumped whenever a scan changes state
+  size_t revision() const { return _revision; }
+
+  // buffer ranges of the visible resident scans, in points
+  void drawRanges(std::vector<int>& firsts, std::vector<int>& counts) const;
+
+private:
+  struct Entry
+  {
+    Scan                       scan;
+    const float                *points;  // the caller's, null for a file
+    const PointStore           *store;   // the caller's, instead of points
+    const uint32_t             *normals; // the caller's, null for a file
+    std::vector<float>         staging;  // points read from the file, until uploaded
+    std::vector<uint32_t>      stagingNormals;
+    MemoryAccount              stagingMemory{MemoryBudget::Points};
+    std::unique_ptr<TaskGroup> loading;
+  };
+
+  bool _inMemory(const Entry& entry) const { return entry.points || entry.store; }
+  size_t _pointBytes() const; // staged per point
+  void _setState(Entry& entry, ScanState state);
+  bool _reserve(Entry& entry);
+  void _start(Entry& entry);
+  void _release(Entry& entry);
+  void _retryDeferred();
+
+  BufferArena                          _arena;
+  std::vector<std::unique_ptr<Entry> > _scans;
+  std::vector<size_t>                  _deferred; // oldest request first
+  size_t                               _revision;
+  bool                                 _normals;
+  std::vector<float>                   _decoded; // a slice of a store being uploaded
+};